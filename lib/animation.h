@@ -0,0 +1,12 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+#include "module.h"
+
+// sets up one frame: fill in the view and global transforms, draw state and lights for the frame
+// VTM and GTM start as the identity, ds and lighting start at their defaults
+// called from worker threads, so it must only read shared data
+typedef void (*AnimationFrameFunc)(int frame, Matrix *VTM, Matrix *GTM, DrawState *ds, Lighting *lighting, void *data);
+
+int animation_render(Module *scene, int rows, int cols, int first, int last, AnimationFrameFunc setup, void *data, char *pattern, int nThreads);
+
+#endif
@@ -3,6 +3,17 @@
 #include "color.h"
 #include "point.h"
 #include "image.h"
+#include "matrix.h"
+#include "mesh.h"
+
+// largest distance, in pixels, bezierCurve_draw lets its segments stray from the curve
+#define BEZIER_TOLERANCE 0.25f
+// most segments a curve is evaluated into
+#define BEZIER_MAX_SEGMENTS 1024
+// most steps an adaptive patch is cut into along any side or across its interior
+#define BEZIER_PATCH_LEVELS 64
+// grid cells bezierSurface_grid draws across before starting the next band, to suit a 32-vertex post-transform cache
+#define BEZIER_GRID_BAND 14
 
 typedef struct{
     Point p[4];
@@ -14,13 +25,32 @@ typedef struct{
     int zBuffer;
 }BezierSurface;
 
+// a Bezier surface tessellated when it is drawn, finely enough to stay within tolerance pixels of the surface
+// in the view it is drawn with; patches that share a boundary curve meet without cracks
+typedef struct{
+    BezierSurface surface;
+    float tolerance; // largest distance, in pixels, the triangles may stray from the surface
+}BezierPatch;
+
+// tessellations of patches kept from one frame to the next, keyed by the patch
+typedef struct BezierCache BezierCache;
+
 void bezierCurve_init(BezierCurve *b);
 void bezierSurface_init(BezierSurface *b);
 void bezierCurve_set(BezierCurve *b, Point *vlist);
 void bezierSurface_set(BezierSurface *b, Point *vlist);
 void bezierCurve_zBuffer(BezierCurve *p, int flag);
 void bezierSurface_zBuffer(BezierCurve *p, int flag);
+int bezierCurve_segments(BezierCurve *b, float tolerance);
+void bezierCurve_evaluate(BezierCurve *b, int n, Point *vlist);
 void bezierCurve_draw(BezierCurve *b, Image *src, Color c);
+void bezierSurface_levels(BezierSurface *b, Matrix *screen, float tolerance, int level[6]);
+int bezierSurface_tessellate(BezierSurface *b, int level[6], Mesh *mesh);
+int bezierSurface_grid(BezierSurface *b, int nu, int nv, Mesh *mesh);
+BezierCache *bezierCache_create(void);
+void bezierCache_free(BezierCache *cache);
+void bezierCache_nextFrame(BezierCache *cache);
+Mesh *bezierCache_mesh(BezierCache *cache, BezierPatch *patch, int level[6], int *built);
 float getLargestDimension(BezierCurve *b);
 void de_casteljau(BezierCurve *b, BezierCurve *left, BezierCurve *right);
 
@@ -2,6 +2,7 @@
 #define DRAWSTATE_H
 #include "color.h"
 #include "point.h"
+#include "texture.h"
 
 typedef enum{
     ShadeFrame, // draw only the borders of objects, including polygons
@@ -12,11 +13,6 @@ typedef enum{
     ShadePhong // draw objects using Phong shading
 }ShadeMethod;
 
-typedef struct{
-    Image *i;
-    float s, t;
-}Texture;
-
 typedef struct{
     Color color; // the foreground color, used in the default drawing mode
     Color flatColor; // the color to flat-fill a polygon based on a shading calculation
@@ -25,11 +21,15 @@ typedef struct{
     float surfaceCoeff; // a float that represents the shininess of the surface
     ShadeMethod shade; // an enumerated type ShadeMethod
     int zBufferFlag; // whether to use z-buffer hidden surface removal
+    int floatVertexFlag; // whether module_draw transforms vertices to the screen in single precision
+    int lineAntialiasFlag; // whether lines, polylines and polygon outlines are drawn anti-aliased
+    int depthOnlyFlag; // whether only the depths of surfaces are drawn, as for a shadow map, whatever the shade method; points and lines are skipped
     Point viewer; // a point representing the view location in 3D(identical to the VRP in View3D)
-    Texture texture;
+    Texture texture; // the map of textured polygons that do not name their own; s and t are unused
 }DrawState;
 
 DrawState *drawstate_create(void);
+void drawstate_init(DrawState *s);
 void drawstate_setColor(DrawState *s, Color c);
 void drawstate_setBody(DrawState *s, Color c);
 void drawstate_setSurface(DrawState *s, Color c);
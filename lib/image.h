@@ -1,5 +1,6 @@
 #ifndef IMAGE_H
 #define IMAGE_H
+#include <stdio.h>
 #include "color.h"
 #include "fpixel.h"
 
@@ -9,8 +10,26 @@ typedef struct{
     FPixel **data;
     float zBuffer;
     float a;
+    int samples; // samples per pixel for multisample anti-aliasing, 1 for none
+    FPixel *sample; // the samples of every pixel, pixel after pixel in row order, when samples > 1
 }Image;
 
+// filters for image_downsample
+typedef enum{
+    FilterBox, // average of the factor x factor block under the pixel
+    FilterTent, // weights falling off linearly to zero a full pixel beyond the block, for smoother edges
+}ImageFilter;
+
+// result of comparing two images
+typedef struct{
+    int nPixels; // number of pixels compared
+    int nDiff; // number of pixels with a channel error above the tolerance
+    float maxError; // largest absolute channel difference, in [0, 1]
+    double mse; // mean squared error over all channels
+    double psnr; // peak signal-to-noise ratio in dB, INFINITY if the images are identical
+    double ssim; // mean structural similarity of the luminance channel, 1.0 if identical
+}ImageDiff;
+
 // constructors and deconstructors
 Image *image_create(int rows, int cols);
 void image_init(Image *src);
@@ -32,13 +51,50 @@ void image_setc(Image *src, int r, int c, int b, float val);
 void image_seta(Image *src, int r, int c, float val);
 void image_setz(Image *src, int r, int c, float val);
 
+// Unchecked access, for inner loops that have already clipped r and c to the image
+void image_putSamples(Image *src, int r, int c, FPixel val);
+
+// the pixels of row r
+static inline FPixel *image_row(Image *src, int r){
+    return src->data[r];
+}
+
+// pixel (r, c)
+static inline FPixel *image_pixel(Image *src, int r, int c){
+    return &src->data[r][c];
+}
+
+// set pixel (r, c), and every sample of it in a multisampled image, to val
+static inline void image_put(Image *src, int r, int c, FPixel val){
+    src->data[r][c] = val;
+    if(src->samples > 1){
+        image_putSamples(src, r, c, val);
+    }
+}
+
+// Spans: runs of pixels on one row, clipped to the image once per call
+int image_clipSpan(Image *src, int r, int *c0, int *c1);
+int image_writeSpan(Image *src, int r, int c0, int c1, FPixel *px, int zTest);
+int image_fillSpan(Image *src, int r, int c0, int c1, Color c, float z, float dz, int zTest);
+
 // Utility
 void image_reset(Image *src);
 void image_fill(Image *src, FPixel val);
 void image_fillrgb(Image *src, float r, float g, float b);
 void image_filla(Image *src, float a);
 void image_fillz(Image *src, float z);
+int image_setSamples(Image *src, int samples);
+const float *image_samplePattern(int samples);
+void image_resolve(Image *src);
+int image_downsample(Image *src, Image *dst, int factor, ImageFilter filter);
 void image_setColor(Image *src, int r, int c, Color val);
 Color image_getColor(Image *src, int r, int c);
 
+// Comparison
+int image_compare(Image *a, Image *b, float tolerance, ImageDiff *stats, Image *diff);
+int image_compareFile(Image *src, char *reference, float tolerance, ImageDiff *stats, char *diffname);
+double image_psnr(Image *a, Image *b);
+double image_ssim(Image *a, Image *b);
+void imagediff_print(ImageDiff *d, FILE *fp);
+
 #endif
\ No newline at end of file
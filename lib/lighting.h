@@ -1,5 +1,6 @@
 #ifndef LIGHTING_H
 #define LIGHTING_H
+#include <stdint.h>
 #include "color.h"
 #include "point.h"
 #include "vector.h"
@@ -19,17 +20,47 @@ typedef struct{
   Point position;
   float cutoff; // store the cosine of the cutoff angle of a spotlight
   float sharpness; // coefficient of the falloff function(power for cosine)
+  float radius; // point and spot lights fade out to nothing at this distance; 0 for unlimited reach
 }Light;
 
+struct ShadowMap;
+
+// cells along each side of the light cluster grid
+#define LIGHT_GRID 8
+
+// the lights of a Lighting rearranged for shading: ambient lights summed, the rest grouped by type
+// with each component in its own array, and everything that does not depend on the surface point
+// (normalized directions, spot cutoff cosines) worked out once
+typedef struct{
+  int valid; // built from the current lights; cleared whenever the lights change
+  Color ambient; // sum of the ambient light colors
+  int nDirect, nPoint, nSpot; // lights of each type, stored in that order in the arrays below
+  double px[64], py[64], pz[64]; // position of point and spot lights
+  double dx[64], dy[64], dz[64]; // unit direction of direct and spot lights
+  float r[64], g[64], b[64]; // light color
+  double cosCutoff[64]; // spot lights: cosine of the cutoff angle
+  float radius[64]; // attenuation radius of point and spot lights, 0 for unlimited
+  uint64_t unbounded; // bit i set for point and spot lights without a radius, which reach everywhere
+  int clustered; // whether any light has a radius, so the grid below is in use
+  double gridMin[3]; // corner of the box holding every bounded light's sphere of influence
+  double cellScale[3]; // cells per unit along each axis
+  uint64_t cell[LIGHT_GRID * LIGHT_GRID * LIGHT_GRID]; // bit i set if bounded light i reaches into the cell
+  struct ShadowMap *shadow[64]; // depth map of direct and spot lights, or NULL
+}LightList;
+
 typedef struct{
   int nLights;
   Light light[64];
+  struct ShadowMap *shadow[64]; // per light, the map that puts surfaces in its shadow, or NULL for none
+  LightList compiled; // used by lighting_shading while valid, see lighting_compile
 } Lighting;
 
 //light functions
 void light_init(Light *light);
 void light_copy(Light *to, Light *from);
 void light_set(Light *light, LightType type, Color *c, Vector *dir, Point *pos, float cutoff, float sharpness);
+void light_setRadius(Light *light, float radius);
+int light_equal(Light *a, Light *b);
 
 //lighting functions
 Lighting *lighting_create(void);
@@ -39,5 +70,6 @@ void lighting_clear(Lighting *l);
 void lighting_add(Lighting *l, LightType type, Color *c, Vector *dir, Point *pos, float cutoff, float sharpness);
 void lighting_shading(Lighting *l, Vector *N, Vector *V, Point *p, Color *Cb, Color *Cs, float s, int oneSided, Color *c);
 void lighting_copy(Lighting *to, Lighting *from);
+void lighting_compile(Lighting *l);
 
 #endif
\ No newline at end of file
@@ -15,7 +15,9 @@ void line_set(Line *l, Point ta, Point tb);
 void line_zBuffer(Line *l, int flag);
 void line_normalize(Line *l);
 void line_copy(Line *to, Line *from);
+int line_clipNear(Line *l, double near);
 void line_draw(Line *l, Image *src, Color c);
 void line_drawDash(Line *l, Image *src, Color c, int length);
+void line_drawAA(Line *l, Image *src, Color c);
 
 #endif
\ No newline at end of file
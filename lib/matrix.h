@@ -12,6 +12,10 @@ typedef struct{
     double m[4][4];
 }Matrix;
 
+typedef struct{
+    float m[4][4];
+}FMatrix;
+
 // 2D matrix
 void matrix_print(Matrix *m, FILE *fp);
 void matrix_clear(Matrix *m);
@@ -22,10 +26,13 @@ void matrix_copy(Matrix *dest, Matrix *src);
 void matrix_transpose(Matrix *m);
 void matrix_multiply(Matrix *left, Matrix *right, Matrix *m);
 void matrix_xformPoint(Matrix *m, Point *p, Point *q);
+void matrix_xformPoints(Matrix *m, const Point *p, Point *q, int n);
 void matrix_xformVector(Matrix *m, Vector *p, Vector *q);
 void matrix_xformPolygon(Matrix *m, Polygon *p);
 void matrix_xformPolyline(Matrix *m, Polyline *p);
 void matrix_xformLine(Matrix *m, Line *line);
+int matrix_isAffine(Matrix *m);
+void matrix_xformScreenAffine(Matrix *m, Point *p, int n);
 void matrix_scale2D(Matrix *m, double sx, double sy);
 void matrix_rotateZ(Matrix *m, double cth, double sth);
 void matrix_translate2D(Matrix *m, double tx, double ty);
@@ -41,5 +48,10 @@ void matrix_shearZ(Matrix *m, double shx, double shy);
 void matrix_perspective(Matrix *m, double d);
 void matrix_setView3D(Matrix *vtm, View3D *view);
 int matrix_is_zero(Matrix *m);
+// single precision screen stage
+void fmatrix_set(FMatrix *f, Matrix *m);
+void fmatrix_xformScreen(FMatrix *m, Point *p, int n);
+void fmatrix_xformPolygon(FMatrix *m, Polygon *p);
+void fmatrix_xformPolyline(FMatrix *m, Polyline *p);
 
 #endif
\ No newline at end of file
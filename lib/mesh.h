@@ -0,0 +1,37 @@
+#ifndef MESH_H
+#define MESH_H
+#include <stdio.h>
+#include "color.h"
+#include "point.h"
+#include "vector.h"
+
+// largest post-transform cache mesh_optimize and mesh_acmr model
+#define MESH_CACHE_MAX 64
+
+// indexed triangle mesh: vertices, normals and colors are shared by the triangles that use them
+typedef struct{
+    int oneSided; // whether to consider the triangles one-sided(1) or two-sided(0) for shading
+    int nVertex; // number of shared vertices
+    Point *vertex; // vertex positions
+    Vector *normal; // surface normal for each vertex, or NULL
+    Color *color; // color for each vertex, or NULL
+    int nTriangle; // number of triangles
+    int *index; // three vertex indices per triangle
+    int zBuffer; // whether to use the z-buffer, default to true(1)
+}Mesh;
+
+Mesh *mesh_create(void);
+void mesh_free(Mesh *m);
+void mesh_init(Mesh *m);
+void mesh_clear(Mesh *m);
+int mesh_set(Mesh *m, int nVertex, Point *vlist, int nTriangle, int *index);
+void mesh_setNormals(Mesh *m, int nVertex, Vector *nlist);
+void mesh_setColors(Mesh *m, int nVertex, Color *clist);
+void mesh_setSided(Mesh *m, int oneSided);
+void mesh_zBuffer(Mesh *m, int flag);
+void mesh_copy(Mesh *to, Mesh *from);
+void mesh_print(Mesh *m, FILE *fp);
+int mesh_optimize(Mesh *m, int cacheSize);
+double mesh_acmr(Mesh *m, int cacheSize);
+
+#endif
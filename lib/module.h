@@ -3,10 +3,12 @@
 #include "color.h"
 #include "point.h"
 #include "polygon.h"
+#include "mesh.h"
 #include "matrix.h"
 #include "lighting.h"
 #include "drawstate.h"
 #include "bezier.h"
+#include "render.h"
 
 typedef enum {
     ObjNone,
@@ -21,7 +23,10 @@ typedef enum {
     ObjSurfaceColor,
     ObjSurfaceCoeff,
     ObjLight,
-    ObjModule
+    ObjModule,
+    ObjMesh,
+    ObjInstances,
+    ObjBezierPatch
 }ObjectType;
 
 // element structure
@@ -37,6 +42,14 @@ typedef struct{
     Element *tail;
 }Module;
 
+// one submodule drawn once under each of an array of transforms
+typedef struct{
+    Module *module; // the shared submodule, not owned by the element
+    int nInstance; // number of copies
+    Matrix *transform; // per copy, applied to the LTM like an ObjMatrix placed before the submodule
+    Color *color; // per copy foreground and body color, or NULL to inherit the draw state's
+}Instances;
+
 // 2D module functions
 Element *element_create();
 Element *element_init(ObjectType type, void *obj);
@@ -50,12 +63,15 @@ void module_point(Module *md, Point *p);
 void module_line(Module *md, Line *p);
 void module_polyline(Module *md, Polyline *p);
 void module_polygon(Module *md, Polygon *p);
+void module_mesh(Module *md, Mesh *m);
+void module_instances(Module *md, Module *sub, int nInstance, Matrix *transform, Color *color);
 void module_identity(Module *md);
 void module_translate2D(Module *md, double tx, double ty);
 void module_scale2D(Module *md, double sx, double sy);
 void module_rotateZ(Module *md, double cth, double sth);
 void module_shear2D(Module *md, double shx, double shy);
 void module_draw(Module *md, Matrix *VTM, Matrix *GTM, DrawState *ds, Lighting *lighting, Image *src);
+void module_render(Module *md, Matrix *GTM, RenderContext *rc);
 
 // 3D module functions
 void module_translate(Module *md, double tx, double ty, double tz);
@@ -70,11 +86,12 @@ void module_bodyColor(Module *md, Color *c);
 void module_surfaceColor(Module *md, Color *c);
 void module_surfaceCoeff(Module *md, float coeff);
 void module_addLight(Module *m, Light *light);
-//void module_parseLighting(Module *m, Matrix *GTM, Lighting *lighting);
+void module_parseLighting(Module *m, Matrix *GTM, Lighting *lighting);
 
 // Bezier Curve and Surface Module Functions
 void module_bezierCurve(Module *m, BezierCurve *b, int divisions);
 void module_bezierSurface(Module *m, BezierSurface *b, int divisions, int solid);
+void module_bezierPatch(Module *m, BezierSurface *b, float tolerance);
 
 // 3D shapes
 void module_cube(Module *md, int solid);
@@ -0,0 +1,7 @@
+#ifndef PARSE_H
+#define PARSE_H
+
+// number parsing shared by the text model loaders
+int parse_number(const char **pp, const char *end, double *v);
+
+#endif
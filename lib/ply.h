@@ -0,0 +1,9 @@
+#ifndef PLY_H
+#define PLY_H
+#include "mesh.h"
+#include "module.h"
+
+Mesh *ply_read(char *filename);
+int module_ply(Module *md, char *filename);
+
+#endif
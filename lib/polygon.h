@@ -13,7 +13,7 @@ typedef struct{
     Color *color; // color info for each vertex
     Vector *normal; // surface normal information for each vertex
     int zBuffer; // whether to use the z-buffer, default to true(1)
-    Texture *texture;
+    Texture *texture; // map and texture coordinates for each vertex, or NULL for an untextured polygon
     //Point *worldPos;
 }Polygon;
 
@@ -26,12 +26,14 @@ void polygon_clear(Polygon *p);
 void polygon_setSided(Polygon *p, int oneSided);
 void polygon_setColors(Polygon *p, int numV, Color *clist);
 void polygon_setNormals(Polygon *p, int numV, Vector *nlist);
+void polygon_setTextures(Polygon *p, int numV, Texture *tlist);
 void polygon_setAll(Polygon *p, int numV, Point *vlist, Color *clist, Vector *nlist, int zBuffer, int oneSided);
 void polygon_zBuffer(Polygon *p, int flag);
 void polygon_copy(Polygon *to, Polygon *from);
 void polygon_print(Polygon *p, FILE *fp);
 void polygon_normalize(Polygon *p);
 void polygon_draw(Polygon *p, Image *src, Color c);
+void polygon_drawAA(Polygon *p, Image *src, Color c);
 void polygon_drawFill(Polygon *p, Image *src, Color c);
 void polygon_drawFillB(Polygon *p, Image *src, Color c);
 void polygon_drawShade(Polygon *p, Image *src, DrawState *ds, Lighting *light);
@@ -21,5 +21,6 @@ void polyline_copy(Polyline *to, Polyline *from);
 void polyline_print(Polyline *p, FILE *fp);
 void polyline_normalize(Polyline *p);
 void polyline_draw(Polyline *p, Image *src, Color c);
+void polyline_drawAA(Polyline *p, Image *src, Color c);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,66 @@
+#ifndef RENDER_H
+#define RENDER_H
+#include <stdio.h>
+#include <stddef.h>
+#include "image.h"
+#include "matrix.h"
+#include "drawstate.h"
+#include "lighting.h"
+
+struct ShadowCache;
+struct BezierCache;
+
+// entries of the FIFO post-transform vertex cache the hit rate is simulated for
+#define RENDER_VERTEX_CACHE 32
+
+// counters for the mesh post-transform vertex cache
+typedef struct{
+    long meshTriangles; // mesh triangles rasterized
+    long vertexRefs; // vertex references made by those triangles
+    long vertexXforms; // vertices actually transformed and lit to serve them
+    long vertexMisses; // references that would miss a RENDER_VERTEX_CACHE entry FIFO cache in triangle order
+    long patchTessellations; // adaptive Bezier patches tessellated rather than taken from the patch cache
+}RenderStats;
+
+// per-thread rendering state for drawing a Module tree
+// a Module is only read during traversal, so one tree can be rendered by several contexts at once
+typedef struct{
+    Matrix VTM; // view transformation matrix
+    FMatrix fVTM; // the view matrix in single precision
+    int vtmAffine; // the view matrix leaves h alone, so the perspective divide can be skipped
+    DrawState ds; // draw state at the root of the traversal
+    Lighting lighting; // lights collected while traversing the tree
+    Image *src; // image to draw into
+    char *scratch; // scratch arena for per-primitive copies
+    size_t scratchSize; // capacity of the scratch arena in bytes
+    size_t scratchUsed; // bytes handed out since the last reset
+    void *overflow; // list of blocks allocated when the arena ran out, freed on reset
+    size_t overflowSize; // bytes allocated in overflow blocks since the last reset
+    RenderStats stats; // counters since the context was initialized or the stats were cleared
+    struct ShadowCache *shadows; // shadow maps brought up to date and used by each render, or NULL for no shadows
+    struct BezierCache *patches; // tessellations of adaptive Bezier patches kept from one render to the next, made on first use
+}RenderContext;
+
+// constructors and deconstructors
+RenderContext *render_create(Image *src, Matrix *VTM, DrawState *ds, Lighting *lighting);
+void render_init(RenderContext *rc, Image *src, Matrix *VTM, DrawState *ds, Lighting *lighting);
+void render_dealloc(RenderContext *rc);
+void render_free(RenderContext *rc);
+
+// state
+void render_setImage(RenderContext *rc, Image *src);
+void render_setView(RenderContext *rc, Matrix *VTM);
+void render_setDrawState(RenderContext *rc, DrawState *ds);
+void render_setLighting(RenderContext *rc, Lighting *lighting);
+void render_setShadows(RenderContext *rc, struct ShadowCache *shadows);
+
+// scratch memory, valid until the next reset
+void *render_alloc(RenderContext *rc, size_t size);
+void render_reset(RenderContext *rc);
+
+// statistics
+void render_clearStats(RenderContext *rc);
+double render_cacheHitRate(RenderContext *rc);
+void render_printStats(RenderContext *rc, FILE *fp);
+
+#endif
@@ -1,5 +1,6 @@
 #ifndef SCANLINE_H
 #define SCANLINE_H
+#include <stdint.h>
 #include "point.h"
 #include "image.h"
 #include "polygon.h"
@@ -12,19 +13,22 @@ typedef struct tEdge {
 	float x1, y1;                   /* end point for the edge */
 	int yStart, yEnd;               /* start row and end row */
     float xIntersect, dxPerScan;    /* where the edge intersects the current scanline and how it changes */
+	int64_t xCol; // first column at or right of the edge on the current scanline, found exactly in 28.4 fixed point
+	int64_t xErr, xDen; // xCol - xIntersect, as a fraction of xDen, which is 16 times the edge's height in sixteenths
+	int64_t xStepCol, xStepErr; // change of xCol and xErr from one scanline to the next
 	float zIntersect, dzPerScan;  // z-buffer
 	Color cIntersect, dcPerScan; // Gouraud shading
 	Point pIntersect, dpPerScan; // Phong shading
 	Vector nIntersect, dnPerScan; // Phong shading surface normal
-	Texture texture;
-	float sIntersect, dsPerScan; // texture coordinate
+	Texture texture; // the map of a textured polygon, NULL otherwise
+	float sIntersect, dsPerScan; // texture coordinate divided by z, like the colors
 	float tIntersect, dtPerScan;
     struct tEdge *next;
 } Edge;
 
 int compYStart( const void *a, const void *b );
 int compXIntersect( const void *a, const void *b );
-Edge *makeEdgeRec( Point start, Point end, Image *src, DrawState *ds, Color c0, Color c1);
+Edge *makeEdgeRec( Point start, Point end, Image *src, DrawState *ds, Color c0, Color c1, Texture *t0, Texture *t1);
 LinkedList *setupEdgeList(  Polygon *p, Image *src, DrawState *ds);
 void fillScan( int scan, LinkedList *active, Image *src, DrawState *ds, Lighting *lights);
 int processEdgeList( LinkedList *edges, Image *src, DrawState *ds, Lighting *lights );
@@ -0,0 +1,19 @@
+#ifndef SCENE_H
+#define SCENE_H
+#include <stddef.h>
+#include "module.h"
+
+// a Module graph loaded from a scene file
+// the modules, elements and their objects all live inside one mapping of the file, so the graph
+// is read-only and is released with scene_free rather than module_delete
+typedef struct{
+    Module *root; // the module that was written
+    void *data; // the mapped file
+    size_t size; // size of the mapping in bytes
+}Scene;
+
+int scene_write(Module *md, char *filename);
+Scene *scene_read(char *filename);
+void scene_free(Scene *s);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef SHADOW_H
+#define SHADOW_H
+#include "module.h"
+
+// the scene's depth as seen from one direct or spot light
+typedef struct ShadowMap{
+    Light light; // the light, in world coordinates, the map was rendered for
+    Matrix view; // world coordinates to map pixels; z is left undivided, as in the view pipeline
+    Image *depth; // z holds 1/z of the surface nearest the light, like the z-buffer of a normal render
+    float bias; // fraction of the stored depth a surface may lie behind it and still be lit
+    int valid; // whether depth matches the light and the scene
+    int used; // whether a light of the current frame uses the map
+}ShadowMap;
+
+// shadow maps kept from one render to the next, so they are only redrawn when a light or the scene changes
+typedef struct ShadowCache{
+    int size; // rows and columns of every map
+    float bias; // depth bias given to new maps
+    int nThreads; // threads rendering maps, 0 or less for one per online processor
+    int nMap; // maps in use
+    ShadowMap *map[64];
+    Module *scene; // the module and global transform the maps were rendered from
+    Matrix GTM;
+    int dirty; // the scene changed since the maps were rendered
+}ShadowCache;
+
+ShadowCache *shadow_create(int size, int nThreads);
+void shadow_free(ShadowCache *sc);
+void shadow_setBias(ShadowCache *sc, float bias);
+void shadow_invalidate(ShadowCache *sc);
+int shadow_update(ShadowCache *sc, Module *scene, Matrix *GTM, Lighting *lighting);
+float shadow_sample(ShadowMap *map, Point *p);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+#include "color.h"
+#include "image.h"
+
+// texels along each side of a tile; a tile's texels are stored together, row by row
+#define TEXTURE_TILE 8
+// enough levels for images up to 2^15 texels wide
+#define TEXTURE_LEVELS 16
+
+// an image prepared for sampling: a chain of mip levels, each half the size of the one before,
+// with the texels of every level stored tile by tile so that a bilinear footprint touches one or two cache lines
+typedef struct TextureMap{
+    int nLevel; // number of mip levels, level 0 being the full-size image
+    int rows[TEXTURE_LEVELS], cols[TEXTURE_LEVELS]; // size of each level
+    int tileCols[TEXTURE_LEVELS]; // tiles per tile row in each level
+    Color *texel[TEXTURE_LEVELS]; // the tiles of each level; all levels share one allocation
+    int refs; // owners of the map; it is freed when the last one releases it
+    char *name; // file the map was read from if it is in the texture cache, NULL otherwise
+    struct TextureMap *next; // next map in the cache
+}TextureMap;
+
+// a texture and a place on it: a polygon's texture array holds one per vertex, whose map, if not NULL,
+// takes the place of the draw state's; the draw state's map applies to polygons that do not name one
+typedef struct{
+    TextureMap *map;
+    float s, t; // texture coordinates, with [0, 1] covering the image once; the texture repeats outside
+}Texture;
+
+TextureMap *texture_create(Image *src);
+TextureMap *texture_read(char *filename);
+void texture_retain(TextureMap *map);
+void texture_release(TextureMap *map);
+void texture_sample(TextureMap *map, float s, float t, float lod, Color *c);
+float texture_lod(TextureMap *map, float dsdx, float dtdx, float dsdy, float dtdy);
+
+#endif
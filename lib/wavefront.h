@@ -0,0 +1,8 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+#include "mesh.h"
+#include "module.h"
+
+int module_wavefront(Module *md, char *filename, int nThreads);
+
+#endif
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "animation.h"
+
+// state shared by the workers of one animation_render call
+typedef struct{
+    Module *scene;
+    int rows, cols;
+    int last;
+    AnimationFrameFunc setup;
+    void *data;
+    char *pattern;
+    int next; // next frame to hand out
+    int written; // next frame to write to disk
+    int failed; // number of frames that could not be written
+    pthread_mutex_t lock;
+    pthread_cond_t turn;
+}AnimationJob;
+
+// render frames until none are left, writing each one once every earlier frame is on disk
+static void *animation_worker(void *arg){
+    AnimationJob *job = arg;
+    Image *src = image_create(job->rows, job->cols);
+    RenderContext *rc = render_create(src, NULL, NULL, NULL);
+    char filename[1024];
+
+    while(1){
+        pthread_mutex_lock(&job->lock);
+        int frame = job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if(frame > job->last){
+            break;
+        }
+
+        int ok = src != NULL && rc != NULL;
+        if(ok){
+            Matrix VTM, GTM;
+            DrawState ds;
+            Lighting lighting;
+            matrix_identity(&VTM);
+            matrix_identity(&GTM);
+            drawstate_init(&ds);
+            lighting_init(&lighting);
+            job->setup(frame, &VTM, &GTM, &ds, &lighting, job->data);
+
+            image_reset(src);
+            render_setView(rc, &VTM);
+            render_setDrawState(rc, &ds);
+            render_setLighting(rc, &lighting);
+            module_render(job->scene, &GTM, rc);
+        }
+
+        // wait for the previous frame so frames reach the disk in order
+        pthread_mutex_lock(&job->lock);
+        while(job->written != frame){
+            pthread_cond_wait(&job->turn, &job->lock);
+        }
+        pthread_mutex_unlock(&job->lock);
+
+        snprintf(filename, sizeof(filename), job->pattern, frame);
+        if(!ok || image_write(src, filename) != 0){
+            fprintf(stderr, "Unable to write frame %d.\n", frame);
+            ok = 0;
+        }
+
+        pthread_mutex_lock(&job->lock);
+        job->written++;
+        if(!ok){
+            job->failed++;
+        }
+        pthread_cond_broadcast(&job->turn);
+        pthread_mutex_unlock(&job->lock);
+    }
+
+    render_free(rc);
+    image_free(src);
+    return NULL;
+}
+
+// render frames first through last (inclusive) of the scene into rows x cols images using nThreads workers
+// setup is called for every frame to place the camera and transform the scene
+// frame i is written to the file named by the printf pattern with i, e.g. "frame-%03d.ppm", in frame order
+// nThreads <= 0 uses one worker per online processor
+// returns the number of frames that failed, or -1 if the render could not start
+int animation_render(Module *scene, int rows, int cols, int first, int last, AnimationFrameFunc setup, void *data, char *pattern, int nThreads){
+    if(scene == NULL || setup == NULL || pattern == NULL || rows <= 0 || cols <= 0){
+        fprintf(stderr, "Invalid animation parameters.\n");
+        return -1;
+    }
+    if(last < first){
+        return 0;
+    }
+
+    if(nThreads <= 0){
+        nThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if(nThreads <= 0){
+            nThreads = 1;
+        }
+    }
+    if(nThreads > last - first + 1){
+        nThreads = last - first + 1;
+    }
+
+    AnimationJob job;
+    job.scene = scene;
+    job.rows = rows;
+    job.cols = cols;
+    job.last = last;
+    job.setup = setup;
+    job.data = data;
+    job.pattern = pattern;
+    job.next = first;
+    job.written = first;
+    job.failed = 0;
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.turn, NULL);
+
+    pthread_t *threads = (pthread_t*)malloc(nThreads * sizeof(pthread_t));
+    if(threads == NULL){
+        fprintf(stderr, "Unable to allocate memory for worker threads.\n");
+        pthread_mutex_destroy(&job.lock);
+        pthread_cond_destroy(&job.turn);
+        return -1;
+    }
+
+    int started = 0;
+    for(int i = 0; i < nThreads; i++){
+        if(pthread_create(&threads[started], NULL, animation_worker, &job) == 0){
+            started++;
+        }
+    }
+    if(started == 0){
+        // no threads available, render on the calling thread
+        animation_worker(&job);
+    }
+    for(int i = 0; i < started; i++){
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+    pthread_mutex_destroy(&job.lock);
+    pthread_cond_destroy(&job.turn);
+    return job.failed;
+}
@@ -1,6 +1,14 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <math.h>
 #include "bezier.h"
 #include "line.h"
+#include "polyline.h"
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 // sets the zbuffer flag to 1 and the curve points to the X-axis between 0 and 1
 void bezierCurve_init(BezierCurve *b){
@@ -80,32 +88,635 @@ void bezierSurface_zBuffer(BezierCurve *p, int flag){
     p->zBuffer = flag;
 }
 
+// number of equal steps in t for a polyline through the curve to stay within tolerance of it in x and y
+// a chord over a step of h strays at most h^2 / 8 times the largest second derivative, which for a cubic
+// is 6 times the larger second difference of the control points
+int bezierCurve_segments(BezierCurve *b, float tolerance){
+    if(b == NULL || !(tolerance > 0)){
+        fprintf(stderr, "Invalid bezier curve or tolerance.\n");
+        return 1;
+    }
+
+    double m = 0.0;
+    for(int i = 0; i < 2; i++){
+        double dx = b->p[i].val[0] - 2 * b->p[i + 1].val[0] + b->p[i + 2].val[0];
+        double dy = b->p[i].val[1] - 2 * b->p[i + 1].val[1] + b->p[i + 2].val[1];
+        m = fmax(m, sqrt(dx * dx + dy * dy));
+    }
+
+    double n = ceil(sqrt(0.75 * m / tolerance));
+    if(!(n < BEZIER_MAX_SEGMENTS)){
+        return BEZIER_MAX_SEGMENTS;
+    }
+    return n < 1 ? 1 : (int)n;
+}
+
+// evaluate the curve at n + 1 equally spaced values of t into vlist, by forward differencing:
+// after the setup, each point costs three vector additions
+void bezierCurve_evaluate(BezierCurve *b, int n, Point *vlist){
+    if(b == NULL || vlist == NULL || n < 1){
+        fprintf(stderr, "Invalid bezier curve or point list.\n");
+        return;
+    }
+
+    double h = 1.0 / n;
+    double f[3], df[3], d2f[3], d3f[3];
+    for(int j = 0; j < 3; j++){
+        // power basis coefficients of the curve
+        double p0 = b->p[0].val[j], p1 = b->p[1].val[j], p2 = b->p[2].val[j], p3 = b->p[3].val[j];
+        double ca = -p0 + 3 * p1 - 3 * p2 + p3;
+        double cb = 3 * p0 - 6 * p1 + 3 * p2;
+        double cc = -3 * p0 + 3 * p1;
+        f[j] = p0;
+        df[j] = ca * h * h * h + cb * h * h + cc * h;
+        d2f[j] = 6 * ca * h * h * h + 2 * cb * h * h;
+        d3f[j] = 6 * ca * h * h * h;
+    }
+
+    for(int i = 0; i < n; i++){
+        point_set3D(&vlist[i], f[0], f[1], f[2]);
+        for(int j = 0; j < 3; j++){
+            f[j] += df[j];
+            df[j] += d2f[j];
+            d2f[j] += d3f[j];
+        }
+    }
+    // the last point is the end of the curve exactly
+    point_set3D(&vlist[n], b->p[3].val[0], b->p[3].val[1], b->p[3].val[2]);
+}
+
 // draws the Bezier curve, given in screen coordinates, into the image using the given color
-// The function should be adaptive so that it uses an appropriate number of line segments to draw the curve.
-// For example, if the bounding box of the control points is less than 10 pixels in the largest dimension,
-// then it is reasonable to draw the lines between the control points as an approximation to the curve.
+// as one connected polyline, with as many segments as keep it within BEZIER_TOLERANCE pixels of the curve
 void bezierCurve_draw(BezierCurve *b, Image *src, Color c){
     if (b == NULL || src == NULL) {
         fprintf(stderr, "Invalid Bezier curve or Image.\n");
         return;
     }
 
-    float largestDimension = getLargestDimension(b);
+    Point vlist[BEZIER_MAX_SEGMENTS + 1];
+    int n = bezierCurve_segments(b, BEZIER_TOLERANCE);
+    bezierCurve_evaluate(b, n, vlist);
+
+    Polyline p;
+    p.zBuffer = b->zBuffer;
+    p.numVertex = n + 1;
+    p.vertex = vlist;
+    polyline_draw(&p, src, c);
+}
+
+// control point indices of the sides of a patch, v = 0, u = 1, v = 1 and u = 0, each running toward larger u or v
+static const int bezier_side[4][4] = {{0, 1, 2, 3}, {3, 7, 11, 15}, {12, 13, 14, 15}, {0, 4, 8, 12}};
+// the corner vertices each side of a tessellated patch starts and ends at
+static const int bezier_corner[4][2] = {{0, 1}, {1, 3}, {2, 3}, {0, 2}};
+
+// smallest power of two at or above n, kept within [least, BEZIER_PATCH_LEVELS]
+static int bezier_level(double n, int least){
+    int level = least;
+    while(level < BEZIER_PATCH_LEVELS && level < n){
+        level *= 2;
+    }
+    return level;
+}
+
+// length in x and y of a - 2b + c
+static double bezier_secondDifference(Point *a, Point *b, Point *c){
+    double dx = a->val[0] - 2 * b->val[0] + c->val[0];
+    double dy = a->val[1] - 2 * b->val[1] + c->val[1];
+    return sqrt(dx * dx + dy * dy);
+}
+
+// the number of steps to cut the surface into for its triangles, drawn through the screen matrix,
+// to stay within tolerance pixels of it: level[0] and level[1] across the interior in u and v,
+// level[2] to level[5] along the sides v = 0, u = 1, v = 1 and u = 0
+// a side's level depends only on its own control points, so patches sharing the side agree on it;
+// levels are powers of two, so a moving view only changes them when the detail needed doubles or halves
+void bezierSurface_levels(BezierSurface *b, Matrix *screen, float tolerance, int level[6]){
+    if(b == NULL || screen == NULL || level == NULL || !(tolerance > 0)){
+        fprintf(stderr, "Invalid bezier surface, matrix or tolerance.\n");
+        return;
+    }
+
+    // the control net in pixels; a net reaching behind the center of projection gets the finest levels
+    Point q[16];
+    for(int i = 0; i < 16; i++){
+        matrix_xformPoint(screen, &b->p[i], &q[i]);
+        if(!(q[i].val[3] > 0)){
+            for(int k = 0; k < 6; k++){
+                level[k] = BEZIER_PATCH_LEVELS;
+            }
+            return;
+        }
+        q[i].val[0] /= q[i].val[3];
+        q[i].val[1] /= q[i].val[3];
+    }
+
+    for(int s = 0; s < 4; s++){
+        BezierCurve c;
+        for(int k = 0; k < 4; k++){
+            c.p[k] = q[bezier_side[s][k]];
+        }
+        level[2 + s] = bezier_level(bezierCurve_segments(&c, tolerance), 1);
+    }
+
+    // a step of hu by hv strays at most (hu^2 Suu + 2 hu hv Suv + hv^2 Svv) / 8 from the surface, where the second
+    // derivatives are bounded by 6 times the second differences of the net and 9 times its twists;
+    // 2 hu hv <= hu^2 + hv^2 folds the twist into both directions, and each direction gets half the tolerance
+    double du = 0.0, dv = 0.0, twist = 0.0;
+    for(int j = 0; j < 4; j++){
+        for(int i = 0; i < 2; i++){
+            du = fmax(du, bezier_secondDifference(&q[j * 4 + i], &q[j * 4 + i + 1], &q[j * 4 + i + 2]));
+            dv = fmax(dv, bezier_secondDifference(&q[i * 4 + j], &q[(i + 1) * 4 + j], &q[(i + 2) * 4 + j]));
+        }
+    }
+    for(int j = 0; j < 3; j++){
+        for(int i = 0; i < 3; i++){
+            Point *p = &q[j * 4 + i];
+            double dx = p[0].val[0] - p[1].val[0] - p[4].val[0] + p[5].val[0];
+            double dy = p[0].val[1] - p[1].val[1] - p[4].val[1] + p[5].val[1];
+            twist = fmax(twist, sqrt(dx * dx + dy * dy));
+        }
+    }
+
+    // the interior is never coarser than the sides, which keeps the triangles along them well shaped
+    double nu = sqrt((6 * du + 9 * twist) / (4 * tolerance));
+    double nv = sqrt((6 * dv + 9 * twist) / (4 * tolerance));
+    level[0] = bezier_level(fmax(nu, fmax(level[2], level[4])), 2);
+    level[1] = bezier_level(fmax(nv, fmax(level[3], level[5])), 2);
+}
+
+// values and derivatives of the four cubic Bernstein polynomials at t
+static void bezier_basis(double t, double B[4], double dB[4]){
+    double s = 1 - t;
+    B[0] = s * s * s;
+    B[1] = 3 * t * s * s;
+    B[2] = 3 * t * t * s;
+    B[3] = t * t * t;
+    dB[0] = -3 * s * s;
+    dB[1] = 3 * s * s - 6 * t * s;
+    dB[2] = 6 * t * s - 3 * t * t;
+    dB[3] = 3 * t * t;
+}
+
+// the point at (u, v), unless p is NULL, and the unit normal du x dv there
+// where the partial derivatives vanish or line up, as along a collapsed side, the normal is taken from just inside the patch
+static void bezierSurface_evaluate(BezierSurface *b, double u, double v, Point *p, Vector *n){
+    for(int attempt = 0; attempt < 2; attempt++){
+        double Bu[4], dBu[4], Bv[4], dBv[4];
+        double x[3] = {0, 0, 0};
+        Vector su, sv;
+        bezier_basis(u, Bu, dBu);
+        bezier_basis(v, Bv, dBv);
+        vector_set(&su, 0, 0, 0);
+        vector_set(&sv, 0, 0, 0);
+        for(int j = 0; j < 4; j++){
+            for(int i = 0; i < 4; i++){
+                Point *c = &b->p[j * 4 + i];
+                for(int k = 0; k < 3; k++){
+                    x[k] += Bu[i] * Bv[j] * c->val[k];
+                    su.val[k] += dBu[i] * Bv[j] * c->val[k];
+                    sv.val[k] += Bu[i] * dBv[j] * c->val[k];
+                }
+            }
+        }
+        if(p != NULL && attempt == 0){
+            point_set3D(p, x[0], x[1], x[2]);
+        }
+        vector_cross(&su, &sv, n);
+        double length = vector_length(n);
+        if(length > 1e-9 * vector_length(&su) * vector_length(&sv)){
+            vector_scale(n, 1.0 / length);
+            return;
+        }
+        u += 0.01 * (0.5 - u);
+        v += 0.01 * (0.5 - v);
+    }
+}
+
+// evaluate side s of the surface at n + 1 equally spaced points into vlist, in the side's own direction
+// the curve is evaluated from whichever end sorts first, so two patches sharing the side, in either direction,
+// get bitwise the same points
+static void bezierSurface_side(BezierSurface *b, int s, int n, Point *vlist){
+    const int *side = bezier_side[s];
+    int reverse = 0;
+    for(int k = 0; k < 4 && reverse == 0; k++){
+        for(int i = 0; i < 3; i++){
+            double forward = b->p[side[k]].val[i], backward = b->p[side[3 - k]].val[i];
+            if(forward != backward){
+                reverse = forward < backward ? -1 : 1;
+                break;
+            }
+        }
+    }
+
+    BezierCurve c;
+    for(int k = 0; k < 4; k++){
+        c.p[k] = b->p[side[reverse > 0 ? 3 - k : k]];
+    }
+    bezierCurve_evaluate(&c, n, vlist);
+    if(reverse > 0){
+        for(int k = 0; k < n - k; k++){
+            Point t = vlist[k];
+            vlist[k] = vlist[n - k];
+            vlist[n - k] = t;
+        }
+    }
+}
+
+// append the triangle (p, q, r), turned if need be to run counterclockwise in (u, v),
+// so that every triangle of a patch faces the way of du x dv
+static int *bezier_triangle(int *tri, int p, int q, int r, double *uv){
+    double area = (uv[2 * q] - uv[2 * p]) * (uv[2 * r + 1] - uv[2 * p + 1]) -
+                  (uv[2 * q + 1] - uv[2 * p + 1]) * (uv[2 * r] - uv[2 * p]);
+    tri[0] = p;
+    tri[1] = area < 0 ? r : q;
+    tri[2] = area < 0 ? q : r;
+    return tri + 3;
+}
+
+// join the chain of vertices a[0..na] to the chain b[0..nb] running alongside it with na + nb triangles,
+// each time stepping along whichever chain is further behind
+static int *bezier_zipper(int *tri, int *a, int na, int *b, int nb, double *uv){
+    int i = 0, j = 0;
+    while(i < na || j < nb){
+        if(j == nb || (i < na && (2 * i + 1) * nb < (2 * j + 1) * na)){
+            tri = bezier_triangle(tri, a[i], a[i + 1], b[j], uv);
+            i++;
+        }else{
+            tri = bezier_triangle(tri, a[i], b[j + 1], b[j], uv);
+            j++;
+        }
+    }
+    return tri;
+}
+
+// replace the contents of mesh with a tessellation of the surface at the levels from bezierSurface_levels
+// the interior is a grid of level[0] by level[1] cells; each side is cut into its own number of steps
+// and joined to the first ring of the grid by a strip of triangles, so a side only depends on its level
+// and its control points and neighboring patches meet exactly; normals are the surface's, du x dv
+// returns 0 on success, -1 on invalid levels or when memory runs out
+int bezierSurface_tessellate(BezierSurface *b, int level[6], Mesh *mesh){
+    if(b == NULL || level == NULL || mesh == NULL){
+        fprintf(stderr, "Invalid bezier surface, levels or mesh.\n");
+        return -1;
+    }
+    for(int k = 0; k < 6; k++){
+        if(level[k] < (k < 2 ? 2 : 1) || level[k] > BEZIER_PATCH_LEVELS){
+            fprintf(stderr, "Invalid tessellation level %d.\n", level[k]);
+            return -1;
+        }
+    }
+
+    // the corners, then the grid inside the first ring, then the inner points of each side
+    int nu = level[0], nv = level[1];
+    int nVertex = 4 + (nu - 1) * (nv - 1);
+    int nTriangle = 2 * (nu - 2) * (nv - 2) + 2 * (nu - 2) + 2 * (nv - 2);
+    int first[4];
+    for(int s = 0; s < 4; s++){
+        first[s] = nVertex;
+        nVertex += level[2 + s] - 1;
+        nTriangle += level[2 + s];
+    }
+
+    Point *vertex = (Point*)malloc(nVertex * sizeof(Point));
+    Vector *normal = (Vector*)malloc(nVertex * sizeof(Vector));
+    int *index = (int*)malloc(3 * nTriangle * sizeof(int));
+    double *uv = (double*)malloc(2 * nVertex * sizeof(double));
+    if(vertex == NULL || normal == NULL || index == NULL || uv == NULL){
+        fprintf(stderr, "Unable to allocate memory for bezier tessellation.\n");
+        free(vertex);
+        free(normal);
+        free(index);
+        free(uv);
+        return -1;
+    }
+
+    for(int k = 0; k < 4; k++){
+        Point *c = &b->p[(k & 1 ? 3 : 0) + (k & 2 ? 12 : 0)];
+        point_set3D(&vertex[k], c->val[0], c->val[1], c->val[2]);
+        uv[2 * k] = k & 1;
+        uv[2 * k + 1] = k >> 1;
+        bezierSurface_evaluate(b, uv[2 * k], uv[2 * k + 1], NULL, &normal[k]);
+    }
+    for(int j = 1; j < nv; j++){
+        for(int i = 1; i < nu; i++){
+            int k = 4 + (j - 1) * (nu - 1) + (i - 1);
+            uv[2 * k] = (double)i / nu;
+            uv[2 * k + 1] = (double)j / nv;
+            bezierSurface_evaluate(b, uv[2 * k], uv[2 * k + 1], &vertex[k], &normal[k]);
+        }
+    }
+
+    int *tri = index;
+    for(int s = 0; s < 4; s++){
+        Point vlist[BEZIER_PATCH_LEVELS + 1];
+        int a[BEZIER_PATCH_LEVELS + 1], inner[BEZIER_PATCH_LEVELS];
+        int n = level[2 + s];
+        bezierSurface_side(b, s, n, vlist);
+        a[0] = bezier_corner[s][0];
+        a[n] = bezier_corner[s][1];
+        for(int k = 1; k < n; k++){
+            int i = first[s] + k - 1;
+            double t = (double)k / n;
+            a[k] = i;
+            vertex[i] = vlist[k];
+            uv[2 * i] = s == 1 ? 1.0 : s == 3 ? 0.0 : t;
+            uv[2 * i + 1] = s == 0 ? 0.0 : s == 2 ? 1.0 : t;
+            bezierSurface_evaluate(b, uv[2 * i], uv[2 * i + 1], NULL, &normal[i]);
+        }
+
+        // the row or column of the grid next to the side
+        int m = s & 1 ? nv - 1 : nu - 1;
+        for(int k = 0; k < m; k++){
+            int i = s == 1 ? nu - 2 : s == 3 ? 0 : k;
+            int j = s == 0 ? 0 : s == 2 ? nv - 2 : k;
+            inner[k] = 4 + j * (nu - 1) + i;
+        }
+        tri = bezier_zipper(tri, a, n, inner, m - 1, uv);
+    }
+
+    for(int j = 1; j < nv - 1; j++){
+        for(int i = 1; i < nu - 1; i++){
+            int k = 4 + (j - 1) * (nu - 1) + (i - 1);
+            tri = bezier_triangle(tri, k, k + 1, k + nu, uv);
+            tri = bezier_triangle(tri, k, k + nu, k + nu - 1, uv);
+        }
+    }
+    free(uv);
+
+    mesh_clear(mesh);
+    mesh->vertex = vertex;
+    mesh->normal = normal;
+    mesh->nVertex = nVertex;
+    mesh->index = index;
+    mesh->nTriangle = nTriangle;
+    mesh->oneSided = 0;
+    mesh->zBuffer = b->zBuffer;
+    mesh_optimize(mesh, 32);
+    return 0;
+}
+
+// the sum of the four points p weighted by w, into q
+// a point fits in one AVX register, or two SSE2 ones, so each term is a broadcast multiply-add
+static inline void bezier_combine(const double w[4], const Point p[4], Point *q){
+#if defined(__AVX__)
+    __m256d acc = _mm256_mul_pd(_mm256_broadcast_sd(&w[0]), _mm256_loadu_pd(p[0].val));
+    acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_broadcast_sd(&w[1]), _mm256_loadu_pd(p[1].val)));
+    acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_broadcast_sd(&w[2]), _mm256_loadu_pd(p[2].val)));
+    acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_broadcast_sd(&w[3]), _mm256_loadu_pd(p[3].val)));
+    _mm256_storeu_pd(q->val, acc);
+#elif defined(__SSE2__)
+    __m128d lo = _mm_setzero_pd(), hi = _mm_setzero_pd();
+    for(int k = 0; k < 4; k++){
+        __m128d s = _mm_set1_pd(w[k]);
+        lo = _mm_add_pd(lo, _mm_mul_pd(s, _mm_loadu_pd(&p[k].val[0])));
+        hi = _mm_add_pd(hi, _mm_mul_pd(s, _mm_loadu_pd(&p[k].val[2])));
+    }
+    _mm_storeu_pd(&q->val[0], lo);
+    _mm_storeu_pd(&q->val[2], hi);
+#else
+    for(int j = 0; j < 4; j++){
+        q->val[j] = w[0] * p[0].val[j] + w[1] * p[1].val[j] + w[2] * p[2].val[j] + w[3] * p[3].val[j];
+    }
+#endif
+}
+
+// replace the contents of mesh with the surface evaluated on a grid of nu by nv cells, two triangles each,
+// sharing its (nu + 1) * (nv + 1) vertices, with the surface normals du x dv at them
+// the Bernstein basis and its derivative are tabled once per grid line; each row of the grid first collapses
+// the net to the four control points of the curve along it, so a vertex, its du and its dv are three
+// weighted sums of four points
+// returns 0 on success, -1 on an invalid grid or when memory runs out
+int bezierSurface_grid(BezierSurface *b, int nu, int nv, Mesh *mesh){
+    if(b == NULL || mesh == NULL || nu < 1 || nv < 1){
+        fprintf(stderr, "Invalid bezier surface, grid or mesh.\n");
+        return -1;
+    }
+
+    int nVertex = (nu + 1) * (nv + 1);
+    int nTriangle = 2 * nu * nv;
+    Point *vertex = (Point*)malloc(nVertex * sizeof(Point));
+    Vector *normal = (Vector*)malloc(nVertex * sizeof(Vector));
+    int *index = (int*)malloc(3 * nTriangle * sizeof(int));
+    // the basis values and derivatives at every u, then at every v
+    double *basis = (double*)malloc(8 * (nu + nv + 2) * sizeof(double));
+    if(vertex == NULL || normal == NULL || index == NULL || basis == NULL){
+        fprintf(stderr, "Unable to allocate memory for bezier grid.\n");
+        free(vertex);
+        free(normal);
+        free(index);
+        free(basis);
+        return -1;
+    }
+
+    double *Bu = basis, *dBu = Bu + 4 * (nu + 1), *Bv = dBu + 4 * (nu + 1), *dBv = Bv + 4 * (nv + 1);
+    for(int i = 0; i <= nu; i++){
+        bezier_basis((double)i / nu, &Bu[4 * i], &dBu[4 * i]);
+    }
+    for(int j = 0; j <= nv; j++){
+        bezier_basis((double)j / nv, &Bv[4 * j], &dBv[4 * j]);
+    }
+
+    for(int j = 0; j <= nv; j++){
+        // the curve at this v, and its derivative in v, as four control points each
+        Point row[4], rowV[4], column[4];
+        for(int i = 0; i < 4; i++){
+            for(int k = 0; k < 4; k++){
+                column[k] = b->p[k * 4 + i];
+            }
+            bezier_combine(&Bv[4 * j], column, &row[i]);
+            bezier_combine(&dBv[4 * j], column, &rowV[i]);
+        }
+
+        for(int i = 0; i <= nu; i++){
+            int k = j * (nu + 1) + i;
+            Vector su, sv;
+            bezier_combine(&Bu[4 * i], row, &vertex[k]);
+            bezier_combine(&dBu[4 * i], row, &su);
+            bezier_combine(&Bu[4 * i], rowV, &sv);
+            vertex[k].val[3] = 1.0;
+
+            vector_cross(&su, &sv, &normal[k]);
+            double length = vector_length(&normal[k]);
+            if(length > 1e-9 * vector_length(&su) * vector_length(&sv)){
+                vector_scale(&normal[k], 1.0 / length);
+            }else{
+                bezierSurface_evaluate(b, (double)i / nu, (double)j / nv, NULL, &normal[k]);
+            }
+        }
+    }
+    free(basis);
+
+    // the cells go band by band, each band few enough columns wide that the row of vertices
+    // above the one being drawn is still in the post-transform cache
+    int *tri = index;
+    for(int first = 0; first < nu; first += BEZIER_GRID_BAND){
+        int last = first + BEZIER_GRID_BAND < nu ? first + BEZIER_GRID_BAND : nu;
+        for(int j = 0; j < nv; j++){
+            for(int i = first; i < last; i++){
+                int k = j * (nu + 1) + i;
+                tri[0] = k;
+                tri[1] = k + 1;
+                tri[2] = k + nu + 2;
+                tri[3] = k;
+                tri[4] = k + nu + 2;
+                tri[5] = k + nu + 1;
+                tri += 6;
+            }
+        }
+    }
+
+    mesh_clear(mesh);
+    mesh->vertex = vertex;
+    mesh->normal = normal;
+    mesh->nVertex = nVertex;
+    mesh->index = index;
+    mesh->nTriangle = nTriangle;
+    mesh->oneSided = 0;
+    mesh->zBuffer = b->zBuffer;
+    return 0;
+}
+
+// one patch's tessellation, held in the cache
+typedef struct{
+    BezierPatch *patch; // the patch, or NULL for an empty slot
+    BezierSurface surface; // the patch's control points when it was tessellated
+    int level[6]; // the levels it was tessellated at
+    Mesh mesh;
+    long frame; // the last frame the patch was drawn in
+}BezierCacheEntry;
+
+struct BezierCache{
+    BezierCacheEntry *entry; // hash table on the address of the patch, probed linearly
+    int size; // slots in the table, a power of two
+    int used; // slots holding a patch
+    long frame; // the frame being drawn
+};
+
+// allocate an empty cache
+BezierCache *bezierCache_create(void){
+    BezierCache *cache = (BezierCache*)malloc(sizeof(BezierCache));
+    if(cache == NULL){
+        fprintf(stderr, "Unable to allocate memory for bezier cache.\n");
+        return NULL;
+    }
+
+    cache->entry = NULL;
+    cache->size = 0;
+    cache->used = 0;
+    cache->frame = 0;
+    return cache;
+}
+
+// free the cache and every tessellation in it
+void bezierCache_free(BezierCache *cache){
+    if(cache == NULL){
+        return;
+    }
+
+    for(int i = 0; i < cache->size; i++){
+        if(cache->entry[i].patch != NULL){
+            mesh_clear(&cache->entry[i].mesh);
+        }
+    }
+    free(cache->entry);
+    free(cache);
+}
+
+// start a new frame; tessellations not used in this frame or the last may be dropped to make room
+void bezierCache_nextFrame(BezierCache *cache){
+    if(cache == NULL){
+        fprintf(stderr, "Invalid bezier cache.\n");
+        return;
+    }
+
+    cache->frame++;
+}
+
+// the slot holding patch, or the empty slot where it belongs
+static BezierCacheEntry *bezierCache_find(BezierCacheEntry *entry, int size, BezierPatch *patch){
+    size_t i = (size_t)(((uintptr_t)patch >> 4) * 2654435761u);
+    while(1){
+        i &= size - 1;
+        if(entry[i].patch == patch || entry[i].patch == NULL){
+            return &entry[i];
+        }
+        i++;
+    }
+}
+
+// make room for one more patch: drop the tessellations that went unused last frame,
+// then double the table if it would still be more than half full
+// returns 0 on success, -1 when memory runs out
+static int bezierCache_grow(BezierCache *cache){
+    int live = 0;
+    for(int i = 0; i < cache->size; i++){
+        if(cache->entry[i].patch != NULL && cache->entry[i].frame >= cache->frame - 1){
+            live++;
+        }
+    }
+    int size = cache->size > 0 ? cache->size : 16;
+    while(2 * (live + 1) > size){
+        size *= 2;
+    }
+
+    BezierCacheEntry *entry = (BezierCacheEntry*)calloc(size, sizeof(BezierCacheEntry));
+    if(entry == NULL){
+        fprintf(stderr, "Unable to allocate memory for bezier cache.\n");
+        return -1;
+    }
+    for(int i = 0; i < cache->size; i++){
+        BezierCacheEntry *e = &cache->entry[i];
+        if(e->patch == NULL){
+            continue;
+        }
+        if(e->frame >= cache->frame - 1){
+            *bezierCache_find(entry, size, e->patch) = *e;
+        }else{
+            mesh_clear(&e->mesh);
+        }
+    }
+    free(cache->entry);
+    cache->entry = entry;
+    cache->size = size;
+    cache->used = live;
+    return 0;
+}
+
+// the tessellation of the patch at the given levels, reusing the one from an earlier draw if the levels
+// and control points are the same; built is set to 1 if the patch had to be tessellated, 0 otherwise
+// a patch drawn several times in a frame at different levels is tessellated again at each change
+// returns NULL if the patch cannot be tessellated
+Mesh *bezierCache_mesh(BezierCache *cache, BezierPatch *patch, int level[6], int *built){
+    if(cache == NULL || patch == NULL || level == NULL || built == NULL){
+        fprintf(stderr, "Invalid bezier cache, patch or levels.\n");
+        return NULL;
+    }
+
+    *built = 0;
+    BezierCacheEntry *e = cache->size > 0 ? bezierCache_find(cache->entry, cache->size, patch) : NULL;
+    if(e == NULL || e->patch == NULL){
+        if(2 * (cache->used + 1) > cache->size && bezierCache_grow(cache) != 0){
+            return NULL;
+        }
+        e = bezierCache_find(cache->entry, cache->size, patch);
+        e->patch = patch;
+        e->level[0] = 0;
+        mesh_init(&e->mesh);
+        cache->used++;
+    }
 
-    // base case
-    if (largestDimension <= 10) {
-        // Draw lines between the control points
-        for (int i = 0; i < 3; i++) {
-            Line l;
-            line_set(&l, b->p[i], b->p[i+1]);
-            line_draw(&l, src, c);
+    // the surface is compared bytewise, so it is copied bytewise too
+    if(memcmp(e->level, level, sizeof(e->level)) != 0 || memcmp(&e->surface, &patch->surface, sizeof(BezierSurface)) != 0){
+        if(bezierSurface_tessellate(&patch->surface, level, &e->mesh) != 0){
+            e->level[0] = 0;
+            return NULL;
         }
-    }else{
-        BezierCurve left, right;
-        de_casteljau(b, &left, &right);
-        bezierCurve_draw(&left, src, c);
-        bezierCurve_draw(&right, src, c);
+        memcpy(e->level, level, sizeof(e->level));
+        memcpy(&e->surface, &patch->surface, sizeof(BezierSurface));
+        *built = 1;
     }
+    e->frame = cache->frame;
+    return &e->mesh;
 }
 
 // calculate the bounding box of the Bezier curve and return the largest dimension
@@ -8,6 +8,17 @@ DrawState *drawstate_create(void){
         fprintf(stderr, "Unable to allocate memory for DrawState.\n");
         return NULL;
     }
+
+    drawstate_init(s);
+    return s;
+}
+
+// initialize an existing DrawState to the default values
+void drawstate_init(DrawState *s){
+    if(s == NULL){
+        fprintf(stderr, "Invalid DrawState.\n");
+        return;
+    }
     Color white, surface;
     color_set(&white, 1.0, 1.0, 1.0);
     color_set(&surface, 0.1, 0.1, 0.1);
@@ -18,8 +29,14 @@ DrawState *drawstate_create(void){
     color_copy(&(s->flatColor), &white);
     s->surfaceCoeff = 0.0;
     s->zBufferFlag = 1;
+    s->floatVertexFlag = 0;
+    s->lineAntialiasFlag = 0;
+    s->depthOnlyFlag = 0;
     s->shade = ShadeFrame;
-    return s;
+    point_set3D(&(s->viewer), 0.0, 0.0, 0.0);
+    s->texture.map = NULL;
+    s->texture.s = 0.0;
+    s->texture.t = 0.0;
 }
 
 // set the color field to c
@@ -76,7 +93,11 @@ void drawstate_copy(DrawState *to, DrawState *from){
     to->shade = from->shade;
     to->surfaceCoeff = from->surfaceCoeff;
     to->zBufferFlag = from->zBufferFlag;
+    to->floatVertexFlag = from->floatVertexFlag;
+    to->lineAntialiasFlag = from->lineAntialiasFlag;
+    to->depthOnlyFlag = from->depthOnlyFlag;
     point_copy(&(to->viewer), &(from->viewer));
+    to->texture = from->texture;
 }
 
 void drawstate_print(DrawState *s) {
@@ -100,6 +121,9 @@ void drawstate_print(DrawState *s) {
 
     printf("Surface Coefficient: %.2f\n", s->surfaceCoeff);
     printf("Z-Buffer Flag: %d\n", s->zBufferFlag);
+    printf("Float Vertex Flag: %d\n", s->floatVertexFlag);
+    printf("Line Antialias Flag: %d\n", s->lineAntialiasFlag);
+    printf("Depth Only Flag: %d\n", s->depthOnlyFlag);
 
     printf("Viewer: ");
     point_print(&(s->viewer),stdout);
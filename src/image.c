@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include "image.h"
 
 // constructors and deconstructors
@@ -14,7 +15,7 @@ Image *image_create(int rows, int cols){
     if(rows == 0 || cols == 0){
         return NULL;
     }else{
-        image = (Image*)malloc(rows * cols * sizeof(Image));
+        image = (Image*)malloc(sizeof(Image));
     }
 
     if(image == NULL){
@@ -22,7 +23,12 @@ Image *image_create(int rows, int cols){
         return NULL;
     }
 
-    image_alloc(image, rows, cols);
+    image_init(image);
+    if(image_alloc(image, rows, cols) != 0){
+        fprintf(stderr, "Error: Unable to allocate memory for image.\n");
+        free(image);
+        return NULL;
+    }
     image->zBuffer = 1;
     image->a = 1;
 
@@ -40,6 +46,8 @@ void image_init(Image *src){
     src -> data = NULL;
     src->zBuffer = 1;
     src->a = 1;
+    src->samples = 1;
+    src->sample = NULL;
 }
 
 // allocate space for image data, 0.0 for RGB and 1.0 for A and Z
@@ -58,6 +66,8 @@ int image_alloc(Image *src, int rows, int cols){
     src -> cols = cols;
     src->zBuffer = 1;
     src->a = 1;
+    src->samples = 1;
+    src->sample = NULL;
 
     // allocate space for image data
     src -> data = (FPixel **)malloc(rows * sizeof(FPixel *));
@@ -96,6 +106,10 @@ void image_dealloc(Image *src){
     if(src == NULL || src->data == NULL){
         return;
     }
+
+    free(src->sample);
+    src->sample = NULL;
+    src->samples = 1;
     
     for (int i = 0; i < src -> rows; i++) {
         free(src->data[i]);
@@ -170,6 +184,13 @@ Image *image_read(char *filename){
     return img;
 }
 
+// a channel value as the byte written to a PPM, clamped to [0, 1] first
+static unsigned char channel_byte(float v){
+    if(!(v > 0.0f)) return 0; // NaN too
+    if(v > 1.0f) v = 1.0f;
+    return (unsigned char)(v * 255);
+}
+
 // writes a PPM image to the given filename
 // Returns 0 on success.
 int image_write(Image *src, char *filename){
@@ -190,9 +211,9 @@ int image_write(Image *src, char *filename){
     unsigned char pixel[3];
     for (int i = 0; i < src->rows; i++) {
         for (int j = 0; j < src->cols; j++) {
-            pixel[0] = (unsigned char)((src->data[i][j].c.c[0] > 1.0 ? 1.0 : src->data[i][j].c.c[0]) * 255);
-            pixel[1] = (unsigned char)((src->data[i][j].c.c[1] > 1.0 ? 1.0 : src->data[i][j].c.c[1]) * 255);
-            pixel[2] = (unsigned char)((src->data[i][j].c.c[2] > 1.0 ? 1.0 : src->data[i][j].c.c[2]) * 255);
+            pixel[0] = channel_byte(src->data[i][j].c.c[0]);
+            pixel[1] = channel_byte(src->data[i][j].c.c[1]);
+            pixel[2] = channel_byte(src->data[i][j].c.c[2]);
             fwrite(pixel, sizeof(unsigned char), 3, fp);
         }
     }
@@ -245,11 +266,12 @@ float image_getz(Image *src, int r, int c){
 }
 
 // sets the values of pixel (r, c) to the FPixel val.
+// in a multisampled image every sample of the pixel is set too
 void image_setf(Image *src, int r, int c, FPixel val){
     if (src == NULL || src->data == NULL || r < 0 || r >= src->rows || c < 0 || c >= src->cols) {
         return; // Error
     }
-    src->data[r][c] = val;
+    image_put(src, r, c, val);
 }
 
 // sets the value of pixel (r, c) band b to val.
@@ -269,7 +291,13 @@ void image_setc(Image *src, int r, int c, int b, float val){
             break;
         default:
             fprintf(stderr, "Error: Invalid band index.\n");
-            break;
+            return;
+    }
+    if(src->samples > 1){
+        FPixel *sample = &src->sample[((size_t)r * src->cols + c) * src->samples];
+        for(int i = 0; i < src->samples; i++){
+            sample[i].c.c[b] = val;
+        }
     }
 }
 
@@ -279,6 +307,12 @@ void image_seta(Image *src, int r, int c, float val){
         return; // Error
     }
     src->data[r][c].a = val;
+    if(src->samples > 1){
+        FPixel *sample = &src->sample[((size_t)r * src->cols + c) * src->samples];
+        for(int i = 0; i < src->samples; i++){
+            sample[i].a = val;
+        }
+    }
 }
 
 // sets the depth value of pixel (r, c) to val.
@@ -287,9 +321,103 @@ void image_setz(Image *src, int r, int c, float val){
         return; // Error
     }
     src->data[r][c].z = val;
+    if(src->samples > 1){
+        FPixel *sample = &src->sample[((size_t)r * src->cols + c) * src->samples];
+        for(int i = 0; i < src->samples; i++){
+            sample[i].z = val;
+        }
+    }
+}
+
+// sets every sample of pixel (r, c) of a multisampled image to val; r and c are not checked
+void image_putSamples(Image *src, int r, int c, FPixel val){
+    FPixel *sample = &src->sample[((size_t)r * src->cols + c) * src->samples];
+    for(int i = 0; i < src->samples; i++){
+        sample[i] = val;
+    }
+}
+
+// clip the columns c0 to c1 of row r to the image
+// returns 0 if nothing is left, leaving c0 and c1 undefined
+int image_clipSpan(Image *src, int r, int *c0, int *c1){
+    if (src == NULL || src->data == NULL || r < 0 || r >= src->rows) {
+        return 0;
+    }
+    if (*c0 < 0) *c0 = 0;
+    if (*c1 >= src->cols) *c1 = src->cols - 1;
+    return *c0 <= *c1;
+}
+
+// writes px[0] to px[c1 - c0] into columns c0 to c1 of row r, skipping the columns off the image
+// with zTest set, a pixel is only written where its z is greater (nearer) than the one stored
+// returns the number of pixels written
+int image_writeSpan(Image *src, int r, int c0, int c1, FPixel *px, int zTest){
+    if (px == NULL) {
+        return 0;
+    }
+    int first = c0;
+    if (!image_clipSpan(src, r, &c0, &c1)) {
+        return 0;
+    }
+
+    FPixel *row = image_row(src, r);
+    px += c0 - first;
+    int n = 0;
+    for (int c = c0; c <= c1; c++, px++) {
+        if (zTest && !(px->z > row[c].z)) {
+            continue;
+        }
+        image_put(src, r, c, *px);
+        n++;
+    }
+    return n;
+}
+
+// sets columns c0 to c1 of row r to color c, with z starting at z in column c0 and changing by dz per column
+// with zTest set, a pixel is only written where its z is greater (nearer) than the one stored
+// returns the number of pixels written
+int image_fillSpan(Image *src, int r, int c0, int c1, Color c, float z, float dz, int zTest){
+    int first = c0;
+    if (!image_clipSpan(src, r, &c0, &c1)) {
+        return 0;
+    }
+
+    FPixel *row = image_row(src, r);
+    FPixel val = {c, 1.0f, z + (c0 - first) * dz};
+    int n = 0;
+    if (!zTest && dz == 0 && src->samples <= 1) {
+        for (int col = c0; col <= c1; col++) {
+            row[col] = val;
+        }
+        return c1 - c0 + 1;
+    }
+    for (int col = c0; col <= c1; col++, val.z += dz) {
+        if (zTest && !(val.z > row[col].z)) {
+            continue;
+        }
+        image_put(src, r, col, val);
+        n++;
+    }
+    return n;
 }
 
 //Utility
+// copy every pixel of a multisampled image into all of its samples
+static void image_fillSamples(Image *src){
+    if(src->samples <= 1){
+        return;
+    }
+
+    FPixel *sample = src->sample;
+    for(int i = 0; i < src->rows; i++){
+        for(int j = 0; j < src->cols; j++){
+            for(int k = 0; k < src->samples; k++){
+                *sample++ = src->data[i][j];
+            }
+        }
+    }
+}
+
 // resets every pixel to a default value (e.g. Black, alpha value of 1.0, z value of 1.0).
 void image_reset(Image *src){
     if (src == NULL || src->data == NULL) return;
@@ -303,6 +431,7 @@ void image_reset(Image *src){
             src->data[i][j].z = 1.0f;      // Depth
         }
     }
+    image_fillSamples(src);
 }
 
 // sets every FPixel to the given value
@@ -314,6 +443,7 @@ void image_fill(Image *src, FPixel val){
             src->data[i][j] = val;
         }
     }
+    image_fillSamples(src);
 }
 
 //  sets the (r, g, b) val ues of each pixel to the given color.
@@ -327,6 +457,7 @@ void image_fillrgb(Image *src, float r, float g, float b){
             src->data[i][j].c.c[2] = b;
         }
     }
+    image_fillSamples(src);
 }
 
 // set the alpha value of each pixel to the given value
@@ -338,6 +469,7 @@ void image_filla(Image *src, float a){
             src->data[i][j].a = a;
         }
     }
+    image_fillSamples(src);
 }
 
 // set the depth value of each pixel to the given value
@@ -349,6 +481,7 @@ void image_fillz(Image *src, float z){
             src->data[i][j].z = z;
         }
     }
+    image_fillSamples(src);
 }
 
 // copy the Color data to the proper pixel
@@ -356,10 +489,365 @@ void image_setColor(Image *src, int r, int c, Color val){
     FPixel *pixel = &src->data[r][c];
     color_copy(&(pixel->c), &val);
     pixel->a = 1.0;
+    if(src->samples > 1){
+        FPixel *sample = &src->sample[((size_t)r * src->cols + c) * src->samples];
+        for(int i = 0; i < src->samples; i++){
+            sample[i].c = val;
+            sample[i].a = 1.0;
+        }
+    }
+}
+
+// sample positions in 1/16 pixel from the pixel center, x then y, for 2, 4, 8 and 16 samples
+// (the usual rotated and sparse patterns, so near-horizontal and near-vertical edges both get distinct samples)
+#define SAMPLE(x, y) (x) / 16.0f, (y) / 16.0f
+static const float samplePattern2[] = {SAMPLE(4, 4), SAMPLE(-4, -4)};
+static const float samplePattern4[] = {SAMPLE(-2, -6), SAMPLE(6, -2), SAMPLE(-6, 2), SAMPLE(2, 6)};
+static const float samplePattern8[] = {SAMPLE(1, -3), SAMPLE(-1, 3), SAMPLE(5, 1), SAMPLE(-3, -5),
+                                       SAMPLE(-5, 5), SAMPLE(-7, -1), SAMPLE(3, 7), SAMPLE(7, -7)};
+static const float samplePattern16[] = {SAMPLE(1, 1), SAMPLE(-1, -3), SAMPLE(-3, 2), SAMPLE(4, -1),
+                                        SAMPLE(-5, -2), SAMPLE(2, 5), SAMPLE(5, 3), SAMPLE(3, -5),
+                                        SAMPLE(-2, 6), SAMPLE(0, -7), SAMPLE(-4, -6), SAMPLE(-6, 4),
+                                        SAMPLE(-8, 0), SAMPLE(7, -4), SAMPLE(6, 7), SAMPLE(-7, -8)};
+#undef SAMPLE
+
+// the sample positions of a multisampled image with the given samples per pixel, as offsets in pixels
+// from the pixel center, x then y for each sample; NULL if there is no pattern for that many samples
+const float *image_samplePattern(int samples){
+    switch(samples){
+        case 2: return samplePattern2;
+        case 4: return samplePattern4;
+        case 8: return samplePattern8;
+        case 16: return samplePattern16;
+        default: return NULL;
+    }
+}
+
+// store samples colors and depths for every pixel (2, 4, 8 or 16), or go back to one per pixel with 1
+// polygons are then rasterized with per-sample coverage and depth but shaded once per pixel;
+// everything else drawn into the image sets all the samples of a pixel alike
+// call image_resolve before reading the pixels; returns 0 on success
+int image_setSamples(Image *src, int samples){
+    if(src == NULL || src->data == NULL || (samples != 1 && image_samplePattern(samples) == NULL)){
+        fprintf(stderr, "Invalid image or number of samples.\n");
+        return -1;
+    }
+
+    free(src->sample);
+    src->sample = NULL;
+    src->samples = 1;
+    if(samples == 1){
+        return 0;
+    }
+
+    src->sample = (FPixel*)malloc((size_t)src->rows * src->cols * samples * sizeof(FPixel));
+    if(src->sample == NULL){
+        fprintf(stderr, "Unable to allocate memory for samples.\n");
+        return -1;
+    }
+    src->samples = samples;
+    image_fillSamples(src);
+    return 0;
+}
+
+// set every pixel of a multisampled image to the average of its samples' colors,
+// and its depth to that of its nearest sample
+void image_resolve(Image *src){
+    if(src == NULL || src->data == NULL || src->samples <= 1){
+        return;
+    }
+
+    int n = src->samples;
+    float scale = 1.0f / n;
+    FPixel *sample = src->sample;
+    for(int i = 0; i < src->rows; i++){
+        for(int j = 0; j < src->cols; j++){
+            float r = 0, g = 0, b = 0, a = 0, z = sample[0].z;
+            for(int k = 0; k < n; k++){
+                r += sample[k].c.c[0];
+                g += sample[k].c.c[1];
+                b += sample[k].c.c[2];
+                a += sample[k].a;
+                if(sample[k].z > z){
+                    z = sample[k].z;
+                }
+            }
+            FPixel *p = &src->data[i][j];
+            p->c.c[0] = r * scale;
+            p->c.c[1] = g * scale;
+            p->c.c[2] = b * scale;
+            p->a = a * scale;
+            p->z = z;
+            sample += n;
+        }
+    }
+}
+
+// weights of the source pixels along one axis for an output pixel, centered on the factor pixels it covers;
+// returns the number of taps and sets offset to how many of them come before the block
+static int image_filterTaps(int factor, ImageFilter filter, float *weight, int *offset){
+    if(filter == FilterBox){
+        for(int i = 0; i < factor; i++){
+            weight[i] = 1.0f / factor;
+        }
+        *offset = 0;
+        return factor;
+    }
+
+    // tent two output pixels wide: source pixel centers at distance d from the output center get 1 - d / factor
+    int taps = 2 * factor;
+    float center = factor / 2 + factor / 2.0f;
+    float sum = 0;
+    for(int i = 0; i < taps; i++){
+        float d = fabsf(i + 0.5f - center);
+        weight[i] = d < factor ? 1.0f - d / factor : 0.0f;
+        sum += weight[i];
+    }
+    *offset = factor / 2;
+    for(int i = 0; i < taps; i++){
+        weight[i] /= sum;
+    }
+    return taps;
+}
+
+// shrink src by an integer factor into dst, which is resized to fit, for supersampling anti-aliasing:
+// draw the scene factor times larger in each direction (e.g. with the view's screen size multiplied),
+// then filter it down; the filter is applied one axis at a time, and edges are clamped
+// returns 0 on success
+int image_downsample(Image *src, Image *dst, int factor, ImageFilter filter){
+    if(src == NULL || dst == NULL || src->data == NULL || factor < 1 || src->rows < factor || src->cols < factor){
+        fprintf(stderr, "Invalid images or downsampling factor.\n");
+        return -1;
+    }
+
+    int rows = src->rows / factor, cols = src->cols / factor;
+    if(dst->data == NULL || dst->rows != rows || dst->cols != cols){
+        if(image_alloc(dst, rows, cols) != 0){
+            fprintf(stderr, "Unable to allocate downsampled image.\n");
+            return -1;
+        }
+    }
+
+    float *weight = (float*)malloc(2 * factor * sizeof(float));
+    float *line = (float*)malloc((size_t)src->rows * cols * 3 * sizeof(float));
+    if(weight == NULL || line == NULL){
+        fprintf(stderr, "Unable to allocate memory for downsampling.\n");
+        free(weight);
+        free(line);
+        return -1;
+    }
+    int offset;
+    int taps = image_filterTaps(factor, filter, weight, &offset);
+
+    // filter each source row down to cols pixels
+    for(int i = 0; i < src->rows; i++){
+        FPixel *row = src->data[i];
+        float *out = &line[(size_t)i * cols * 3];
+        for(int j = 0; j < cols; j++){
+            float r = 0, g = 0, b = 0;
+            int first = j * factor - offset;
+            for(int k = 0; k < taps; k++){
+                int x = first + k;
+                x = x < 0 ? 0 : (x >= src->cols ? src->cols - 1 : x);
+                r += weight[k] * row[x].c.c[0];
+                g += weight[k] * row[x].c.c[1];
+                b += weight[k] * row[x].c.c[2];
+            }
+            out[3 * j] = r;
+            out[3 * j + 1] = g;
+            out[3 * j + 2] = b;
+        }
+    }
+
+    // then the columns down to rows pixels
+    for(int i = 0; i < rows; i++){
+        int first = i * factor - offset;
+        for(int j = 0; j < cols; j++){
+            float r = 0, g = 0, b = 0;
+            for(int k = 0; k < taps; k++){
+                int y = first + k;
+                y = y < 0 ? 0 : (y >= src->rows ? src->rows - 1 : y);
+                float *in = &line[((size_t)y * cols + j) * 3];
+                r += weight[k] * in[0];
+                g += weight[k] * in[1];
+                b += weight[k] * in[2];
+            }
+            FPixel *p = &dst->data[i][j];
+            p->c.c[0] = r;
+            p->c.c[1] = g;
+            p->c.c[2] = b;
+            p->a = 1.0f;
+            p->z = 1.0f;
+        }
+    }
+
+    free(weight);
+    free(line);
+    return 0;
 }
 
 // return a color structure built from the pixel values
 Color image_getColor(Image *src, int r, int c){
     FPixel p = image_getf(src, r, c);
     return p.c;
-}
\ No newline at end of file
+}
+
+// Comparison
+// quantize a channel value the same way image_write does, so a rendered image
+// compares exactly against the PPM it would be written to
+static float quantize(float v){
+    return channel_byte(v) / 255.0f;
+}
+
+// luminance of the quantized pixel at (r, c)
+static float luminance(Image *src, int r, int c){
+    FPixel *p = &src->data[r][c];
+    return 0.299f * quantize(p->c.c[0]) + 0.587f * quantize(p->c.c[1]) + 0.114f * quantize(p->c.c[2]);
+}
+
+// compare images a and b channel by channel and fill in stats
+// a pixel counts as different if any channel differs by more than tolerance (in [0, 1])
+// if diff is not NULL it is resized to match and set to a diff image:
+// matching pixels are a dimmed copy of a, differing pixels are red scaled by the error
+// returns the number of differing pixels, or -1 if the images cannot be compared
+int image_compare(Image *a, Image *b, float tolerance, ImageDiff *stats, Image *diff){
+    if(a == NULL || b == NULL || a->data == NULL || b->data == NULL){
+        fprintf(stderr, "Unable to compare. Invalid images.\n");
+        return -1;
+    }
+    if(a->rows != b->rows || a->cols != b->cols){
+        fprintf(stderr, "Unable to compare. Image sizes differ (%dx%d vs %dx%d).\n", a->cols, a->rows, b->cols, b->rows);
+        return -1;
+    }
+    if(diff != NULL && (diff->rows != a->rows || diff->cols != a->cols)){
+        if(image_alloc(diff, a->rows, a->cols) != 0){
+            fprintf(stderr, "Unable to allocate diff image.\n");
+            diff = NULL;
+        }
+    }
+
+    int nDiff = 0;
+    float maxError = 0.0f;
+    double sse = 0.0;
+
+    for(int i = 0; i < a->rows; i++){
+        for(int j = 0; j < a->cols; j++){
+            float err = 0.0f;
+            for(int k = 0; k < 3; k++){
+                float d = fabsf(quantize(a->data[i][j].c.c[k]) - quantize(b->data[i][j].c.c[k]));
+                sse += d * d;
+                if(d > err) err = d;
+            }
+            if(err > maxError) maxError = err;
+            if(err > tolerance) nDiff++;
+
+            if(diff != NULL){
+                FPixel *p = &diff->data[i][j];
+                if(err > tolerance){
+                    color_set(&(p->c), 0.5f + 0.5f * err, 0.0f, 0.0f);
+                }else{
+                    float l = 0.25f * luminance(a, i, j);
+                    color_set(&(p->c), l, l, l);
+                }
+                p->a = 1.0f;
+                p->z = 1.0f;
+            }
+        }
+    }
+
+    if(stats != NULL){
+        stats->nPixels = a->rows * a->cols;
+        stats->nDiff = nDiff;
+        stats->maxError = maxError;
+        stats->mse = sse / (3.0 * a->rows * a->cols);
+        stats->psnr = stats->mse > 0.0 ? 10.0 * log10(1.0 / stats->mse) : INFINITY;
+        stats->ssim = image_ssim(a, b);
+    }
+
+    return nDiff;
+}
+
+// compare src against the reference PPM stored in the given file
+// if diffname is not NULL and the images differ, a diff image is written there
+// returns the number of differing pixels, or -1 if the comparison could not be made
+int image_compareFile(Image *src, char *reference, float tolerance, ImageDiff *stats, char *diffname){
+    Image *ref = image_read(reference);
+    if(ref == NULL){
+        fprintf(stderr, "Unable to read reference image %s.\n", reference);
+        return -1;
+    }
+
+    Image diff;
+    image_init(&diff);
+    int nDiff = image_compare(src, ref, tolerance, stats, diffname != NULL ? &diff : NULL);
+    if(nDiff > 0 && diffname != NULL){
+        image_write(&diff, diffname);
+    }
+
+    image_dealloc(&diff);
+    image_free(ref);
+    return nDiff;
+}
+
+// return the peak signal-to-noise ratio between a and b in dB, INFINITY if they are identical
+double image_psnr(Image *a, Image *b){
+    ImageDiff d;
+    if(image_compare(a, b, 0.0f, &d, NULL) < 0){
+        return 0.0;
+    }
+    return d.psnr;
+}
+
+// return the mean structural similarity of the luminance of a and b
+// computed over 8x8 windows placed every 4 pixels
+double image_ssim(Image *a, Image *b){
+    if(a == NULL || b == NULL || a->data == NULL || b->data == NULL || a->rows != b->rows || a->cols != b->cols){
+        fprintf(stderr, "Unable to compute SSIM. Invalid images.\n");
+        return 0.0;
+    }
+
+    const int win = 8;
+    const int step = 4;
+    const double C1 = 0.01 * 0.01;
+    const double C2 = 0.03 * 0.03;
+    int rows = a->rows < win ? a->rows : win;
+    int cols = a->cols < win ? a->cols : win;
+    double total = 0.0;
+    int count = 0;
+
+    for(int r0 = 0; r0 + rows <= a->rows; r0 += step){
+        for(int c0 = 0; c0 + cols <= a->cols; c0 += step){
+            double sa = 0.0, sb = 0.0, saa = 0.0, sbb = 0.0, sab = 0.0;
+            for(int i = r0; i < r0 + rows; i++){
+                for(int j = c0; j < c0 + cols; j++){
+                    double la = luminance(a, i, j);
+                    double lb = luminance(b, i, j);
+                    sa += la;
+                    sb += lb;
+                    saa += la * la;
+                    sbb += lb * lb;
+                    sab += la * lb;
+                }
+            }
+            double n = rows * cols;
+            double ma = sa / n, mb = sb / n;
+            double va = saa / n - ma * ma;
+            double vb = sbb / n - mb * mb;
+            double cov = sab / n - ma * mb;
+            total += ((2 * ma * mb + C1) * (2 * cov + C2)) / ((ma * ma + mb * mb + C1) * (va + vb + C2));
+            count++;
+        }
+    }
+
+    return count > 0 ? total / count : 1.0;
+}
+
+// print the comparison result to the stream fp
+void imagediff_print(ImageDiff *d, FILE *fp){
+    if(d == NULL || fp == NULL){
+        return;
+    }
+
+    fprintf(fp, "pixels: %d, differing: %d, max error: %.4f, mse: %.6f, psnr: %.2f dB, ssim: %.4f\n",
+            d->nPixels, d->nDiff, d->maxError, d->mse, d->psnr, d->ssim);
+}
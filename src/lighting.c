@@ -1,6 +1,8 @@
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "lighting.h"
+#include "shadow.h"
 
 // light functions
 // initialize the light to default values
@@ -11,6 +13,7 @@ void light_init(Light *light){
     light->position = (Point){{0.0, 0.0, 0.0, 1.0}};
     light->cutoff = 0.0;
     light->sharpness = 0.0;
+    light->radius = 0.0;
 }
 
 // copy the light information
@@ -21,6 +24,7 @@ void light_copy(Light *to, Light *from){
     point_copy(&(to->position), &(from->position));
     to->cutoff = from->cutoff;
     to->sharpness = from->sharpness;
+    to->radius = from->radius;
 }
 
 void light_set(Light *light, LightType type, Color *c, Vector *dir, Point *pos, float cutoff, float sharpness){
@@ -38,6 +42,31 @@ void light_set(Light *light, LightType type, Color *c, Vector *dir, Point *pos,
     }    
     light->cutoff = cutoff;
     light->sharpness = sharpness;
+    light->radius = 0.0;
+}
+
+// whether two lights have the same type, color, placement, spot parameters and reach
+int light_equal(Light *a, Light *b){
+    if(a == NULL || b == NULL){
+        fprintf(stderr, "Invalid light.\n");
+        return 0;
+    }
+
+    return a->type == b->type && memcmp(&a->color, &b->color, sizeof(Color)) == 0 &&
+           memcmp(a->position.val, b->position.val, 3 * sizeof(double)) == 0 &&
+           memcmp(a->direction.val, b->direction.val, 3 * sizeof(double)) == 0 &&
+           a->cutoff == b->cutoff && a->sharpness == b->sharpness && a->radius == b->radius;
+}
+
+// give a point or spot light a finite reach: its contribution fades smoothly to zero at distance radius,
+// which lets shading skip it entirely for surfaces farther away; 0 restores unlimited reach
+void light_setRadius(Light *light, float radius){
+    if(light == NULL || radius < 0){
+        fprintf(stderr, "Invalid light or radius.\n");
+        return;
+    }
+
+    light->radius = radius;
 }
 
 //lighting functions
@@ -69,8 +98,10 @@ void lighting_init(Lighting *l){
     }
     for(int i = 0; i < 64; i++){
         light_init(&(l->light[i]));
+        l->shadow[i] = NULL;
     }
     l->nLights = 0;
+    l->compiled.valid = 0;
 }
 
 // reset the lighting structure to 0 lights
@@ -80,15 +111,18 @@ void lighting_clear(Lighting *l){
     }
     for(int i = 0; i < 64; i++){
         light_init(&(l->light[i]));
+        l->shadow[i] = NULL;
     }
     l->nLights = 0;
+    l->compiled.valid = 0;
 }
 
 // add a new light to the lighting structure given the parameters, some of which may be NULL, depending upon the type
 // Make sure you don't add more lights than max_lights
 void lighting_add(Lighting *l, LightType type, Color *c, Vector *dir, Point *pos, float cutoff, float sharpness){
-    if(l == NULL || l->nLights > 64){
+    if(l == NULL || l->nLights >= 64){
         fprintf(stderr, "Invalid lighting. Max lights reached. \n");
+        return;
     }
 
     Light *light = &(l->light[l->nLights]);
@@ -102,8 +136,141 @@ void lighting_add(Lighting *l, LightType type, Color *c, Vector *dir, Point *pos
     }
     light->cutoff = cutoff;
     light->sharpness = sharpness;
+    light->radius = 0.0;
+    l->shadow[l->nLights] = NULL;
 
     l->nLights++;
+    l->compiled.valid = 0;
+}
+
+// mask with the lowest n bits set, for n up to 64
+static uint64_t lighting_bits(int n){
+    return n >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << n) - 1;
+}
+
+// windowed inverse-square style falloff at distance d from a light of the given radius
+// 1 at the light, reaching 0 with zero slope at the radius; lights without a radius do not fade
+static double lighting_attenuation(double d, float radius){
+    if(radius <= 0){
+        return 1.0;
+    }
+    double x = d / radius;
+    if(x >= 1.0){
+        return 0.0;
+    }
+    x = 1.0 - x * x;
+    return x * x;
+}
+
+// add the body and surface reflection of one light with color (r, g, b) to result
+// dotNL is the cosine between the normal and the light, (lx, ly, lz) the light direction used for the halfway vector
+static void lighting_reflect(float dotNL, double lx, double ly, double lz, float r, float g, float b,
+                             Vector *N, Vector *V, Color *Cb, Color *Cs, float s, int oneSided, Color *result){
+    double hx = (lx + V->val[0]) * 0.5;
+    double hy = (ly + V->val[1]) * 0.5;
+    double hz = (lz + V->val[2]) * 0.5;
+    double length = sqrt(hx*hx + hy*hy + hz*hz);
+    hx = hx / length;
+    hy = hy / length;
+    hz = hz / length;
+
+    float dotNH = hx * N->val[0] + hy * N->val[1] + hz * N->val[2];
+    if(dotNL < 0 && !oneSided){
+        dotNL = -dotNL;
+        dotNH = -dotNH;
+    }
+    dotNH = pow(dotNH, s);
+
+    result->c[0] += dotNL * r * Cb->c[0] + dotNH * r * Cs->c[0];
+    result->c[1] += dotNL * g * Cb->c[1] + dotNH * g * Cs->c[1];
+    result->c[2] += dotNL * b * Cb->c[2] + dotNH * b * Cs->c[2];
+}
+
+// shade with the compiled light list; N and V are already unit vectors
+static void lighting_shadeCompiled(LightList *list, Vector *N, Vector *V, Point *p, Color *Cb, Color *Cs, float s, int oneSided, Color *c){
+    float dotNV = vector_dot(N, V);
+    Color result;
+    result.c[0] = 0.0 + list->ambient.c[0] * Cb->c[0];
+    result.c[1] = 0.0 + list->ambient.c[1] * Cb->c[1];
+    result.c[2] = 0.0 + list->ambient.c[2] * Cb->c[2];
+
+    int i = 0;
+    for(; i < list->nDirect; i++){
+        float dotNL = N->val[0] * list->dx[i] + N->val[1] * list->dy[i] + N->val[2] * list->dz[i];
+        if((oneSided && dotNL < 0) || (dotNL < 0 && dotNV > 0) || (dotNL > 0 && dotNV < 0)){
+            continue;
+        }
+        float lit = list->shadow[i] != NULL ? shadow_sample(list->shadow[i], p) : 1.0;
+        if(lit <= 0){
+            continue;
+        }
+        if(lit < 1.0){
+            lighting_reflect(dotNL, list->dx[i], list->dy[i], list->dz[i], lit * list->r[i], lit * list->g[i], lit * list->b[i],
+                             N, V, Cb, Cs, s, oneSided, &result);
+        }else{
+            lighting_reflect(dotNL, list->dx[i], list->dy[i], list->dz[i], list->r[i], list->g[i], list->b[i],
+                             N, V, Cb, Cs, s, oneSided, &result);
+        }
+    }
+
+    // point and spot lights that can reach p: the lights of its cluster plus those with unlimited reach
+    int nLit = list->nDirect + list->nPoint + list->nSpot;
+    uint64_t reach = lighting_bits(nLit) & ~lighting_bits(i);
+    if(list->clustered){
+        reach = list->unbounded;
+        int cx = (int)floor((p->val[0] - list->gridMin[0]) * list->cellScale[0]);
+        int cy = (int)floor((p->val[1] - list->gridMin[1]) * list->cellScale[1]);
+        int cz = (int)floor((p->val[2] - list->gridMin[2]) * list->cellScale[2]);
+        if(cx >= 0 && cx < LIGHT_GRID && cy >= 0 && cy < LIGHT_GRID && cz >= 0 && cz < LIGHT_GRID){
+            reach |= list->cell[(cz * LIGHT_GRID + cy) * LIGHT_GRID + cx];
+        }
+    }
+
+    while(reach != 0){
+        i = __builtin_ctzll(reach);
+        reach &= reach - 1;
+
+        double lx = list->px[i] - p->val[0];
+        double ly = list->py[i] - p->val[1];
+        double lz = list->pz[i] - p->val[2];
+        double length = sqrt(lx*lx + ly*ly + lz*lz);
+        float fade = lighting_attenuation(length, list->radius[i]);
+        if(fade <= 0.0){
+            continue;
+        }
+        lx = lx / length;
+        ly = ly / length;
+        lz = lz / length;
+
+        float dotNL = N->val[0] * lx + N->val[1] * ly + N->val[2] * lz;
+        if((oneSided && dotNL < 0) || (dotNL < 0 && dotNV > 0) || (dotNL > 0 && dotNV < 0)){
+            continue;
+        }
+        if(i >= list->nDirect + list->nPoint){
+            // spot lights: the halfway vector uses the direction from the light, as the uncompiled path does
+            lx = -lx;
+            ly = -ly;
+            lz = -lz;
+            float dotDL = list->dx[i] * lx + list->dy[i] * ly + list->dz[i] * lz;
+            if(dotDL < list->cosCutoff[i]){
+                continue;
+            }
+            if(list->shadow[i] != NULL){
+                fade *= shadow_sample(list->shadow[i], p);
+                if(fade <= 0){
+                    continue;
+                }
+            }
+        }
+        if(fade < 1.0){
+            lighting_reflect(dotNL, lx, ly, lz, fade * list->r[i], fade * list->g[i], fade * list->b[i],
+                             N, V, Cb, Cs, s, oneSided, &result);
+        }else{
+            lighting_reflect(dotNL, lx, ly, lz, list->r[i], list->g[i], list->b[i], N, V, Cb, Cs, s, oneSided, &result);
+        }
+    }
+
+    color_copy(c, &result);
 }
 
 // caculate the proper color given the normal N, view vector V, 3D point P, body color Cb, surface color Cs,
@@ -119,6 +286,10 @@ void lighting_shading(Lighting *l, Vector *N, Vector *V, Point *p, Color *Cb, Co
     Color result = {{0.0, 0.0, 0.0}};
     vector_normalize(N);
     vector_normalize(V);
+    if(l->compiled.valid){
+        lighting_shadeCompiled(&l->compiled, N, V, p, Cb, Cs, s, oneSided, c);
+        return;
+    }
     dotNV = vector_dot(N, V);
 
     for(int i = 0; i < l->nLights; i++){
@@ -144,6 +315,15 @@ void lighting_shading(Lighting *l, Vector *N, Vector *V, Point *p, Color *Cb, Co
                 if( (dotNL < 0 && dotNV > 0) || (dotNL > 0 && dotNV < 0) ){
                     continue;
                 }
+                if(l->shadow[i] != NULL){
+                    float lit = shadow_sample(l->shadow[i], p);
+                    if(lit <= 0){
+                        continue;
+                    }
+                    light.color.c[0] *= lit;
+                    light.color.c[1] *= lit;
+                    light.color.c[2] *= lit;
+                }
                 vector_add(&H, &L, V);
                 vector_scale(&H, 0.5);
                 vector_normalize(&H);
@@ -170,6 +350,15 @@ void lighting_shading(Lighting *l, Vector *N, Vector *V, Point *p, Color *Cb, Co
             }
             case LightPoint:{
                 vector_subtract(&L, &(light.position), p);
+                if(light.radius > 0){
+                    float fade = lighting_attenuation(vector_length(&L), light.radius);
+                    if(fade <= 0){
+                        continue;
+                    }
+                    light.color.c[0] *= fade;
+                    light.color.c[1] *= fade;
+                    light.color.c[2] *= fade;
+                }
                 vector_normalize(&L);
 
                 dotNL = vector_dot(N, &L);
@@ -190,9 +379,6 @@ void lighting_shading(Lighting *l, Vector *N, Vector *V, Point *p, Color *Cb, Co
                 }
                 dotNH = pow(dotNH, s);
 
-		color_print( Cb );
-		color_print( Cs );
-
                 // body reflection
                 body.c[0] = dotNL * light.color.c[0] * Cb->c[0];
                 body.c[1] = dotNL * light.color.c[1] * Cb->c[1];
@@ -202,21 +388,22 @@ void lighting_shading(Lighting *l, Vector *N, Vector *V, Point *p, Color *Cb, Co
                 surface.c[1] = dotNH * light.color.c[1] * Cs->c[1];
                 surface.c[2] = dotNH * light.color.c[2] * Cs->c[2];
                 //integrated
-
-		color_print( &body );
-		color_print( &surface );
-		
                 result.c[0] += body.c[0] + surface.c[0];
                 result.c[1] += body.c[1] + surface.c[1];
                 result.c[2] += body.c[2] + surface.c[2];
-
-		printf("result: ");
-		color_print( &result );
-		
                 break;
             }
             case LightSpot:{
                 vector_subtract(&L, &(light.position), p);
+                if(light.radius > 0){
+                    float fade = lighting_attenuation(vector_length(&L), light.radius);
+                    if(fade <= 0){
+                        continue;
+                    }
+                    light.color.c[0] *= fade;
+                    light.color.c[1] *= fade;
+                    light.color.c[2] *= fade;
+                }
                 vector_normalize(&L);
 
                 dotNL = vector_dot(N, &L);
@@ -233,6 +420,15 @@ void lighting_shading(Lighting *l, Vector *N, Vector *V, Point *p, Color *Cb, Co
                 if(dotDL < cos(light.cutoff)) {
                     continue;
                 }
+                if(l->shadow[i] != NULL){
+                    float lit = shadow_sample(l->shadow[i], p);
+                    if(lit <= 0){
+                        continue;
+                    }
+                    light.color.c[0] *= lit;
+                    light.color.c[1] *= lit;
+                    light.color.c[2] *= lit;
+                }
                 vector_add(&H, &L, V);
                 vector_scale(&H, 0.5);
                 vector_normalize(&H);
@@ -274,5 +470,142 @@ void lighting_copy(Lighting *to, Lighting *from){
     to->nLights = from->nLights;
     for(int i = 0; i < from->nLights; i++){
         light_copy(&to->light[i], &from->light[i]);
+        to->shadow[i] = from->shadow[i];
     }
+    to->compiled.valid = 0;
+}
+
+// sort the bounded point and spot lights of a compiled list into a grid of cells over the box their
+// spheres of influence fill, so shading a point only visits the lights whose sphere reaches its cell
+static void lighting_cluster(LightList *list){
+    double lo[3], hi[3];
+    int first = list->nDirect;
+    int last = list->nDirect + list->nPoint + list->nSpot;
+
+    list->unbounded = 0;
+    list->clustered = 0;
+    for(int i = first; i < last; i++){
+        if(list->radius[i] <= 0){
+            list->unbounded |= (uint64_t)1 << i;
+            continue;
+        }
+        double c[3] = {list->px[i], list->py[i], list->pz[i]};
+        for(int k = 0; k < 3; k++){
+            if(!list->clustered || c[k] - list->radius[i] < lo[k]){
+                lo[k] = c[k] - list->radius[i];
+            }
+            if(!list->clustered || c[k] + list->radius[i] > hi[k]){
+                hi[k] = c[k] + list->radius[i];
+            }
+        }
+        list->clustered = 1;
+    }
+    if(!list->clustered){
+        return;
+    }
+
+    double size[3];
+    for(int k = 0; k < 3; k++){
+        list->gridMin[k] = lo[k];
+        size[k] = (hi[k] - lo[k]) / LIGHT_GRID;
+        list->cellScale[k] = 1.0 / size[k];
+    }
+    memset(list->cell, 0, sizeof(list->cell));
+
+    for(int i = first; i < last; i++){
+        float radius = list->radius[i];
+        if(radius <= 0){
+            continue;
+        }
+        double c[3] = {list->px[i], list->py[i], list->pz[i]};
+        int cmin[3], cmax[3];
+        for(int k = 0; k < 3; k++){
+            cmin[k] = (int)floor((c[k] - radius - lo[k]) / size[k]);
+            cmax[k] = (int)floor((c[k] + radius - lo[k]) / size[k]);
+            cmin[k] = cmin[k] < 0 ? 0 : cmin[k];
+            cmax[k] = cmax[k] >= LIGHT_GRID ? LIGHT_GRID - 1 : cmax[k];
+        }
+
+        // only the cells the sphere actually touches, not its whole bounding box
+        for(int z = cmin[2]; z <= cmax[2]; z++){
+            for(int y = cmin[1]; y <= cmax[1]; y++){
+                for(int x = cmin[0]; x <= cmax[0]; x++){
+                    int cell[3] = {x, y, z};
+                    double d2 = 0.0;
+                    for(int k = 0; k < 3; k++){
+                        double a = lo[k] + cell[k] * size[k];
+                        double b = a + size[k];
+                        double e = c[k] < a ? a - c[k] : c[k] > b ? c[k] - b : 0.0;
+                        d2 += e * e;
+                    }
+                    if(d2 <= (double)radius * radius){
+                        list->cell[(z * LIGHT_GRID + y) * LIGHT_GRID + x] |= (uint64_t)1 << i;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// build the compiled light list from the current lights
+// lighting_shading uses it until the lights are changed through lighting_add, lighting_clear or lighting_copy;
+// code that edits the light array directly must clear compiled.valid itself
+void lighting_compile(Lighting *l){
+    if(l == NULL){
+        fprintf(stderr, "Invalid lighting.\n");
+        return;
+    }
+
+    LightList *list = &l->compiled;
+    list->ambient = (Color){{0.0, 0.0, 0.0}};
+    list->nDirect = 0;
+    list->nPoint = 0;
+    list->nSpot = 0;
+
+    // one pass per type keeps the lights of a type in the order they were added
+    int n = 0;
+    for(LightType type = LightAmbient; type <= LightSpot; type++){
+        for(int i = 0; i < l->nLights; i++){
+            Light *light = &l->light[i];
+            if(light->type != type){
+                continue;
+            }
+            if(type == LightAmbient){
+                list->ambient.c[0] += light->color.c[0];
+                list->ambient.c[1] += light->color.c[1];
+                list->ambient.c[2] += light->color.c[2];
+                continue;
+            }
+
+            // spot directions are normalized too, since gathering them through a scaling GTM stretches them
+            Vector dir;
+            vector_copy(&dir, &light->direction);
+            if(type != LightPoint){
+                vector_normalize(&dir);
+            }
+            if(type == LightDirect){
+                list->nDirect++;
+            }else if(type == LightPoint){
+                list->nPoint++;
+            }else{
+                list->nSpot++;
+            }
+            list->px[n] = light->position.val[0];
+            list->py[n] = light->position.val[1];
+            list->pz[n] = light->position.val[2];
+            list->dx[n] = dir.val[0];
+            list->dy[n] = dir.val[1];
+            list->dz[n] = dir.val[2];
+            list->r[n] = light->color.c[0];
+            list->g[n] = light->color.c[1];
+            list->b[n] = light->color.c[2];
+            list->cosCutoff[n] = cos(light->cutoff);
+            list->radius[n] = type == LightDirect ? 0.0 : light->radius;
+            list->shadow[n] = type == LightPoint ? NULL : l->shadow[i];
+            n++;
+        }
+    }
+
+    lighting_cluster(list);
+    list->valid = 1;
 }
@@ -1,7 +1,11 @@
 #include <stdlib.h>
+#include <math.h>
 #include "image.h"
 #include "line.h"
 
+// how far inside the last row and column clipped lines end, so their end points truncate onto the image
+#define LINE_EDGE 0.001f
+
 // initialize a 2D line
 void line_set2D(Line *l, double x0, double y0, double x1, double y1){
     if(l == NULL){
@@ -68,22 +72,119 @@ void line_copy(Line *to, Line *from){
     to -> zBuffer = from -> zBuffer; 
 }
 
+// clip the segment from (x0, y0) to (x1, y1) to the rectangle [0, w] x [0, h] (Liang-Barsky)
+// the parameters are found in double, since a float one is off by a pixel or more on lines thousands of pixels long
+// return 0 if none of it is inside, otherwise set t0 <= t1 to the parameters of the part that is
+static int line_clipRect(double x0, double y0, double x1, double y1, double w, double h, double *t0, double *t1){
+    double p[4] = {x0 - x1, x1 - x0, y0 - y1, y1 - y0};
+    double q[4] = {x0, w - x0, y0, h - y0};
+    double a = 0.0, b = 1.0;
+
+    if(!(isfinite(x0) && isfinite(y0) && isfinite(x1) && isfinite(y1))){
+        return 0;
+    }
+    for(int i = 0; i < 4; i++){
+        if(p[i] == 0){
+            if(q[i] < 0){
+                return 0;
+            }
+            continue;
+        }
+        double t = q[i] / p[i];
+        if(p[i] < 0){
+            a = t > a ? t : a;
+        }else{
+            b = t < b ? t : b;
+        }
+    }
+    if(a > b){
+        return 0;
+    }
+
+    *t0 = a;
+    *t1 = b;
+    return 1;
+}
+
+// truncate a clipped coordinate to a pixel index in [0, max]
+static inline int line_clampInt(double v, int max){
+    int i = (int)v;
+    return i < 0 ? 0 : (i > max ? max : i);
+}
+
+// clip the line's screen coordinates to the pixels of src, which lie in [0, cols) x [0, rows)
+// return 0 if the line misses the image, otherwise set the integer end points of the part that is on it
+// and the parameters t0 <= t1 of that part along the original line
+// the end points are clamped to the image as well, so every pixel between them is on it whatever the rounding
+static int line_clipImage(Line *l, Image *src, int *x0, int *y0, int *x1, int *y1, double *t0, double *t1){
+    double ax = l->a.val[0], ay = l->a.val[1];
+    double bx = l->b.val[0], by = l->b.val[1];
+    double w = src->cols - LINE_EDGE, h = src->rows - LINE_EDGE;
+
+    if(!line_clipRect(ax, ay, bx, by, w, h, t0, t1)){
+        return 0;
+    }
+    // a line entirely on the image keeps its exact end points
+    if(*t0 > 0){
+        ax += *t0 * (l->b.val[0] - l->a.val[0]);
+        ay += *t0 * (l->b.val[1] - l->a.val[1]);
+    }
+    if(*t1 < 1){
+        bx = l->a.val[0] + *t1 * (l->b.val[0] - l->a.val[0]);
+        by = l->a.val[1] + *t1 * (l->b.val[1] - l->a.val[1]);
+    }
+    *x0 = line_clampInt(ax, src->cols - 1);
+    *y0 = line_clampInt(ay, src->rows - 1);
+    *x1 = line_clampInt(bx, src->cols - 1);
+    *y1 = line_clampInt(by, src->rows - 1);
+    return 1;
+}
+
+// clip a line in homogeneous view coordinates, before the perspective divide, to the part with h >= near
+// every coordinate, z included, is interpolated in homogeneous space, so the clipped line divides correctly
+// return 0 if the whole line is behind the near plane
+int line_clipNear(Line *l, double near){
+    if(l == NULL){
+        fprintf(stderr, "Invalid line.\n");
+        return 0;
+    }
+
+    double ha = l->a.val[3], hb = l->b.val[3];
+    if(ha >= near && hb >= near){
+        return 1;
+    }
+    if(ha < near && hb < near){
+        return 0;
+    }
+
+    double t = (near - ha) / (hb - ha);
+    Point *p = ha < near ? &l->a : &l->b;
+    for(int i = 0; i < 4; i++){
+        p->val[i] = l->a.val[i] + t * (l->b.val[i] - l->a.val[i]);
+    }
+    p->val[3] = near;
+    return 1;
+}
+
 // draw the line into src using color c and the z-buffer
+// the line is clipped to the image first, with its end points clamped to it, so only pixels on it are visited
 void line_draw(Line *l, Image *src, Color c){
-    if(l == NULL || src == NULL){
-        fprintf(stderr, "Unable to draw. Invalid line or image.");
+    if(l == NULL || src == NULL || src->data == NULL){
+        fprintf(stderr, "Unable to draw. Invalid line or image.\n");
+        return;
     }
 
-    int x0 = (int)l -> a.val[0];
-    int y0 = (int)l -> a.val[1];
-    int x1 = (int)l -> b.val[0];
-    int y1 = (int)l -> b.val[1];
-
-    double z0 = l->a.val[2];
-    double z1 = l->b.val[2];
+    int x0, y0, x1, y1;
+    double t0, t1;
+    if(!line_clipImage(l, src, &x0, &y0, &x1, &y1, &t0, &t1)){
+        return;
+    }
 
-    double inv_z0 = 1.0 / z0;
-    double inv_z1 = 1.0 / z1;
+    // 1/z is linear along the line on the screen, so the clipped ends take it at their parameters
+    double inv_za = 1.0 / l->a.val[2];
+    double inv_zb = 1.0 / l->b.val[2];
+    double inv_z0 = t0 > 0 ? inv_za + t0 * (inv_zb - inv_za) : inv_za;
+    double inv_z1 = t1 < 1 ? inv_za + t1 * (inv_zb - inv_za) : inv_zb;
 
     int dx = abs(x1 - x0);
     int dy = abs(y1 - y0);
@@ -101,18 +202,22 @@ void line_draw(Line *l, Image *src, Color c){
 
     // Initial 1/z value
     double inv_z = inv_z0;
+    FPixel val = {c, 1.0, 1.0};
 
-    while (x0 != x1 || y0 != y1) {
+    // line_clipImage clamps both end points to the image and the steps never leave the box they span,
+    // so every pixel visited is on the image and the unchecked accessors are safe
+    while (1) {
         // Set the pixel at (x0, y0) considering the z-buffer
         if (l->zBuffer) {
-            if (inv_z > image_getz(src, y0, x0)) {
-                FPixel val = {c, 1.0, 1.0};
-                image_setf(src, y0, x0, val);
-                image_setz(src, y0, x0, inv_z);
+            if (inv_z > image_pixel(src, y0, x0)->z) {
+                val.z = inv_z;
+                image_put(src, y0, x0, val);
             }
         } else {
-            FPixel val = {c, 1.0, 1.0};
-            image_setf(src, y0, x0, val);
+            image_put(src, y0, x0, val);
+        }
+        if (x0 == x1 && y0 == y1) {
+            break;
         }
 
         // Update the current 1/z value
@@ -128,30 +233,28 @@ void line_draw(Line *l, Image *src, Color c){
             y0 += sy;
         }
     }
-
-    // Final pixel
-    if (l->zBuffer) {
-        if (inv_z > image_getz(src, y1, x1)) {
-            FPixel val = {c, 1.0, 1.0};
-            image_setf(src, y1, x1, val);
-            image_setz(src, y1, x1, inv_z);
-        }
-    } else {
-        FPixel val = {c, 1.0, 1.0};
-        image_setf(src, y1, x1, val);
-    }
 }
 
 // draw dash line with a given length
+// the line is clipped and clamped to the image first; the dashes keep the phase they would have had on the whole line
 void line_drawDash(Line *l, Image *src, Color c, int length){
-    if(l == NULL || src == NULL){
-        fprintf(stderr, "Unable to draw. Invalid line or image.");
+    if(l == NULL || src == NULL || src->data == NULL || length <= 0){
+        fprintf(stderr, "Unable to draw. Invalid line or image.\n");
+        return;
     }
 
-    int x0 = (int)l -> a.val[0];
-    int y0 = (int)l -> a.val[1];
-    int x1 = (int)l -> b.val[0];
-    int y1 = (int)l -> b.val[1];
+    int x0, y0, x1, y1;
+    double t0, t1;
+    if(!line_clipImage(l, src, &x0, &y0, &x1, &y1, &t0, &t1)){
+        return;
+    }
+
+    // steps the unclipped line would have taken before reaching the first pixel on the image
+    int skipped = 0;
+    if(t0 > 0){
+        double steps = fmax(fabs(x0 - l->a.val[0]), fabs(y0 - l->a.val[1]));
+        skipped = (int)fmod(floor(steps), 2 * length);
+    }
 
     int dx = abs(x1 - x0);
     int dy = abs(y1 - y0);
@@ -159,13 +262,14 @@ void line_drawDash(Line *l, Image *src, Color c, int length){
     int sy = (y0 < y1) ? 1 : -1;
 
     int err = dx - dy;
-    int count = 0;
-    int draw = 1; // draw or not draw flag
+    int count = skipped % length;
+    int draw = skipped < length; // draw or not draw flag
+    FPixel val = {c, 1.0, 1.0};
 
+    // the end points are clamped to the image, as in line_draw, so image_put needs no bounds check
     while (x0 != x1 || y0 != y1) {
         if(draw){
-            FPixel val = {c, 1.0, 1.0};
-            image_setf(src, y0, x0, val);
+            image_put(src, y0, x0, val);
         }
         count++;
         if(count >= length){
@@ -184,4 +288,102 @@ void line_drawDash(Line *l, Image *src, Color c, int length){
             y0 += sy;
         }
     }
+}
+
+// blend color into pixel (r, c), or into each of its samples, with weight w where 1/z is nearer than what is there
+// only a pixel the line covers at least half of takes the line's depth
+static inline void line_blend(Image *src, int r, int c, Color *color, float w, float z, int zBuffer){
+    FPixel *px = &src->data[r][c];
+    int n = 1;
+    if(src->samples > 1){
+        px = &src->sample[((size_t)r * src->cols + c) * src->samples];
+        n = src->samples;
+    }
+
+    for(int i = 0; i < n; i++){
+        if(zBuffer && !(z > px[i].z)){
+            continue;
+        }
+        px[i].c.c[0] += w * (color->c[0] - px[i].c.c[0]);
+        px[i].c.c[1] += w * (color->c[1] - px[i].c.c[1]);
+        px[i].c.c[2] += w * (color->c[2] - px[i].c.c[2]);
+        px[i].a += w * (1.0f - px[i].a);
+        if(zBuffer && w >= 0.5f){
+            px[i].z = z;
+        }
+    }
+}
+
+// draw the line into src anti-aliased (Wu's algorithm): each step along the major axis blends the color
+// into the two pixels straddling the line, in proportion to how close it passes to their centers
+// the line is clipped to the image once, so no pixel access is bounds-checked
+void line_drawAA(Line *l, Image *src, Color c){
+    if(l == NULL || src == NULL || src->data == NULL){
+        fprintf(stderr, "Unable to draw. Invalid line or image.\n");
+        return;
+    }
+
+    // pixel (r, c) covers [c, c + 1) x [r, r + 1), as in line_draw, so move its center to (c, r)
+    // the end points stay in double until they are clipped: a perspective line cut at the near plane
+    // can reach millions of pixels past the image, where a float is off by more than a pixel
+    double x0 = l->a.val[0] - 0.5, y0 = l->a.val[1] - 0.5;
+    double x1 = l->b.val[0] - 0.5, y1 = l->b.val[1] - 0.5;
+    double q0 = 1.0 / l->a.val[2], q1 = 1.0 / l->b.val[2];
+    double tmp;
+
+    // step along x: swap the axes of steep lines and the ends of lines going left
+    int steep = fabs(y1 - y0) > fabs(x1 - x0);
+    if(steep){
+        tmp = x0; x0 = y0; y0 = tmp;
+        tmp = x1; x1 = y1; y1 = tmp;
+    }
+    if(x0 > x1){
+        tmp = x0; x0 = x1; x1 = tmp;
+        tmp = y0; y0 = y1; y1 = tmp;
+        tmp = q0; q0 = q1; q1 = tmp;
+    }
+    int width = steep ? src->rows : src->cols;
+    int height = steep ? src->cols : src->rows;
+
+    double t0, t1;
+    if(!line_clipRect(x0, y0, x1, y1, width - 1, height - 1, &t0, &t1)){
+        return;
+    }
+    double dx = x1 - x0;
+    double slope = dx > 0 ? (y1 - y0) / dx : 0.0;
+    double dq = dx > 0 ? (q1 - q0) / dx : 0.0;
+    double xa = x0 + t0 * dx, xb = x0 + t1 * dx;
+
+    // the end pixels are weighted by how much of them the line spans along x, unless that end was clipped
+    double lo = t0 > 0 ? -1.0 : xa;
+    double hi = t1 < 1 ? width : xb;
+    // clamped like line_clipImage's end points, so no rounding of the clip can step off the image
+    int ca = line_clampInt(xa + 0.5, width - 1), cb = line_clampInt(xb + 0.5, width - 1);
+
+    for(int x = ca; x <= cb; x++){
+        float w = 1.0f;
+        if((x == ca || x == cb) && dx > 0){
+            w = fmin(x + 0.5, hi) - fmax(x - 0.5, lo);
+            if(w <= 0){
+                continue;
+            }
+            w = w < 1.0f ? w : 1.0f;
+        }
+
+        double y = fmin(fmax(y0 + slope * (x - x0), 0.0), height - 1);
+        float z = q0 + dq * (x - x0);
+        int r = (int)y;
+        float f = y - r;
+        if(steep){
+            line_blend(src, x, r, &c, w * (1.0f - f), z, l->zBuffer);
+            if(f > 0){
+                line_blend(src, x, r + 1, &c, w * f, z, l->zBuffer);
+            }
+        }else{
+            line_blend(src, r, x, &c, w * (1.0f - f), z, l->zBuffer);
+            if(f > 0){
+                line_blend(src, r + 1, x, &c, w * f, z, l->zBuffer);
+            }
+        }
+    }
 }
\ No newline at end of file
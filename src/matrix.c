@@ -1,6 +1,38 @@
 #include <math.h>
 #include "matrix.h"
 
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// fused multiply-add where the target has it: a * b + c
+#if defined(__FMA__)
+#define MADD256(a, b, c) _mm256_fmadd_pd((a), (b), (c))
+#define MADDPS128(a, b, c) _mm_fmadd_ps((a), (b), (c))
+#else
+#define MADD256(a, b, c) _mm256_add_pd(_mm256_mul_pd((a), (b)), (c))
+#define MADDPS128(a, b, c) _mm_add_ps(_mm_mul_ps((a), (b)), (c))
+#endif
+
+#if defined(__AVX__)
+// the four columns of m, each holding one coordinate's weight in every row
+static inline void matrix_columns256(Matrix *m, __m256d c[4]){
+    for (int j = 0; j < 4; j++) {
+        c[j] = _mm256_set_pd(m->m[3][j], m->m[2][j], m->m[1][j], m->m[0][j]);
+    }
+}
+
+// q = m * p from the columns of m, summed from +0.0 one coordinate at a time
+// matrix_xformPoint and matrix_xformPoints both go through here, so a vertex rounds the same in either
+static inline void matrix_xform256(const __m256d c[4], const Point *p, Point *q){
+    __m256d acc = MADD256(c[0], _mm256_broadcast_sd(&p->val[0]), _mm256_setzero_pd());
+    acc = MADD256(c[1], _mm256_broadcast_sd(&p->val[1]), acc);
+    acc = MADD256(c[2], _mm256_broadcast_sd(&p->val[2]), acc);
+    acc = MADD256(c[3], _mm256_broadcast_sd(&p->val[3]), acc);
+    _mm256_storeu_pd(q->val, acc);
+}
+#endif
+
 // 2D matrix
 // print out the matrix in a nice 4x4 arrangement with a blank line below
 void matrix_print(Matrix *m, FILE *fp){
@@ -97,66 +129,146 @@ void matrix_transpose(Matrix *m){
 
 // multiply left and right and put the result in m
 // make sure the function is written so that the result matrix can also be the left or right matrix
+// each result row is a combination of the rows of right weighted by a row of left
 void matrix_multiply(Matrix *left, Matrix *right, Matrix *m){
     if (left == NULL || right == NULL || m == NULL) {
         fprintf(stderr, "Invalid matrices.\n");
         return;
     }
 
+#if defined(__AVX__)
+    __m256d r0 = _mm256_loadu_pd(right->m[0]);
+    __m256d r1 = _mm256_loadu_pd(right->m[1]);
+    __m256d r2 = _mm256_loadu_pd(right->m[2]);
+    __m256d r3 = _mm256_loadu_pd(right->m[3]);
+    __m256d row[4];
+
+    for (int i = 0; i < 4; i++) {
+        __m256d acc = MADD256(_mm256_broadcast_sd(&left->m[i][0]), r0, _mm256_setzero_pd());
+        acc = MADD256(_mm256_broadcast_sd(&left->m[i][1]), r1, acc);
+        acc = MADD256(_mm256_broadcast_sd(&left->m[i][2]), r2, acc);
+        row[i] = MADD256(_mm256_broadcast_sd(&left->m[i][3]), r3, acc);
+    }
+    for (int i = 0; i < 4; i++) {
+        _mm256_storeu_pd(m->m[i], row[i]);
+    }
+#elif defined(__SSE2__)
+    Matrix result;
+
+    for (int i = 0; i < 4; i++) {
+        __m128d lo = _mm_setzero_pd();
+        __m128d hi = _mm_setzero_pd();
+        for (int k = 0; k < 4; k++) {
+            __m128d l = _mm_set1_pd(left->m[i][k]);
+            lo = _mm_add_pd(lo, _mm_mul_pd(l, _mm_loadu_pd(&right->m[k][0])));
+            hi = _mm_add_pd(hi, _mm_mul_pd(l, _mm_loadu_pd(&right->m[k][2])));
+        }
+        _mm_storeu_pd(&result.m[i][0], lo);
+        _mm_storeu_pd(&result.m[i][2], hi);
+    }
+    *m = result;
+#else
     Matrix result; 
 
     for (int i = 0; i < 4; i++) {
         for (int j = 0; j < 4; j++) {
-            result.m[i][j] = 0.0;
-            for (int k = 0; k < 4; k++) {
-                result.m[i][j] += left->m[i][k] * right->m[k][j];
-            }
+            result.m[i][j] = 0.0 + left->m[i][0] * right->m[0][j] + left->m[i][1] * right->m[1][j]
+                           + left->m[i][2] * right->m[2][j] + left->m[i][3] * right->m[3][j];
         }
     }
-
-    // Copy the result to the output matrix m
-    matrix_copy(m, &result);
+    *m = result;
+#endif
 }
 
 // transform the point p by the matrix m and put the result in q
-// p and q need to be different variables
+// p and q may be the same variable
+// sums start from +0.0 so a -0.0 z never reaches the z-buffer as -inf
 void matrix_xformPoint(Matrix *m, Point *p, Point *q){
     if (m == NULL || p == NULL || q == NULL) {
         fprintf(stderr, "Invalid matrix or points.\n");
         return;
     }
 
-    Point temp; 
+#if defined(__AVX__)
+    __m256d c[4];
+    matrix_columns256(m, c);
+    matrix_xform256(c, p, q);
+#elif defined(__SSE2__)
+    // accumulate the columns in the same order as the scalar loop
+    __m128d x = _mm_set1_pd(p->val[0]);
+    __m128d y = _mm_set1_pd(p->val[1]);
+    __m128d z = _mm_set1_pd(p->val[2]);
+    __m128d h = _mm_set1_pd(p->val[3]);
+    __m128d lo = _mm_add_pd(_mm_setzero_pd(), _mm_mul_pd(_mm_set_pd(m->m[1][0], m->m[0][0]), x));
+    __m128d hi = _mm_add_pd(_mm_setzero_pd(), _mm_mul_pd(_mm_set_pd(m->m[3][0], m->m[2][0]), x));
+    lo = _mm_add_pd(lo, _mm_mul_pd(_mm_set_pd(m->m[1][1], m->m[0][1]), y));
+    hi = _mm_add_pd(hi, _mm_mul_pd(_mm_set_pd(m->m[3][1], m->m[2][1]), y));
+    lo = _mm_add_pd(lo, _mm_mul_pd(_mm_set_pd(m->m[1][2], m->m[0][2]), z));
+    hi = _mm_add_pd(hi, _mm_mul_pd(_mm_set_pd(m->m[3][2], m->m[2][2]), z));
+    lo = _mm_add_pd(lo, _mm_mul_pd(_mm_set_pd(m->m[1][3], m->m[0][3]), h));
+    hi = _mm_add_pd(hi, _mm_mul_pd(_mm_set_pd(m->m[3][3], m->m[2][3]), h));
+    _mm_storeu_pd(&q->val[0], lo);
+    _mm_storeu_pd(&q->val[2], hi);
+#else
+    double x = p->val[0], y = p->val[1], z = p->val[2], h = p->val[3];
 
     for (int i = 0; i < 4; i++) {
-        temp.val[i] = 0.0;
+        q->val[i] = 0.0 + m->m[i][0] * x + m->m[i][1] * y + m->m[i][2] * z + m->m[i][3] * h;
+    }
+#endif
+}
+
+// transform the n points in p by the matrix m and put the results in q
+// p and q may be the same array
+// the matrix columns are loaded once, so each point costs four multiply-adds
+void matrix_xformPoints(Matrix *m, const Point *p, Point *q, int n){
+    if (m == NULL || (n > 0 && (p == NULL || q == NULL))) {
+        fprintf(stderr, "Invalid matrix or points.\n");
+        return;
+    }
+
+#if defined(__AVX__)
+    __m256d c[4];
+    matrix_columns256(m, c);
+    for (int i = 0; i < n; i++) {
+        matrix_xform256(c, &p[i], &q[i]);
+    }
+#elif defined(__SSE2__)
+    __m128d c0lo = _mm_set_pd(m->m[1][0], m->m[0][0]), c0hi = _mm_set_pd(m->m[3][0], m->m[2][0]);
+    __m128d c1lo = _mm_set_pd(m->m[1][1], m->m[0][1]), c1hi = _mm_set_pd(m->m[3][1], m->m[2][1]);
+    __m128d c2lo = _mm_set_pd(m->m[1][2], m->m[0][2]), c2hi = _mm_set_pd(m->m[3][2], m->m[2][2]);
+    __m128d c3lo = _mm_set_pd(m->m[1][3], m->m[0][3]), c3hi = _mm_set_pd(m->m[3][3], m->m[2][3]);
+    __m128d zero = _mm_setzero_pd();
+
+    for (int i = 0; i < n; i++) {
+        __m128d x = _mm_set1_pd(p[i].val[0]);
+        __m128d y = _mm_set1_pd(p[i].val[1]);
+        __m128d z = _mm_set1_pd(p[i].val[2]);
+        __m128d h = _mm_set1_pd(p[i].val[3]);
+        __m128d lo = _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_add_pd(zero, _mm_mul_pd(c0lo, x)), _mm_mul_pd(c1lo, y)), _mm_mul_pd(c2lo, z)), _mm_mul_pd(c3lo, h));
+        __m128d hi = _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_add_pd(zero, _mm_mul_pd(c0hi, x)), _mm_mul_pd(c1hi, y)), _mm_mul_pd(c2hi, z)), _mm_mul_pd(c3hi, h));
+        _mm_storeu_pd(&q[i].val[0], lo);
+        _mm_storeu_pd(&q[i].val[2], hi);
+    }
+#else
+    for (int i = 0; i < n; i++) {
+        double x = p[i].val[0], y = p[i].val[1], z = p[i].val[2], h = p[i].val[3];
         for (int j = 0; j < 4; j++) {
-            temp.val[i] += m->m[i][j] * p->val[j];
+            q[i].val[j] = 0.0 + m->m[j][0] * x + m->m[j][1] * y + m->m[j][2] * z + m->m[j][3] * h;
         }
     }
-    // Copy the result to the output point q
-    point_copy(q, &temp);
+#endif
 }
 
 // transform the vector p by the matrix m and put the result in q.
-// for this function, p and q need to be different variables
+// p and q may be the same variable
 void matrix_xformVector(Matrix *m, Vector *p, Vector *q){
     if (m == NULL || p == NULL || q == NULL) {
         fprintf(stderr, "Invalid matrix or points.\n");
         return;
     }
 
-    Vector temp; // Temporary vector to store the result
-
-    for (int i = 0; i < 4; i++) {
-        temp.val[i] = 0.0;
-        for (int j = 0; j < 4; j++) {
-            temp.val[i] += m->m[i][j] * p->val[j];
-        }
-    }
-
-    // Copy the result to the output vector q
-    vector_copy(q, &temp);
+    matrix_xformPoint(m, p, q);
 }
 
 // transform the points and surface normals(if they exist)in the polygon p by the matrix m
@@ -166,18 +278,9 @@ void matrix_xformPolygon(Matrix *m, Polygon *p){
         return;
     }
 
-    for (int i = 0; i < p->nVertex; i++) {
-        // Transform the vertex
-        Point transformedVertex;
-        matrix_xformPoint(m, &p->vertex[i], &transformedVertex);
-        vector_copy(&p->vertex[i], &transformedVertex);
-
-        // Transform the normal if it exists
-        if (p->normal != NULL) {
-            Vector transformedNormal;
-            matrix_xformVector(m, &p->normal[i], &transformedNormal);
-            vector_copy(&p->normal[i], &transformedNormal);
-        }
+    matrix_xformPoints(m, p->vertex, p->vertex, p->nVertex);
+    if (p->normal != NULL) {
+        matrix_xformPoints(m, p->normal, p->normal, p->nVertex);
     }
 }
 
@@ -188,11 +291,7 @@ void matrix_xformPolyline(Matrix *m, Polyline *p){
         return;
     }
 
-    for(int i = 0; i < p->numVertex; i++){
-        Point transformedVertex;
-        matrix_xformPoint(m, &p->vertex[i], &transformedVertex);
-        vector_copy(&p->vertex[i], &transformedVertex);
-    }
+    matrix_xformPoints(m, p->vertex, p->vertex, p->numVertex);
 }
 
 // transform the points in line by the matrix m
@@ -202,14 +301,62 @@ void matrix_xformLine(Matrix *m, Line *line){
         return;
     }
 
-    Point a;
-    Point b;
+    matrix_xformPoint(m, &line->a, &line->a);
+    matrix_xformPoint(m, &line->b, &line->b);
+}
 
-    matrix_xformPoint(m, &line->a, &a);
-    matrix_xformPoint(m, &line->b, &b);
+// return 1 if the bottom row of m is 0 0 0 1, so transforming by m never changes h
+int matrix_isAffine(Matrix *m){
+    if (m == NULL) {
+        fprintf(stderr, "Invalid matrix.\n");
+        return 0;
+    }
+
+    return m->m[3][0] == 0.0 && m->m[3][1] == 0.0 && m->m[3][2] == 0.0 && m->m[3][3] == 1.0;
+}
+
+// transform the n points in p in place by the affine matrix m and normalize them for the screen
+// only the top three rows are evaluated and h passes through, so x and y are divided
+// only for the rare point whose h is not already 1; z is left as the depth, as in polygon_normalize
+void matrix_xformScreenAffine(Matrix *m, Point *p, int n){
+    if (m == NULL || (n > 0 && p == NULL)) {
+        fprintf(stderr, "Invalid matrix or points.\n");
+        return;
+    }
 
-    vector_copy(&line->a, &a);
-    vector_copy(&line->b, &b);
+#if defined(__SSE2__)
+    __m128d c0 = _mm_set_pd(m->m[1][0], m->m[0][0]);
+    __m128d c1 = _mm_set_pd(m->m[1][1], m->m[0][1]);
+    __m128d c2 = _mm_set_pd(m->m[1][2], m->m[0][2]);
+    __m128d c3 = _mm_set_pd(m->m[1][3], m->m[0][3]);
+    __m128d zero = _mm_setzero_pd();
+
+    for (int i = 0; i < n; i++) {
+        double x = p[i].val[0], y = p[i].val[1], z = p[i].val[2], h = p[i].val[3];
+        __m128d xy = _mm_add_pd(zero, _mm_mul_pd(c0, _mm_set1_pd(x)));
+        xy = _mm_add_pd(xy, _mm_mul_pd(c1, _mm_set1_pd(y)));
+        xy = _mm_add_pd(xy, _mm_mul_pd(c2, _mm_set1_pd(z)));
+        xy = _mm_add_pd(xy, _mm_mul_pd(c3, _mm_set1_pd(h)));
+        p[i].val[2] = 0.0 + m->m[2][0] * x + m->m[2][1] * y + m->m[2][2] * z + m->m[2][3] * h;
+        if (h != 1.0 && h != 0.0) {
+            xy = _mm_div_pd(xy, _mm_set1_pd(h));
+            p[i].val[3] = 1.0;
+        }
+        _mm_storeu_pd(&p[i].val[0], xy);
+    }
+#else
+    for (int i = 0; i < n; i++) {
+        double x = p[i].val[0], y = p[i].val[1], z = p[i].val[2], h = p[i].val[3];
+        for (int j = 0; j < 3; j++) {
+            p[i].val[j] = 0.0 + m->m[j][0] * x + m->m[j][1] * y + m->m[j][2] * z + m->m[j][3] * h;
+        }
+        if (h != 1.0 && h != 0.0) {
+            p[i].val[0] /= h;
+            p[i].val[1] /= h;
+            p[i].val[3] = 1.0;
+        }
+    }
+#endif
 }
 
 // premultiply the matrix by a scale matrix parameterized by sx and sy
@@ -538,4 +685,102 @@ int matrix_is_zero(Matrix *m){
         }
     }
     return 1;
-}
\ No newline at end of file
+}
+
+// single precision screen stage
+// narrow the double precision matrix m into the single precision matrix f
+void fmatrix_set(FMatrix *f, Matrix *m){
+    if (f == NULL || m == NULL) {
+        fprintf(stderr, "Invalid matrices.\n");
+        return;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            f->m[i][j] = (float)m->m[i][j];
+        }
+    }
+}
+
+// transform the n points in p in place in single precision and divide x and y by h
+// the way polygon_normalize does, leaving z as the depth for the z-buffer
+// points that come out with h == 1, as they do under an affine matrix, skip the divide
+// the rasterizer narrows to float anyway, so only the storage stays double
+void fmatrix_xformScreen(FMatrix *m, Point *p, int n){
+    if (m == NULL || (n > 0 && p == NULL)) {
+        fprintf(stderr, "Invalid matrix or points.\n");
+        return;
+    }
+
+#if defined(__SSE2__)
+    __m128 c0 = _mm_set_ps(m->m[3][0], m->m[2][0], m->m[1][0], m->m[0][0]);
+    __m128 c1 = _mm_set_ps(m->m[3][1], m->m[2][1], m->m[1][1], m->m[0][1]);
+    __m128 c2 = _mm_set_ps(m->m[3][2], m->m[2][2], m->m[1][2], m->m[0][2]);
+    __m128 c3 = _mm_set_ps(m->m[3][3], m->m[2][3], m->m[1][3], m->m[0][3]);
+    __m128 xyMask = _mm_castsi128_ps(_mm_set_epi32(0, 0, -1, -1));
+    __m128 zMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, 0, 0));
+    __m128 hOne = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+
+    for (int i = 0; i < n; i++) {
+#if defined(__AVX__)
+        __m128 v = _mm256_cvtpd_ps(_mm256_loadu_pd(p[i].val));
+#else
+        __m128 v = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(&p[i].val[0])), _mm_cvtpd_ps(_mm_loadu_pd(&p[i].val[2])));
+#endif
+        __m128 acc = _mm_mul_ps(c0, _mm_shuffle_ps(v, v, 0x00));
+        acc = MADDPS128(c1, _mm_shuffle_ps(v, v, 0x55), acc);
+        acc = MADDPS128(c2, _mm_shuffle_ps(v, v, 0xAA), acc);
+        acc = MADDPS128(c3, _mm_shuffle_ps(v, v, 0xFF), acc);
+
+        __m128 h = _mm_shuffle_ps(acc, acc, 0xFF);
+        float w = _mm_cvtss_f32(h);
+        if (w != 0.0f && w != 1.0f) {
+            __m128 d = _mm_div_ps(acc, h);
+            acc = _mm_or_ps(_mm_or_ps(_mm_and_ps(xyMask, d), _mm_and_ps(zMask, acc)), hOne);
+        }
+#if defined(__AVX__)
+        _mm256_storeu_pd(p[i].val, _mm256_cvtps_pd(acc));
+#else
+        _mm_storeu_pd(&p[i].val[0], _mm_cvtps_pd(acc));
+        _mm_storeu_pd(&p[i].val[2], _mm_cvtps_pd(_mm_movehl_ps(acc, acc)));
+#endif
+    }
+#else
+    for (int i = 0; i < n; i++) {
+        float x = p[i].val[0], y = p[i].val[1], z = p[i].val[2], h = p[i].val[3];
+        float q[4];
+        for (int j = 0; j < 4; j++) {
+            q[j] = m->m[j][0] * x + m->m[j][1] * y + m->m[j][2] * z + m->m[j][3] * h;
+        }
+        if (q[3] != 0.0f && q[3] != 1.0f) {
+            q[0] /= q[3];
+            q[1] /= q[3];
+            q[3] = 1.0f;
+        }
+        for (int j = 0; j < 4; j++) {
+            p[i].val[j] = q[j];
+        }
+    }
+#endif
+}
+
+// transform the polygon vertices to the screen in single precision and normalize them
+// the normals are left alone since nothing past the view transform uses them
+void fmatrix_xformPolygon(FMatrix *m, Polygon *p){
+    if (m == NULL || p == NULL) {
+        fprintf(stderr, "Invalid matrix or polygon.\n");
+        return;
+    }
+
+    fmatrix_xformScreen(m, p->vertex, p->nVertex);
+}
+
+// transform the polyline vertices to the screen in single precision and normalize them
+void fmatrix_xformPolyline(FMatrix *m, Polyline *p){
+    if (m == NULL || p == NULL) {
+        fprintf(stderr, "Invalid matrix or polyline.\n");
+        return;
+    }
+
+    fmatrix_xformScreen(m, p->vertex, p->numVertex);
+}
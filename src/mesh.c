@@ -0,0 +1,431 @@
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "mesh.h"
+
+// return an allocated, empty mesh
+Mesh *mesh_create(void){
+    Mesh *m = (Mesh*)malloc(sizeof(Mesh));
+    if(m == NULL){
+        fprintf(stderr, "Failed to allocate memory for mesh.\n");
+        return NULL;
+    }
+
+    mesh_init(m);
+    return m;
+}
+
+// free the internal data of the mesh and the mesh pointer
+void mesh_free(Mesh *m){
+    if(m == NULL){
+        return;
+    }
+
+    mesh_clear(m);
+    free(m);
+}
+
+// initialize an existing mesh to an empty, two-sided mesh
+void mesh_init(Mesh *m){
+    if(m == NULL){
+        fprintf(stderr, "Unable to initialize. Invalid mesh.\n");
+        return;
+    }
+
+    m->oneSided = 0;
+    m->nVertex = 0;
+    m->vertex = NULL;
+    m->normal = NULL;
+    m->color = NULL;
+    m->nTriangle = 0;
+    m->index = NULL;
+    m->zBuffer = 1;
+}
+
+// free the internal data and reset the counts
+void mesh_clear(Mesh *m){
+    if(m == NULL){
+        fprintf(stderr, "Invalid mesh.\n");
+        return;
+    }
+
+    free(m->vertex);
+    free(m->normal);
+    free(m->color);
+    free(m->index);
+    m->vertex = NULL;
+    m->normal = NULL;
+    m->color = NULL;
+    m->index = NULL;
+    m->nVertex = 0;
+    m->nTriangle = 0;
+}
+
+// set the shared vertices to vlist and the triangles to the 3 * nTriangle indices in index
+// any normals or colors are dropped since they no longer match the vertices
+// returns 0 on success, -1 if an index is out of range or memory runs out
+int mesh_set(Mesh *m, int nVertex, Point *vlist, int nTriangle, int *index){
+    if(m == NULL || (nVertex > 0 && vlist == NULL) || (nTriangle > 0 && index == NULL)){
+        fprintf(stderr, "Invalid mesh, vertices or indices.\n");
+        return -1;
+    }
+
+    for(int i = 0; i < 3 * nTriangle; i++){
+        if(index[i] < 0 || index[i] >= nVertex){
+            fprintf(stderr, "Mesh index %d out of range.\n", index[i]);
+            return -1;
+        }
+    }
+
+    mesh_clear(m);
+    m->vertex = (Point*)malloc(nVertex * sizeof(Point));
+    m->index = (int*)malloc(3 * nTriangle * sizeof(int));
+    if((nVertex > 0 && m->vertex == NULL) || (nTriangle > 0 && m->index == NULL)){
+        fprintf(stderr, "Failed to allocate memory for mesh.\n");
+        mesh_clear(m);
+        return -1;
+    }
+
+    memcpy(m->vertex, vlist, nVertex * sizeof(Point));
+    memcpy(m->index, index, 3 * nTriangle * sizeof(int));
+    m->nVertex = nVertex;
+    m->nTriangle = nTriangle;
+    return 0;
+}
+
+// set the per-vertex normals to the vectors in nlist
+void mesh_setNormals(Mesh *m, int nVertex, Vector *nlist){
+    if(m == NULL || nlist == NULL || nVertex != m->nVertex){
+        fprintf(stderr, "Invalid mesh or normal list.\n");
+        return;
+    }
+
+    free(m->normal);
+    m->normal = (Vector*)malloc(nVertex * sizeof(Vector));
+    if(m->normal == NULL){
+        fprintf(stderr, "Failed to allocate memory for normal list.\n");
+        return;
+    }
+    memcpy(m->normal, nlist, nVertex * sizeof(Vector));
+}
+
+// set the per-vertex colors to the colors in clist
+void mesh_setColors(Mesh *m, int nVertex, Color *clist){
+    if(m == NULL || clist == NULL || nVertex != m->nVertex){
+        fprintf(stderr, "Invalid mesh or color list.\n");
+        return;
+    }
+
+    free(m->color);
+    m->color = (Color*)malloc(nVertex * sizeof(Color));
+    if(m->color == NULL){
+        fprintf(stderr, "Failed to allocate memory for color list.\n");
+        return;
+    }
+    memcpy(m->color, clist, nVertex * sizeof(Color));
+}
+
+// set oneSided to the value
+void mesh_setSided(Mesh *m, int oneSided){
+    if(m == NULL){
+        fprintf(stderr, "Invalid mesh.\n");
+        return;
+    }
+
+    m->oneSided = oneSided;
+}
+
+// set the z-buffer flag to the value
+void mesh_zBuffer(Mesh *m, int flag){
+    if(m == NULL){
+        fprintf(stderr, "Invalid mesh.\n");
+        return;
+    }
+
+    m->zBuffer = flag;
+}
+
+// deep copy from into to, which must have been initialized
+void mesh_copy(Mesh *to, Mesh *from){
+    if(to == NULL || from == NULL){
+        fprintf(stderr, "Invalid meshes.\n");
+        return;
+    }
+
+    if(to == from){
+        return;
+    }
+
+    if(mesh_set(to, from->nVertex, from->vertex, from->nTriangle, from->index) != 0){
+        return;
+    }
+    if(from->normal != NULL){
+        mesh_setNormals(to, from->nVertex, from->normal);
+    }
+    if(from->color != NULL){
+        mesh_setColors(to, from->nVertex, from->color);
+    }
+    to->oneSided = from->oneSided;
+    to->zBuffer = from->zBuffer;
+}
+
+// print the mesh data to the stream fp
+void mesh_print(Mesh *m, FILE *fp){
+    if(m == NULL || fp == NULL){
+        fprintf(stderr, "Invalid mesh or file stream.\n");
+        return;
+    }
+
+    fprintf(fp, "Mesh: %d vertices, %d triangles, %s\n", m->nVertex, m->nTriangle, m->oneSided ? "one-sided" : "two-sided");
+    for(int i = 0; i < m->nVertex; i++){
+        fprintf(fp, "%d\t%f\t%f\t%f\n", i, m->vertex[i].val[0], m->vertex[i].val[1], m->vertex[i].val[2]);
+    }
+    for(int i = 0; i < m->nTriangle; i++){
+        fprintf(fp, "%d\t%d %d %d\n", i, m->index[3 * i], m->index[3 * i + 1], m->index[3 * i + 2]);
+    }
+}
+
+// Forsyth vertex cache optimization
+// score for a vertex at cachePos in an LRU cache of cacheSize entries (-1 if not cached)
+// with remaining triangles still to be emitted; recently used, low valence vertices score highest
+static float forsyth_vertexScore(int cachePos, int remaining, int cacheSize){
+    if(remaining == 0){
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if(cachePos >= 0){
+        if(cachePos < 3){
+            // the last triangle's vertices get a fixed score so the order does not run in strips
+            score = 0.75f;
+        }else{
+            score = powf(1.0f - (float)(cachePos - 3) / (cacheSize - 3), 1.5f);
+        }
+    }
+    return score + 2.0f * powf((float)remaining, -0.5f);
+}
+
+// reorder the triangles so consecutive triangles reuse recently transformed vertices,
+// using Tom Forsyth's linear-speed vertex cache optimization for an LRU cache of cacheSize entries,
+// then renumber the vertices in first-use order so the vertex arrays are read nearly sequentially
+// the set of triangles and their winding are unchanged; returns 0 on success, -1 if memory runs out
+int mesh_optimize(Mesh *m, int cacheSize){
+    if(m == NULL){
+        fprintf(stderr, "Invalid mesh.\n");
+        return -1;
+    }
+    if(m->nTriangle == 0){
+        return 0;
+    }
+    if(cacheSize < 4){
+        cacheSize = 4;
+    }
+    if(cacheSize > MESH_CACHE_MAX){
+        cacheSize = MESH_CACHE_MAX;
+    }
+
+    int nVertex = m->nVertex;
+    int nTriangle = m->nTriangle;
+    int *remaining = (int*)calloc(nVertex, sizeof(int));
+    int *offset = (int*)malloc((nVertex + 1) * sizeof(int));
+    int *cachePos = (int*)malloc(nVertex * sizeof(int));
+    int *triList = (int*)malloc(3 * nTriangle * sizeof(int));
+    int *order = (int*)malloc(3 * nTriangle * sizeof(int));
+    float *vScore = (float*)malloc(nVertex * sizeof(float));
+    float *tScore = (float*)malloc(nTriangle * sizeof(float));
+    char *emitted = (char*)calloc(nTriangle, 1);
+    if(remaining == NULL || offset == NULL || cachePos == NULL || triList == NULL || order == NULL ||
+       vScore == NULL || tScore == NULL || emitted == NULL){
+        fprintf(stderr, "Failed to allocate memory for mesh optimization.\n");
+        free(remaining); free(offset); free(cachePos); free(triList);
+        free(order); free(vScore); free(tScore); free(emitted);
+        return -1;
+    }
+
+    // triangles using each vertex, as lists packed into triList
+    for(int i = 0; i < 3 * nTriangle; i++){
+        remaining[m->index[i]]++;
+    }
+    offset[0] = 0;
+    for(int v = 0; v < nVertex; v++){
+        offset[v + 1] = offset[v] + remaining[v];
+        cachePos[v] = offset[v];
+    }
+    for(int i = 0; i < 3 * nTriangle; i++){
+        triList[cachePos[m->index[i]]++] = i / 3;
+    }
+
+    for(int v = 0; v < nVertex; v++){
+        cachePos[v] = -1;
+        vScore[v] = forsyth_vertexScore(-1, remaining[v], cacheSize);
+    }
+    int best = 0;
+    for(int t = 0; t < nTriangle; t++){
+        int *tri = &m->index[3 * t];
+        tScore[t] = vScore[tri[0]] + vScore[tri[1]] + vScore[tri[2]];
+        if(tScore[t] > tScore[best]){
+            best = t;
+        }
+    }
+
+    int cache[MESH_CACHE_MAX + 3];
+    int cacheCount = 0;
+    int scan = 0;
+    for(int out = 0; out < nTriangle; out++){
+        if(best < 0){
+            // nothing in the cache touches a remaining triangle, so take the best one left
+            while(emitted[scan]){
+                scan++;
+            }
+            best = scan;
+            for(int t = scan + 1; t < nTriangle; t++){
+                if(!emitted[t] && tScore[t] > tScore[best]){
+                    best = t;
+                }
+            }
+        }
+
+        int *tri = &m->index[3 * best];
+        memcpy(&order[3 * out], tri, 3 * sizeof(int));
+        emitted[best] = 1;
+
+        // take the triangle off its vertices' lists
+        for(int k = 0; k < 3; k++){
+            int v = tri[k];
+            int *list = &triList[offset[v]];
+            for(int j = 0; j < remaining[v]; j++){
+                if(list[j] == best){
+                    list[j] = list[remaining[v] - 1];
+                    remaining[v]--;
+                    break;
+                }
+            }
+        }
+
+        // move the triangle's vertices to the front of the LRU cache
+        int next[MESH_CACHE_MAX + 3];
+        int n = 0;
+        for(int k = 0; k < 3; k++){
+            if(k == 0 || (tri[k] != tri[0] && (k == 1 || tri[k] != tri[1]))){
+                next[n++] = tri[k];
+            }
+        }
+        for(int i = 0; i < cacheCount; i++){
+            int v = cache[i];
+            if(v != tri[0] && v != tri[1] && v != tri[2]){
+                next[n++] = v;
+            }
+        }
+        for(int i = 0; i < n; i++){
+            int v = next[i];
+            cachePos[v] = i < cacheSize ? i : -1;
+            vScore[v] = forsyth_vertexScore(cachePos[v], remaining[v], cacheSize);
+        }
+        cacheCount = n < cacheSize ? n : cacheSize;
+        memcpy(cache, next, cacheCount * sizeof(int));
+
+        // rescore the triangles touched by the cache and pick the next one among them
+        best = -1;
+        float bestScore = -1.0f;
+        for(int i = 0; i < n; i++){
+            int v = next[i];
+            for(int j = 0; j < remaining[v]; j++){
+                int t = triList[offset[v] + j];
+                int *u = &m->index[3 * t];
+                tScore[t] = vScore[u[0]] + vScore[u[1]] + vScore[u[2]];
+                if(tScore[t] > bestScore){
+                    bestScore = tScore[t];
+                    best = t;
+                }
+            }
+        }
+    }
+
+    // renumber the vertices in the order the new triangle list first uses them
+    int *newIndex = cachePos;
+    int count = 0;
+    for(int v = 0; v < nVertex; v++){
+        newIndex[v] = -1;
+    }
+    for(int i = 0; i < 3 * nTriangle; i++){
+        if(newIndex[order[i]] < 0){
+            newIndex[order[i]] = count++;
+        }
+    }
+    for(int v = 0; v < nVertex; v++){
+        if(newIndex[v] < 0){
+            newIndex[v] = count++;
+        }
+    }
+    for(int i = 0; i < 3 * nTriangle; i++){
+        m->index[i] = newIndex[order[i]];
+    }
+
+    Point *vertex = (Point*)malloc(nVertex * sizeof(Point));
+    Vector *normal = m->normal != NULL ? (Vector*)malloc(nVertex * sizeof(Vector)) : NULL;
+    Color *color = m->color != NULL ? (Color*)malloc(nVertex * sizeof(Color)) : NULL;
+    if(vertex == NULL || (m->normal != NULL && normal == NULL) || (m->color != NULL && color == NULL)){
+        // keep the original numbering; undo the index renumbering
+        for(int v = 0; v < nVertex; v++){
+            remaining[newIndex[v]] = v;
+        }
+        for(int i = 0; i < 3 * nTriangle; i++){
+            m->index[i] = remaining[m->index[i]];
+        }
+        free(vertex);
+        free(normal);
+        free(color);
+    }else{
+        for(int v = 0; v < nVertex; v++){
+            vertex[newIndex[v]] = m->vertex[v];
+            if(normal != NULL){
+                normal[newIndex[v]] = m->normal[v];
+            }
+            if(color != NULL){
+                color[newIndex[v]] = m->color[v];
+            }
+        }
+        free(m->vertex);
+        free(m->normal);
+        free(m->color);
+        m->vertex = vertex;
+        m->normal = normal;
+        m->color = color;
+    }
+
+    free(remaining); free(offset); free(cachePos); free(triList);
+    free(order); free(vScore); free(tScore); free(emitted);
+    return 0;
+}
+
+// average cache miss ratio: the number of vertices a FIFO post-transform cache of cacheSize
+// entries would have to transform, per triangle, when drawing the mesh in index order
+// 0.5 is the ideal for large regular meshes, 3 means no reuse at all
+double mesh_acmr(Mesh *m, int cacheSize){
+    if(m == NULL || m->nTriangle == 0 || cacheSize < 1 || cacheSize > MESH_CACHE_MAX){
+        fprintf(stderr, "Invalid mesh or cache size.\n");
+        return 0.0;
+    }
+
+    int cache[MESH_CACHE_MAX];
+    int head = 0, count = 0, misses = 0;
+    for(int i = 0; i < 3 * m->nTriangle; i++){
+        int v = m->index[i];
+        int hit = 0;
+        for(int j = 0; j < count; j++){
+            if(cache[j] == v){
+                hit = 1;
+                break;
+            }
+        }
+        if(!hit){
+            misses++;
+            cache[head] = v;
+            head = (head + 1) % cacheSize;
+            if(count < cacheSize){
+                count++;
+            }
+        }
+    }
+    return (double)misses / m->nTriangle;
+}
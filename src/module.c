@@ -1,6 +1,8 @@
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "module.h"
+#include "shadow.h"
 
 // 2D module functions
 // allocate and return an initialized but empty element
@@ -57,6 +59,46 @@ Element *element_init(ObjectType type, void *obj){
             e->obj = polygon_create();
             polygon_copy(e->obj, obj);
             break;
+        case ObjMesh:
+            e->obj = mesh_create();
+            mesh_copy(e->obj, obj);
+            break;
+        case ObjInstances:{
+            Instances *from = obj;
+            Instances *to = (Instances*)malloc(sizeof(Instances));
+            if(to == NULL){
+                fprintf(stderr, "Unable to allocate memory for obj.\n");
+                return NULL;
+            }
+            to->module = from->module;
+            to->nInstance = from->nInstance;
+            to->transform = (Matrix*)malloc(from->nInstance * sizeof(Matrix));
+            to->color = NULL;
+            if(from->color != NULL){
+                to->color = (Color*)malloc(from->nInstance * sizeof(Color));
+            }
+            if(to->transform == NULL || (from->color != NULL && to->color == NULL)){
+                fprintf(stderr, "Unable to allocate memory for obj.\n");
+                free(to->transform);
+                free(to->color);
+                free(to);
+                return NULL;
+            }
+            memcpy(to->transform, from->transform, from->nInstance * sizeof(Matrix));
+            if(from->color != NULL){
+                memcpy(to->color, from->color, from->nInstance * sizeof(Color));
+            }
+            e->obj = to;
+            break;
+        }
+        case ObjBezierPatch:
+            e->obj = (BezierPatch*)malloc(sizeof(BezierPatch));
+            if(e->obj == NULL){
+                fprintf(stderr, "Unable to allocate memory for obj.\n");
+                return NULL;
+            }
+            memcpy(e->obj, obj, sizeof(BezierPatch));
+            break;
         case ObjIdentity:
             e->obj = NULL;
             break;
@@ -94,7 +136,11 @@ Element *element_init(ObjectType type, void *obj){
             break;
         case ObjSurfaceCoeff:
             e->obj = (float*)malloc(sizeof(float));
-            e->obj = (float*)obj;
+            if(e->obj == NULL){
+                fprintf(stderr, "Unable to allocate memory for obj.\n");
+                return NULL;
+            }
+            *(float*)e->obj = *(float*)obj;
             break;
         case ObjLight:
             e->obj = (Light*)malloc(sizeof(Light));
@@ -125,6 +171,14 @@ void element_delete(Element *e){
         case ObjPolygon:
             polygon_free(e->obj);
             break;
+        case ObjMesh:
+            mesh_free(e->obj);
+            break;
+        case ObjInstances:
+            free(((Instances*)e->obj)->transform);
+            free(((Instances*)e->obj)->color);
+            free(e->obj);
+            break;
         case ObjLine:
         case ObjPoint:
         case ObjMatrix:
@@ -132,10 +186,11 @@ void element_delete(Element *e){
         case ObjBodyColor:
         case ObjSurfaceColor:
         case ObjSurfaceCoeff:
-        case ObjModule:
         case ObjLight:
+        case ObjBezierPatch:
             free(e->obj);
             break;
+        case ObjModule: // referenced, not owned
         case ObjNone:
         case ObjIdentity:
             break;
@@ -166,8 +221,9 @@ void module_clear(Module *md){
 
     Element *current = md->head;
     while(current != NULL){
+        Element *next = current->next;
         element_delete(current);
-        current = current->next;
+        current = next;
     }
 
     md->head = NULL;
@@ -183,8 +239,9 @@ void module_delete(Module *md){
     
     Element *current = md->head;
     while(current != NULL){
+        Element *next = current->next;
         element_delete(current);
-        current = current->next;
+        current = next;
     }
 
     free(md);
@@ -262,6 +319,34 @@ void module_polygon(Module *md, Polygon *p){
     module_insert(md, e);
 }
 
+// add a copy of the indexed triangle mesh m to the tail of the module's list
+void module_mesh(Module *md, Mesh *m){
+    if(md == NULL || m == NULL){
+        fprintf(stderr, "Invalid module or mesh.\n");
+        return;
+    }
+
+    Element *e = element_init(ObjMesh, m);
+    module_insert(md, e);
+}
+
+// add one element that draws sub nInstance times, copy i under transform[i] and, if color is not NULL,
+// with color[i] as its foreground and body color; the arrays are copied, sub is referenced like module_module
+void module_instances(Module *md, Module *sub, int nInstance, Matrix *transform, Color *color){
+    if(md == NULL || sub == NULL || transform == NULL || nInstance <= 0){
+        fprintf(stderr, "Invalid module, submodule or instance transforms.\n");
+        return;
+    }
+
+    Instances in;
+    in.module = sub;
+    in.nInstance = nInstance;
+    in.transform = transform;
+    in.color = color;
+    Element *e = element_init(ObjInstances, &in);
+    module_insert(md, e);
+}
+
 // object that sets the current transform to the identity, placed at the tail of the module's list
 void module_identity(Module *md){
     if(md == NULL){
@@ -329,17 +414,390 @@ void module_shear2D(Module *md, double shx, double shy){
     module_insert(md, e);
 }
 
-// draw the module into the image using the given view transformation matrix VTM
-// Lighting and DrawState by traversing the list of Elements
-// Lighting can be an empty structure
-void module_draw(Module *md, Matrix *VTM, Matrix *GTM, DrawState *ds, Lighting *lighting, Image *src){
-    if(md == NULL){
-        fprintf(stderr, "Invalid module.\n");
+// copy the polygon from into to, using scratch memory from the render context for the arrays
+// a color array is only created if from has one or needColor is set, so fills still use the drawstate color
+// returns -1 if the scratch memory could not be allocated
+static int scratch_polygon(RenderContext *rc, Polygon *to, Polygon *from, int needColor){
+    polygon_init(to);
+    to->oneSided = from->oneSided;
+    to->zBuffer = from->zBuffer;
+    to->nVertex = from->nVertex;
+
+    to->vertex = render_alloc(rc, from->nVertex * sizeof(Point));
+    if(from->normal != NULL){
+        to->normal = render_alloc(rc, from->nVertex * sizeof(Vector));
+    }
+    if(from->color != NULL || needColor){
+        to->color = render_alloc(rc, from->nVertex * sizeof(Color));
+    }
+    if(to->vertex == NULL || (from->normal != NULL && to->normal == NULL) ||
+       ((from->color != NULL || needColor) && to->color == NULL)){
+        fprintf(stderr, "Unable to copy polygon for drawing.\n");
+        return -1;
+    }
+
+    memcpy(to->vertex, from->vertex, from->nVertex * sizeof(Point));
+    if(from->normal != NULL){
+        memcpy(to->normal, from->normal, from->nVertex * sizeof(Vector));
+    }
+    if(from->color != NULL){
+        memcpy(to->color, from->color, from->nVertex * sizeof(Color));
+    }
+    // texture coordinates do not change with the vertices, so the copy shares them
+    to->texture = from->texture;
+    return 0;
+}
+
+// copy the polyline from into to, using scratch memory from the render context for the vertices
+// returns -1 if the scratch memory could not be allocated
+static int scratch_polyline(RenderContext *rc, Polyline *to, Polyline *from){
+    polyline_init(to);
+    to->zBuffer = from->zBuffer;
+    to->numVertex = from->numVertex;
+    to->vertex = render_alloc(rc, from->numVertex * sizeof(Point));
+    if(to->vertex == NULL){
+        fprintf(stderr, "Unable to copy polyline for drawing.\n");
+        return -1;
+    }
+    memcpy(to->vertex, from->vertex, from->numVertex * sizeof(Point));
+    return 0;
+}
+
+// the matrix taking model coordinates straight to the screen, rebuilt after LTM changes
+typedef struct{
+    int valid;
+    int affine; // VTM * GTM * LTM leaves h alone, so the perspective divide can be skipped
+    Matrix m; // VTM * GTM * LTM
+    FMatrix f; // the same matrix in single precision
+}ScreenMatrix;
+
+// compose VTM * GTM * LTM into s unless it is already up to date
+static ScreenMatrix *screen_matrix(ScreenMatrix *s, Matrix *VTM, Matrix *GTM, Matrix *LTM){
+    if(!s->valid){
+        matrix_multiply(GTM, LTM, &s->m);
+        matrix_multiply(VTM, &s->m, &s->m);
+        fmatrix_set(&s->f, &s->m);
+        s->affine = matrix_isAffine(&s->m);
+        s->valid = 1;
+    }
+    return s;
+}
+
+// lines are clipped where their homogeneous coordinate falls below this, just in front of the center of projection
+#define MODULE_NEAR 0.001
+
+// draw a screen-space line, anti-aliased if the draw state asks for it
+static void line_drawMode(Line *l, Image *src, DrawState *ds){
+    if(ds->lineAntialiasFlag){
+        line_drawAA(l, src, ds->color);
+    }else{
+        line_draw(l, src, ds->color);
+    }
+}
+
+// draw a line in homogeneous view coordinates: clip it to the near plane, then divide and draw it
+static void line_drawNear(Line *l, Image *src, DrawState *ds){
+    if(line_clipNear(l, MODULE_NEAR)){
+        line_normalize(l);
+        line_drawMode(l, src, ds);
+    }
+}
+
+// draw a screen-space polygon the way the draw state's shade method asks for
+static void polygon_drawMode(Polygon *plg, Image *src, DrawState *ds, Lighting *lighting){
+    if(ds->depthOnlyFlag){
+        polygon_drawShade(plg, src, ds, lighting);
+        return;
+    }
+    switch(ds->shade){
+        case ShadeFrame:
+            if(ds->lineAntialiasFlag){
+                polygon_drawAA(plg, src, ds->color);
+            }else{
+                polygon_draw(plg, src, ds->color);
+            }
+            break;
+        case ShadeConstant:
+            polygon_drawFill(plg, src, ds->color);
+            break;
+        case ShadeFlat:
+        case ShadeDepth:
+        case ShadeGouraud:
+        case ShadePhong:
+            polygon_drawShade(plg, src, ds, lighting);
+            break;
+        default:
+            break;
+    }
+}
+
+// draw an indexed mesh: every shared vertex is transformed, and lit for Gouraud shading,
+// exactly once, then the triangles are rasterized out of that post-transform vertex cache
+// the cache lives in the render context's scratch memory until the caller resets it
+static void module_drawMesh(Mesh *mesh, Matrix *LTM, Matrix *GTM, ScreenMatrix *sm, DrawState *ds, RenderContext *rc){
+    Matrix *VTM = &rc->VTM;
+    int nVertex = mesh->nVertex;
+    Point *vertex = render_alloc(rc, nVertex * sizeof(Point));
+    Color *color = mesh->color;
+    Polygon cache;
+
+    if(vertex == NULL){
+        fprintf(stderr, "Unable to allocate the mesh vertex cache.\n");
+        return;
+    }
+    memcpy(vertex, mesh->vertex, nVertex * sizeof(Point));
+    polygon_init(&cache);
+    cache.vertex = vertex;
+    cache.nVertex = nVertex;
+
+    if(ds->shade == ShadeGouraud && !ds->depthOnlyFlag){
+        if(mesh->normal == NULL){
+            fprintf(stderr, "Unable to shade a mesh without normals.\n");
+            return;
+        }
+        Vector *normal = render_alloc(rc, nVertex * sizeof(Vector));
+        Color *shaded = render_alloc(rc, nVertex * sizeof(Color));
+        if(normal == NULL || shaded == NULL){
+            fprintf(stderr, "Unable to allocate the mesh vertex cache.\n");
+            return;
+        }
+        memcpy(normal, mesh->normal, nVertex * sizeof(Vector));
+        matrix_xformPoints(LTM, vertex, vertex, nVertex);
+        matrix_xformPoints(GTM, vertex, vertex, nVertex);
+        matrix_xformPoints(LTM, normal, normal, nVertex);
+        matrix_xformPoints(GTM, normal, normal, nVertex);
+
+        color = shaded;
+        for(int i = 0; i < nVertex; i++){
+            Vector v;
+            vector_set(&v, ds->viewer.val[0] - vertex[i].val[0], ds->viewer.val[1] - vertex[i].val[1],
+                       ds->viewer.val[2] - vertex[i].val[2]);
+            lighting_shading(&rc->lighting, &normal[i], &v, &vertex[i], &ds->bodyColor, &ds->surfaceColor,
+                             ds->surfaceCoeff, mesh->oneSided, &color[i]);
+        }
+
+        if(ds->floatVertexFlag){
+            fmatrix_xformScreen(&rc->fVTM, vertex, nVertex);
+        }else if(rc->vtmAffine){
+            matrix_xformScreenAffine(VTM, vertex, nVertex);
+        }else{
+            matrix_xformPoints(VTM, vertex, vertex, nVertex);
+            polygon_normalize(&cache);
+        }
+    }else if(ds->floatVertexFlag){
+        fmatrix_xformScreen(&sm->f, vertex, nVertex);
+    }else if(sm->affine){
+        matrix_xformScreenAffine(&sm->m, vertex, nVertex);
+    }else{
+        matrix_xformPoints(LTM, vertex, vertex, nVertex);
+        matrix_xformPoints(GTM, vertex, vertex, nVertex);
+        matrix_xformPoints(VTM, vertex, vertex, nVertex);
+        polygon_normalize(&cache);
+    }
+
+    rc->stats.meshTriangles += mesh->nTriangle;
+    rc->stats.vertexRefs += 3 * mesh->nTriangle;
+    rc->stats.vertexXforms += nVertex;
+
+    // replay the references through a FIFO cache for the hit rate: vertex v is in it while fewer than
+    // RENDER_VERTEX_CACHE vertices have been loaded since v was, which is one test per reference
+    int *loaded = render_alloc(rc, nVertex * sizeof(int));
+    if(loaded != NULL){
+        int nLoaded = 0;
+        memset(loaded, 0, nVertex * sizeof(int));
+        for(int i = 0; i < 3 * mesh->nTriangle; i++){
+            int v = mesh->index[i];
+            if(loaded[v] == 0 || nLoaded - loaded[v] >= RENDER_VERTEX_CACHE){
+                loaded[v] = ++nLoaded;
+            }
+        }
+        rc->stats.vertexMisses += nLoaded;
+    }else{
+        rc->stats.vertexMisses += 3 * mesh->nTriangle;
+    }
+
+    // assemble each triangle from the cache
+    Point tv[3];
+    Color tc[3];
+    Polygon tri;
+    polygon_init(&tri);
+    tri.oneSided = mesh->oneSided;
+    tri.zBuffer = mesh->zBuffer;
+    tri.nVertex = 3;
+    tri.vertex = tv;
+    tri.color = color != NULL ? tc : NULL;
+
+    for(int t = 0; t < mesh->nTriangle; t++){
+        int *index = &mesh->index[3 * t];
+        for(int k = 0; k < 3; k++){
+            tv[k] = vertex[index[k]];
+            if(color != NULL){
+                tc[k] = color[index[k]];
+            }
+        }
+        polygon_drawMode(&tri, rc->src, ds, &rc->lighting);
+    }
+}
+
+struct CopySet;
+static void module_drawCopies(Module *md, struct CopySet *copies, DrawState *ds, RenderContext *rc);
+
+// draw state fields a module can change
+enum{
+    ScopeColor = 1,
+    ScopeBodyColor = 2,
+    ScopeSurfaceColor = 4,
+    ScopeSurfaceCoeff = 8
+};
+
+// the values a module replaced in the shared draw state, so they can be put back when it ends
+// a module only pays for the fields it actually changes
+typedef struct{
+    int saved; // Scope bits of the fields saved below
+    Color color;
+    Color bodyColor;
+    Color surfaceColor;
+    float surfaceCoeff;
+}DrawStateScope;
+
+// remember the current value of a color field the first time the module changes it
+static void scope_saveColor(DrawStateScope *scope, int field, Color *saved, Color *current){
+    if(!(scope->saved & field)){
+        *saved = *current;
+        scope->saved |= field;
+    }
+}
+
+// put back every field the module changed
+static void scope_restore(DrawStateScope *scope, DrawState *ds){
+    if(scope->saved & ScopeColor){
+        ds->color = scope->color;
+    }
+    if(scope->saved & ScopeBodyColor){
+        ds->bodyColor = scope->bodyColor;
+    }
+    if(scope->saved & ScopeSurfaceColor){
+        ds->surfaceColor = scope->surfaceColor;
+    }
+    if(scope->saved & ScopeSurfaceCoeff){
+        ds->surfaceCoeff = scope->surfaceCoeff;
+    }
+}
+
+// the copies of a module a traversal draws: just one for an ordinary module, or one per instance
+// under module_drawInstances, so each element is visited once and drawn for every copy in turn
+typedef struct CopySet{
+    int n; // number of copies
+    Matrix *GTM; // per copy
+    ScreenMatrix *screen; // per copy VTM * GTM * LTM, recomposed when LTM changes
+    Color *color; // per copy foreground and body color, or NULL
+    int fields; // ScopeColor and ScopeBodyColor bits of the draw state still taken from color
+}CopySet;
+
+// point the set at matrices for n copies: the ones given for a single copy, otherwise a heap block
+// return 0 if the block could not be allocated
+static int copy_alloc(CopySet *set, int n, Matrix *oneGTM, ScreenMatrix *oneScreen){
+    set->n = n;
+    if(n == 1){
+        set->GTM = oneGTM;
+        set->screen = oneScreen;
+        return 1;
+    }
+    set->GTM = malloc(n * (sizeof(Matrix) + sizeof(ScreenMatrix)));
+    if(set->GTM == NULL){
+        fprintf(stderr, "Unable to allocate instance matrices.\n");
+        return 0;
+    }
+    set->screen = (ScreenMatrix*)(set->GTM + n);
+    return 1;
+}
+
+// release the matrices of a set made by copy_alloc
+static void copy_free(CopySet *set){
+    if(set->n > 1){
+        free(set->GTM);
+    }
+}
+
+// the LTM changed, so every copy's screen matrix has to be composed again
+static void copy_invalidate(CopySet *set){
+    for(int i = 0; i < set->n; i++){
+        set->screen[i].valid = 0;
+    }
+}
+
+// give the draw state the color of copy i, where the module has not set its own
+static void copy_begin(CopySet *set, int i, DrawState *ds){
+    if(set->color != NULL){
+        if(set->fields & ScopeColor){
+            ds->color = set->color[i];
+        }
+        if(set->fields & ScopeBodyColor){
+            ds->bodyColor = set->color[i];
+        }
+    }
+}
+
+// draw every copy of an instanced submodule
+// the transforms of all the copies are composed, down to their screen matrices, in one pass,
+// then the submodule is traversed once and each of its primitives is drawn for all the copies
+// constant shading and frames paint without a depth test, and anti-aliased lines blend, so under those
+// the copies are traversed one after another instead, keeping the order separate submodules would draw in;
+// a depth-only pass keeps the nearest depth whatever the order, so it always takes all the copies at once
+static void module_drawInstances(Instances *in, Matrix *LTM, Matrix *GTM, DrawState *ds, RenderContext *rc){
+    Matrix oneGTM;
+    ScreenMatrix oneScreen;
+    CopySet set;
+    if(in->nInstance < 1 || !copy_alloc(&set, in->nInstance, &oneGTM, &oneScreen)){
         return;
     }
+    set.color = in->color;
+    set.fields = in->color != NULL ? ScopeColor | ScopeBodyColor : 0;
+
+    DrawStateScope scope;
+    scope.saved = 0;
+    if(in->color != NULL){
+        scope_saveColor(&scope, ScopeColor, &scope.color, &ds->color);
+        scope_saveColor(&scope, ScopeBodyColor, &scope.bodyColor, &ds->bodyColor);
+    }
+
+    for(int i = 0; i < set.n; i++){
+        matrix_multiply(&in->transform[i], LTM, &set.GTM[i]);
+        matrix_multiply(GTM, &set.GTM[i], &set.GTM[i]);
+        matrix_multiply(&rc->VTM, &set.GTM[i], &set.screen[i].m);
+        fmatrix_set(&set.screen[i].f, &set.screen[i].m);
+        set.screen[i].affine = matrix_isAffine(&set.screen[i].m);
+        set.screen[i].valid = 1;
+    }
+    if(!ds->depthOnlyFlag && (ds->shade == ShadeConstant || ds->shade == ShadeFrame || ds->lineAntialiasFlag)){
+        for(int i = 0; i < set.n; i++){
+            CopySet one = {1, &set.GTM[i], &set.screen[i], in->color != NULL ? &in->color[i] : NULL, set.fields};
+            module_drawCopies(in->module, &one, ds, rc);
+        }
+    }else{
+        module_drawCopies(in->module, &set, ds, rc);
+    }
 
+    copy_free(&set);
+    scope_restore(&scope, ds);
+}
+
+// traverse one module, drawing each primitive once for every copy in the set
+// ds is shared by the whole traversal; whatever the module changes in it is put back before returning
+// the screen matrices of the set belong to the traversal, which updates them as the LTM changes
+static void module_drawCopies(Module *md, CopySet *copies, DrawState *ds, RenderContext *rc){
+    Matrix *VTM = &rc->VTM;
+    Lighting *lighting = &rc->lighting;
+    Image *src = rc->src;
     Matrix LTM;
     matrix_identity(&LTM);
+    CopySet set = *copies;
+    // the view matrix alone, for polygons that are lit in world coordinates first
+    int vtmAffine = rc->vtmAffine;
+    FMatrix *fVTM = &rc->fVTM;
+    DrawStateScope scope;
+    scope.saved = 0;
+    scope.surfaceCoeff = ds->surfaceCoeff;
     
     Element *current = md->head;
     while(current != NULL){
@@ -348,108 +806,279 @@ void module_draw(Module *md, Matrix *VTM, Matrix *GTM, DrawState *ds, Lighting *
             case ObjNone:       
                 break;        
             case ObjColor:
+                scope_saveColor(&scope, ScopeColor, &scope.color, &ds->color);
                 color_copy(&(ds->color), current->obj);
+                set.fields &= ~ScopeColor;
                 break;
             case ObjBodyColor:
+                scope_saveColor(&scope, ScopeBodyColor, &scope.bodyColor, &ds->bodyColor);
                 color_copy(&(ds->bodyColor), current->obj);
+                set.fields &= ~ScopeBodyColor;
                 break;
             case ObjSurfaceColor:
+                scope_saveColor(&scope, ScopeSurfaceColor, &scope.surfaceColor, &ds->surfaceColor);
                 color_copy(&(ds->surfaceColor), current->obj);
                 break;
             case ObjSurfaceCoeff:
+                if(!(scope.saved & ScopeSurfaceCoeff)){
+                    scope.surfaceCoeff = ds->surfaceCoeff;
+                    scope.saved |= ScopeSurfaceCoeff;
+                }
                 ds->surfaceCoeff = *(float*)(current->obj);
                 break;
-            case ObjPoint: {
-                Point X, q;
-                point_copy(&X, current->obj);
-                matrix_xformPoint(&LTM, &X, &q);
-                matrix_xformPoint(GTM, &q, &X);
-                matrix_xformPoint(VTM, &X, &q);
-                point_normalize(&q);
-                point_draw(&q, src, ds->color);
-                break;
-            }                
-            case ObjLine: {
-                Line L;
-                line_copy(&L, current->obj);
-                matrix_xformLine(&LTM, &L);
-                matrix_xformLine(GTM, &L);
-                matrix_xformLine(VTM, &L);
-                line_normalize(&L);
-                printf("drawing line (%.2f %.2f) to (%.2f %.2f)\n", L.a.val[0], L.a.val[1], 
-                        L.b.val[0], L.b.val[1] );
-                line_draw(&L, src, ds->color);
+            case ObjPoint:
+                // points and lines cover no area, so a depth-only pass has nothing to draw for them
+                if(ds->depthOnlyFlag){
+                    break;
+                }
+                for(int i = 0; i < set.n; i++){
+                    Point X, q;
+                    Matrix *GTM = &set.GTM[i];
+                    ScreenMatrix *sm = screen_matrix(&set.screen[i], VTM, GTM, &LTM);
+                    copy_begin(&set, i, ds);
+                    if(sm->affine){
+                        point_copy(&q, current->obj);
+                        matrix_xformScreenAffine(&sm->m, &q, 1);
+                    }else{
+                        point_copy(&X, current->obj);
+                        matrix_xformPoint(&LTM, &X, &q);
+                        matrix_xformPoint(GTM, &q, &X);
+                        matrix_xformPoint(VTM, &X, &q);
+                        point_normalize(&q);
+                    }
+                    point_draw(&q, src, ds->color);
+                }
                 break;
-            }
-            case ObjPolyline: {
-                Polyline polyline;
-                polyline_init(&polyline);
-                polyline_copy(&polyline, current->obj);
-                matrix_xformPolyline(&LTM, &polyline);
-                matrix_xformPolyline(GTM, &polyline);
-                matrix_xformPolyline(VTM, &polyline);
-                polyline_normalize(&polyline);
-                polyline_draw(&polyline, src, ds->color);
+            case ObjLine:
+                if(ds->depthOnlyFlag){
+                    break;
+                }
+                for(int i = 0; i < set.n; i++){
+                    Line L;
+                    Matrix *GTM = &set.GTM[i];
+                    ScreenMatrix *sm = screen_matrix(&set.screen[i], VTM, GTM, &LTM);
+                    copy_begin(&set, i, ds);
+                    line_copy(&L, current->obj);
+                    if(sm->affine){
+                        matrix_xformScreenAffine(&sm->m, &L.a, 1);
+                        matrix_xformScreenAffine(&sm->m, &L.b, 1);
+                        line_drawMode(&L, src, ds);
+                    }else{
+                        matrix_xformLine(&LTM, &L);
+                        matrix_xformLine(GTM, &L);
+                        matrix_xformLine(VTM, &L);
+                        line_drawNear(&L, src, ds);
+                    }
+                }
                 break;
-            }
-            case ObjPolygon:{
-                Polygon plg;
-                polygon_init(&plg);
-                polygon_copy(&plg, current->obj);
-                matrix_xformPolygon(&LTM, &plg);
-                matrix_xformPolygon(GTM, &plg);
-                if(ds->shade == ShadeGouraud){
-                    polygon_shade(&plg, ds, lighting);
+            case ObjPolyline:
+                if(ds->depthOnlyFlag){
+                    break;
                 }
-                matrix_xformPolygon(VTM, &plg);
-                polygon_normalize(&plg);
-                switch(ds->shade){
-                    case ShadeFrame:
-                        polygon_draw(&plg, src, ds->color);
-                        break;
-                    case ShadeConstant:
-                        polygon_drawFill(&plg, src, ds->color);
-                        break;
-                    case ShadeFlat:
-                    case ShadeDepth:
-                    case ShadeGouraud:
-                    case ShadePhong:
-                        polygon_drawShade(&plg, src, ds, lighting);
+                for(int i = 0; i < set.n; i++){
+                    Polyline polyline;
+                    Matrix *GTM = &set.GTM[i];
+                    ScreenMatrix *sm = screen_matrix(&set.screen[i], VTM, GTM, &LTM);
+                    copy_begin(&set, i, ds);
+                    if(scratch_polyline(rc, &polyline, current->obj) != 0){
+                        render_reset(rc);
                         break;
-                    default:
+                    }
+                    if(sm->affine){
+                        if(ds->floatVertexFlag){
+                            fmatrix_xformPolyline(&sm->f, &polyline);
+                        }else{
+                            matrix_xformScreenAffine(&sm->m, polyline.vertex, polyline.numVertex);
+                        }
+                        if(ds->lineAntialiasFlag){
+                            polyline_drawAA(&polyline, src, ds->color);
+                        }else{
+                            polyline_draw(&polyline, src, ds->color);
+                        }
+                    }else{
+                        // a perspective view needs the homogeneous coordinates to clip each segment to the near plane
+                        matrix_xformPolyline(&LTM, &polyline);
+                        matrix_xformPolyline(GTM, &polyline);
+                        matrix_xformPolyline(VTM, &polyline);
+                        for(int k = 0; k < polyline.numVertex - 1; k++){
+                            Line L;
+                            L.a = polyline.vertex[k];
+                            L.b = polyline.vertex[k + 1];
+                            L.zBuffer = polyline.zBuffer;
+                            line_drawNear(&L, src, ds);
+                        }
+                    }
+                    render_reset(rc);
+                }
+                break;
+            case ObjPolygon:
+                for(int i = 0; i < set.n; i++){
+                    Polygon plg;
+                    Matrix *GTM = &set.GTM[i];
+                    copy_begin(&set, i, ds);
+                    int lit = ds->shade == ShadeGouraud && !ds->depthOnlyFlag;
+                    if(scratch_polygon(rc, &plg, current->obj, lit) != 0){
+                        render_reset(rc);
                         break;
+                    }
+                    if(!lit){
+                        // nothing needs world coordinates, so go to the screen in one pass when we can
+                        ScreenMatrix *sm = screen_matrix(&set.screen[i], VTM, GTM, &LTM);
+                        if(ds->floatVertexFlag){
+                            fmatrix_xformPolygon(&sm->f, &plg);
+                        }else if(sm->affine){
+                            matrix_xformScreenAffine(&sm->m, plg.vertex, plg.nVertex);
+                        }else{
+                            matrix_xformPolygon(&LTM, &plg);
+                            matrix_xformPolygon(GTM, &plg);
+                            matrix_xformPolygon(VTM, &plg);
+                            polygon_normalize(&plg);
+                        }
+                    }else{
+                        matrix_xformPolygon(&LTM, &plg);
+                        matrix_xformPolygon(GTM, &plg);
+                        polygon_shade(&plg, ds, lighting);
+                        if(ds->floatVertexFlag){
+                            fmatrix_xformPolygon(fVTM, &plg);
+                        }else if(vtmAffine){
+                            matrix_xformScreenAffine(VTM, plg.vertex, plg.nVertex);
+                        }else{
+                            matrix_xformPolygon(VTM, &plg);
+                            polygon_normalize(&plg);
+                        }
+                    }
+                    polygon_drawMode(&plg, src, ds, lighting);
+                    render_reset(rc);
+                }
+                break;
+            case ObjMesh:
+                for(int i = 0; i < set.n; i++){
+                    copy_begin(&set, i, ds);
+                    module_drawMesh(current->obj, &LTM, &set.GTM[i], screen_matrix(&set.screen[i], VTM, &set.GTM[i], &LTM), ds, rc);
+                    render_reset(rc);
+                }
+                break;
+            case ObjBezierPatch:
+                // tessellated for the view it is seen in, or taken from the context's cache when that has not changed
+                for(int i = 0; i < set.n; i++){
+                    BezierPatch *patch = current->obj;
+                    ScreenMatrix *sm = screen_matrix(&set.screen[i], VTM, &set.GTM[i], &LTM);
+                    int level[6], built = 0;
+                    copy_begin(&set, i, ds);
+                    bezierSurface_levels(&patch->surface, &sm->m, patch->tolerance, level);
+                    if(rc->patches == NULL){
+                        rc->patches = bezierCache_create();
+                    }
+                    Mesh *mesh = bezierCache_mesh(rc->patches, patch, level, &built);
+                    if(mesh != NULL){
+                        module_drawMesh(mesh, &LTM, &set.GTM[i], sm, ds, rc);
+                    }
+                    rc->stats.patchTessellations += built;
+                    render_reset(rc);
                 }
                 break;
-            }
             case ObjMatrix: {
                 if(matrix_is_zero(current->obj) == 0){
                     matrix_multiply(current->obj, &LTM, &LTM);
+                    copy_invalidate(&set);
                 }             
                 break;
             }
             case ObjIdentity:
                 matrix_identity(&LTM);
+                copy_invalidate(&set);
                 break;
             case ObjLight:
-                if(lighting != NULL && lighting->nLights < 64) {
-                    lighting->light[lighting->nLights] = *(Light*)(current->obj);
-                    lighting->nLights++;
-                }
+                // already gathered, in world coordinates, by module_parseLighting before the traversal
                 break;
             case ObjModule:{
-                Matrix TM;
-                DrawState tempDS;
-                Lighting tempLighting;
-                matrix_identity(&TM);
-                matrix_multiply(GTM, &LTM, &TM);
-                drawstate_copy(&tempDS, ds);
-                lighting_copy(&tempLighting, lighting);
-                module_draw(current->obj, VTM, &TM, &tempDS, lighting, src);
+                Matrix oneGTM;
+                ScreenMatrix oneScreen;
+                CopySet sub = set;
+                if(!copy_alloc(&sub, set.n, &oneGTM, &oneScreen)){
+                    break;
+                }
+                for(int i = 0; i < set.n; i++){
+                    matrix_multiply(&set.GTM[i], &LTM, &sub.GTM[i]);
+                    sub.screen[i].valid = 0;
+                }
+                module_drawCopies(current->obj, &sub, ds, rc);
+                copy_free(&sub);
                 break;
             }
+            case ObjInstances:
+                for(int i = 0; i < set.n; i++){
+                    copy_begin(&set, i, ds);
+                    module_drawInstances(current->obj, &LTM, &set.GTM[i], ds, rc);
+                }
+                break;
         }
         current = current->next;
     }
+    scope_restore(&scope, ds);
+}
+
+// draw the module using the view, draw state, lights and image held by the render context
+// the module and the context's draw state are not modified, and lights added by the module
+// only last for this call, so the same context can be reused frame after frame
+// GTM may be NULL for the identity
+void module_render(Module *md, Matrix *GTM, RenderContext *rc){
+    if(md == NULL || rc == NULL){
+        fprintf(stderr, "Invalid module or render context.\n");
+        return;
+    }
+
+    Matrix I;
+    if(GTM == NULL){
+        matrix_identity(&I);
+        GTM = &I;
+    }
+
+    DrawState ds;
+    drawstate_init(&ds);
+    drawstate_copy(&ds, &rc->ds);
+    int nLights = rc->lighting.nLights;
+
+    // lights anywhere in the tree light all of it, so they are gathered before anything is drawn
+    module_parseLighting(md, GTM, &rc->lighting);
+    if(rc->shadows != NULL){
+        shadow_update(rc->shadows, md, GTM, &rc->lighting);
+    }
+    lighting_compile(&rc->lighting);
+    if(rc->patches != NULL){
+        bezierCache_nextFrame(rc->patches);
+    }
+    ScreenMatrix screen;
+    screen.valid = 0;
+    CopySet set = {1, GTM, &screen, NULL, 0};
+    module_drawCopies(md, &set, &ds, rc);
+
+    // the maps belong to the cache, which may be freed or changed before the next call
+    for(int i = 0; i < rc->lighting.nLights; i++){
+        rc->lighting.shadow[i] = NULL;
+    }
+    rc->lighting.nLights = nLights;
+    rc->lighting.compiled.valid = 0;
+    render_reset(rc);
+}
+
+// draw the module into the image using the given view transformation matrix VTM
+// Lighting and DrawState by traversing the list of Elements
+// Lighting can be an empty structure or NULL
+// the drawing happens in a private render context, so ds and lighting are left unchanged
+// and Bezier patches are tessellated afresh; module_render with a kept context reuses their tessellations
+void module_draw(Module *md, Matrix *VTM, Matrix *GTM, DrawState *ds, Lighting *lighting, Image *src){
+    if(md == NULL){
+        fprintf(stderr, "Invalid module.\n");
+        return;
+    }
+
+    RenderContext *rc = render_create(src, VTM, ds, lighting);
+    if(rc == NULL){
+        return;
+    }
+    module_render(md, GTM, rc);
+    render_free(rc);
 }
 
 // 3D module functions
@@ -579,39 +1208,142 @@ void module_addLight(Module *m, Light *light){
     module_insert(m, e);
 }
 
-/*
-// traverse the module and all sub-modules, keep track of the LTM and GTM and apply all ObjMatrix and ObjIdentity elements.Recursively traverse all ObjModule elements.
+// whether the module or any module below it adds a light
+static int module_hasLights(Module *md){
+    for(Element *e = md->head; e != NULL; e = e->next){
+        if(e->type == ObjLight){
+            return 1;
+        }
+        if(e->type == ObjModule && module_hasLights(e->obj)){
+            return 1;
+        }
+        if(e->type == ObjInstances && module_hasLights(((Instances*)e->obj)->module)){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// add light, moved into world coordinates by TM, unless the same light was already gathered
+// returns 1 if there was no room for it
+static int lighting_gather(Lighting *lighting, Light *light, Matrix *TM){
+    Light world;
+    Vector direction;
+    light_copy(&world, light);
+    matrix_xformPoint(TM, &light->position, &world.position);
+    // directions are not moved by translations
+    vector_copy(&direction, &light->direction);
+    direction.val[3] = 0.0;
+    matrix_xformVector(TM, &direction, &world.direction);
+    // the reach grows with the largest stretch TM applies along any axis
+    if(light->radius > 0){
+        double stretch = 0.0;
+        for(int j = 0; j < 3; j++){
+            double length = sqrt(TM->m[0][j] * TM->m[0][j] + TM->m[1][j] * TM->m[1][j] + TM->m[2][j] * TM->m[2][j]);
+            stretch = length > stretch ? length : stretch;
+        }
+        world.radius = light->radius * stretch;
+    }
+
+    for(int i = 0; i < lighting->nLights; i++){
+        if(light_equal(&lighting->light[i], &world)){
+            return 0;
+        }
+    }
+    if(lighting->nLights >= 64){
+        return 1;
+    }
+    lighting->shadow[lighting->nLights] = NULL;
+    lighting->light[lighting->nLights++] = world;
+    lighting->compiled.valid = 0;
+    return 0;
+}
+
+// the traversal behind module_parseLighting; returns the number of lights there was no room for
+static int module_gatherLights(Module *md, Matrix *GTM, Lighting *lighting){
+    Matrix LTM, TM;
+    int dropped = 0;
+    matrix_identity(&LTM);
+
+    for(Element *e = md->head; e != NULL; e = e->next){
+        switch(e->type){
+            case ObjMatrix:
+                if(matrix_is_zero(e->obj) == 0){
+                    matrix_multiply(e->obj, &LTM, &LTM);
+                }
+                break;
+            case ObjIdentity:
+                matrix_identity(&LTM);
+                break;
+            case ObjLight:
+                matrix_multiply(GTM, &LTM, &TM);
+                dropped += lighting_gather(lighting, e->obj, &TM);
+                break;
+            case ObjModule:
+                matrix_multiply(GTM, &LTM, &TM);
+                dropped += module_gatherLights(e->obj, &TM, lighting);
+                break;
+            case ObjInstances:{
+                Instances *in = e->obj;
+                if(!module_hasLights(in->module)){
+                    break;
+                }
+                for(int i = 0; i < in->nInstance; i++){
+                    matrix_multiply(&in->transform[i], &LTM, &TM);
+                    matrix_multiply(GTM, &TM, &TM);
+                    dropped += module_gatherLights(in->module, &TM, lighting);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    return dropped;
+}
+
+// traverse the module and all sub-modules, keep track of the LTM and GTM and apply all ObjMatrix and ObjIdentity elements. Recursively traverse all ObjModule and ObjInstances elements.
 // when the traversal finds an ObjLight element, copy and add it to the Lighting structure and transform the position and direction fields of the Light by the LTM and GTM.
+// a light reached more than once with the same placement, e.g. through a shared submodule, is only added once
+// GTM may be NULL for the identity
 void module_parseLighting(Module *m, Matrix *GTM, Lighting *lighting){
+    if(m == NULL || lighting == NULL){
+        fprintf(stderr, "Invalid module or lighting.\n");
+        return;
+    }
+
+    Matrix I;
+    if(GTM == NULL){
+        matrix_identity(&I);
+        GTM = &I;
+    }
 
+    int dropped = module_gatherLights(m, GTM, lighting);
+    if(dropped > 0){
+        fprintf(stderr, "Max lights reached, %d lights ignored.\n", dropped);
+    }
 }
-*/
 
-// use the de Casteljau algorithm to subdivide the Bezier curve divisions times
-// then add the lines connecting the control points to the module
-// For example, if divisions is 1, the four original Bezier curve control points will be used to generate eight control points and two new Bezier curves.
-// Then the algorithm will add six lines to the module, three for each of the smaller Bezier curves.
+// add the Bezier curve to the module as one polyline of 3 * 2^divisions segments, the number of lines
+// that subdividing the curve divisions times and joining the control points used to give
+// the points are on the curve, evaluated by forward differencing
 void module_bezierCurve(Module *m, BezierCurve *b, int divisions){
-    if (m == NULL || b == NULL) {
+    if (m == NULL || b == NULL || divisions < 0) {
         fprintf(stderr, "Invalid module or bezier curve.\n");
         return;
     }
 
-    if (divisions == 0) {
-        // Base case: Add lines for the original BezierCurve
-        for (int i = 0; i < 3; i++) {
-            Line l;
-            line_set(&l,b->p[i], b->p[i + 1]);
-            Element *e = element_init(ObjLine, &l);
-            module_insert(m, e);
-        }
-    } else {
-        // Recursive case: Subdivide and add lines for the subdivided curves
-        BezierCurve left, right;
-        de_casteljau(b, &left, &right);
-        module_bezierCurve(m, &left, divisions - 1);
-        module_bezierCurve(m, &right, divisions - 1);
-    }
+    int n = divisions < 9 ? 3 << divisions : BEZIER_MAX_SEGMENTS;
+    n = n < BEZIER_MAX_SEGMENTS ? n : BEZIER_MAX_SEGMENTS;
+    Point vlist[BEZIER_MAX_SEGMENTS + 1];
+    bezierCurve_evaluate(b, n, vlist);
+
+    Polyline p;
+    polyline_init(&p);
+    p.zBuffer = b->zBuffer;
+    p.numVertex = n + 1;
+    p.vertex = vlist;
+    module_polyline(m, &p);
 }
 
 // subdivide a BezierSurface using de Casteljau algorithm
@@ -733,17 +1465,30 @@ void bezierSurface_subdivide(BezierSurface *b, BezierSurface *topLeft, BezierSur
     point_copy(&(bottomRight->p[15]), &(b->p[15]));
 }
 
-// use the de Casteljau algorithm to subdivide the Bezier surface divisions times
-// then add to the module either the lines connecting the control points, if solid is 0, or triangles using the four corner control points.
+// add the Bezier surface to the module, either as the lines connecting the control points of the patches left
+// after subdividing it divisions times with the de Casteljau algorithm, if solid is 0, or as one indexed mesh
+// of the surface evaluated on a grid of 3 * 2^divisions cells a side, the cells those control nets used to give,
+// with shared vertices and surface normals, in an order that already suits the post-transform vertex cache
 // For example, if divisions is 1, the 16 original Bezier curve control points will be used to generate 64 control points and four new Bezier surfaces, which is 1 level of subdivision
-// then the algorithm will add lines or triangles connecting adjacent control points to the module
-// Subdividing surfaces is a counting exercise
+// then the algorithm will add lines connecting adjacent control points to the module
 void module_bezierSurface(Module *m, BezierSurface *b, int divisions, int solid){
-    if (m == NULL || b == NULL) {
+    if (m == NULL || b == NULL || divisions < 0) {
         fprintf(stderr, "Invalid module or bezier surface.\n");
         return;
     }
 
+    if (solid != 0) {
+        int n = divisions < 9 ? 3 << divisions : BEZIER_MAX_SEGMENTS;
+        n = n < BEZIER_MAX_SEGMENTS ? n : BEZIER_MAX_SEGMENTS;
+        Mesh mesh;
+        mesh_init(&mesh);
+        if (bezierSurface_grid(b, n, n, &mesh) == 0) {
+            module_mesh(m, &mesh);
+        }
+        mesh_clear(&mesh);
+        return;
+    }
+
     if (divisions == 0) {
         // Base case: Add triangles or lines for the original BezierSurface
         if (solid == 0) {
@@ -761,29 +1506,6 @@ void module_bezierSurface(Module *m, BezierSurface *b, int divisions, int solid)
                     module_insert(m, e2);
                 }
             }
-        } else {
-            // Add triangles to the Module for the BezierSurface
-            for (int j = 0; j < 3; ++j) {
-                for (int i = 0; i < 3; ++i) {
-                    Polygon *poly1 = polygon_create();
-                    Point pt[3];
-                    point_copy(&pt[1], &(b->p[j * 4 + i]));
-                    point_copy(&pt[1], &(b->p[j * 4 + i + 1]));
-                    point_copy(&pt[1], &(b->p[(j + 1) * 4 + i + 1]));
-
-                    polygon_set(poly1, 3, pt);
-                    Element *e3 = element_init(ObjPolygon, poly1);
-                    module_insert(m, e3);
-
-                    Polygon *poly2 = polygon_create();
-                    point_copy(&pt[1], &(b->p[j * 4 + i]));
-                    point_copy(&pt[1], &(b->p[(j + 1) * 4 + i]));
-                    point_copy(&pt[1], &(b->p[(j + 1) * 4 + i + 1]));
-                    polygon_set(poly2, 3, pt);
-                    Element *e4 = element_init(ObjPolygon, poly2);
-                    module_insert(m, e4);
-                }
-            }
         }
     } else {
         // Recursive case: Subdivide and add triangles or lines for the subdivided surfaces
@@ -796,6 +1518,21 @@ void module_bezierSurface(Module *m, BezierSurface *b, int divisions, int solid)
     }
 }
 
+// add the Bezier surface to the module as one patch that is tessellated when it is drawn, into as many triangles
+// as keep it within tolerance pixels of the surface on the screen; patches sharing a boundary curve meet without cracks
+void module_bezierPatch(Module *m, BezierSurface *b, float tolerance){
+    if (m == NULL || b == NULL || !(tolerance > 0)) {
+        fprintf(stderr, "Invalid module, bezier surface or tolerance.\n");
+        return;
+    }
+
+    BezierPatch patch;
+    memset(&patch, 0, sizeof(patch));
+    memcpy(&patch.surface, b, sizeof(BezierSurface));
+    patch.tolerance = tolerance;
+    module_insert(m, element_init(ObjBezierPatch, &patch));
+}
+
 // add a unit cube, axis-aligned and centered on zero to the Module. If solid is zero, add only lines
 // if solid is non-zero, use polygons. Make sure each polygon has surface normals defined for it
 void module_cube(Module *md, int solid){
@@ -1016,61 +1753,64 @@ void module_cone(Module *mod, int sides){
 
 // a unit sphere module
 void module_sphere(Module *mod, int slices, int stacks) {
-    Polygon p;
-    Point pt[4];
-    Vector n[4];
-    double phi1, phi2, theta1, theta2;
-    double x1, y1, z1, x2, y2, z2;
-    int i, j;
-
-    polygon_init(&p); 
-
-    for(i = 0; i < stacks; i++) {
-        phi1 = M_PI * (-0.5 + (double)(i) / stacks);
-        phi2 = M_PI * (-0.5 + (double)(i + 1) / stacks);
-
-        for(j = 0; j < slices; j++) {
-            theta1 = 2 * M_PI * (double)(j) / slices;
-            theta2 = 2 * M_PI * (double)(j + 1) / slices;
-
-            //set up 4 points of polygon
-            x1 = cos(phi1) * cos(theta1);
-            y1 = sin(phi1);
-            z1 = cos(phi1) * sin(theta1);
-            point_set3D(&pt[0], x1, y1, z1);
-            vector_set(&n[0], x1, y1, z1);
-
-            x2 = cos(phi1) * cos(theta2);
-            y2 = sin(phi1);
-            z2 = cos(phi1) * sin(theta2);
-            point_set3D(&pt[1], x2, y2, z2);
-            vector_set(&n[1], x2, y2, z2);
-
-            x1 = cos(phi2) * cos(theta2);
-            y1 = sin(phi2);
-            z1 = cos(phi2) * sin(theta2);
-            point_set3D(&pt[2], x1, y1, z1);
-            vector_set(&n[2], x1, y1, z1);
-
-            x2 = cos(phi2) * cos(theta1);
-            y2 = sin(phi2);
-            z2 = cos(phi2) * sin(theta1);
-            point_set3D(&pt[3], x2, y2, z2);
-            vector_set(&n[3], x2, y2, z2);
-
-            polygon_set(&p, 3, pt); 
-            polygon_setNormals(&p, 3, n);
-            module_polygon(mod, &p);
-
-            point_copy(&pt[1], &pt[3]);
-            vector_copy(&n[1], &n[3]);
-            polygon_set(&p, 3, pt);
-            polygon_setNormals(&p, 3, n);
-            module_polygon(mod, &p);
+    if(mod == NULL || slices < 1 || stacks < 1){
+        fprintf(stderr, "Invalid module or sphere resolution.\n");
+        return;
+    }
+
+    // a (stacks + 1) x (slices + 1) grid of shared vertices; the seam column is repeated
+    // so every vertex matches the one the quad-by-quad construction produced
+    int nVertex = (stacks + 1) * (slices + 1);
+    int nTriangle = 2 * stacks * slices;
+    Point *pt = (Point*)malloc(nVertex * sizeof(Point));
+    Vector *n = (Vector*)malloc(nVertex * sizeof(Vector));
+    int *index = (int*)malloc(3 * nTriangle * sizeof(int));
+    if(pt == NULL || n == NULL || index == NULL){
+        fprintf(stderr, "Failed to allocate memory for sphere.\n");
+        free(pt);
+        free(n);
+        free(index);
+        return;
+    }
+
+    for(int i = 0; i <= stacks; i++) {
+        double phi = M_PI * (-0.5 + (double)(i) / stacks);
+        for(int j = 0; j <= slices; j++) {
+            double theta = 2 * M_PI * (double)(j) / slices;
+            double x = cos(phi) * cos(theta);
+            double y = sin(phi);
+            double z = cos(phi) * sin(theta);
+            point_set3D(&pt[i * (slices + 1) + j], x, y, z);
+            vector_set(&n[i * (slices + 1) + j], x, y, z);
         }
     }
 
-    polygon_clear(&p); 
+    // two triangles per quad, in the order the polygon version emitted them
+    int *tri = index;
+    for(int i = 0; i < stacks; i++) {
+        for(int j = 0; j < slices; j++) {
+            int v00 = i * (slices + 1) + j;
+            int v01 = v00 + 1;
+            int v10 = v00 + slices + 1;
+            int v11 = v10 + 1;
+            tri[0] = v00; tri[1] = v01; tri[2] = v11;
+            tri[3] = v00; tri[4] = v10; tri[5] = v11;
+            tri += 6;
+        }
+    }
+
+    Mesh mesh;
+    mesh_init(&mesh);
+    if(mesh_set(&mesh, nVertex, pt, nTriangle, index) == 0){
+        mesh_setNormals(&mesh, nVertex, n);
+        mesh_optimize(&mesh, 32);
+        module_mesh(mod, &mesh);
+    }
+
+    mesh_clear(&mesh);
+    free(pt);
+    free(n);
+    free(index);
 }
 
 void module_prism( Module *mod ) {
@@ -0,0 +1,78 @@
+#include <stdint.h>
+#include <math.h>
+#include "parse.h"
+
+// exact powers of ten for parse_number
+static const double parse_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// parse a decimal number at *pp, after any spaces or tabs, stopping at end, and move *pp past it
+// much faster than strtod and exact for the short numbers model writers produce
+// returns -1, leaving *pp alone, if there is no number
+int parse_number(const char **pp, const char *end, double *v){
+    const char *p = *pp;
+    while(p < end && (*p == ' ' || *p == '\t')){
+        p++;
+    }
+
+    int neg = 0;
+    if(p < end && (*p == '-' || *p == '+')){
+        neg = *p == '-';
+        p++;
+    }
+
+    uint64_t mant = 0;
+    int digits = 0, exp10 = 0, seen = 0;
+    while(p < end && *p >= '0' && *p <= '9'){
+        if(digits < 19){
+            mant = mant * 10 + (*p - '0');
+            digits += mant != 0;
+        }else{
+            exp10++;
+        }
+        seen = 1;
+        p++;
+    }
+    if(p < end && *p == '.'){
+        p++;
+        while(p < end && *p >= '0' && *p <= '9'){
+            if(digits < 19){
+                mant = mant * 10 + (*p - '0');
+                digits += mant != 0;
+                exp10--;
+            }
+            seen = 1;
+            p++;
+        }
+    }
+    if(!seen){
+        return -1;
+    }
+    if(p < end && (*p == 'e' || *p == 'E')){
+        int eneg = 0, e = 0;
+        p++;
+        if(p < end && (*p == '-' || *p == '+')){
+            eneg = *p == '-';
+            p++;
+        }
+        while(p < end && *p >= '0' && *p <= '9'){
+            if(e < 10000){
+                e = e * 10 + (*p - '0');
+            }
+            p++;
+        }
+        exp10 += eneg ? -e : e;
+    }
+
+    double x = (double)mant;
+    if(exp10 > 0){
+        x *= exp10 <= 22 ? parse_pow10[exp10] : pow(10.0, exp10);
+    }else if(exp10 < 0){
+        x /= -exp10 <= 22 ? parse_pow10[-exp10] : pow(10.0, -exp10);
+    }
+    *v = neg ? -x : x;
+    *pp = p;
+    return 0;
+}
@@ -0,0 +1,510 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "parse.h"
+#include "ply.h"
+
+#define PLY_MAX_ELEMENT 16
+#define PLY_MAX_PROPERTY 32
+
+typedef enum{
+    PlyNone,
+    PlyChar,
+    PlyUChar,
+    PlyShort,
+    PlyUShort,
+    PlyInt,
+    PlyUInt,
+    PlyFloat,
+    PlyDouble
+}PlyType;
+
+typedef enum{
+    PlyAscii,
+    PlyBinaryLE,
+    PlyBinaryBE
+}PlyFormat;
+
+// a property of an element; lists have a count type as well as a value type
+typedef struct{
+    char name[32];
+    PlyType type;
+    PlyType countType; // PlyNone unless the property is a list
+}PlyProperty;
+
+typedef struct{
+    char name[32];
+    long count;
+    int nProperty;
+    PlyProperty property[PLY_MAX_PROPERTY];
+}PlyElement;
+
+// read position in the mapped file
+typedef struct{
+    const char *p;
+    const char *end;
+    PlyFormat format;
+    int swap; // binary data is in the other byte order from the host
+}PlyReader;
+
+// size in bytes of a binary value of the given type
+static int ply_size(PlyType type){
+    switch(type){
+        case PlyChar:
+        case PlyUChar:
+            return 1;
+        case PlyShort:
+        case PlyUShort:
+            return 2;
+        case PlyInt:
+        case PlyUInt:
+        case PlyFloat:
+            return 4;
+        case PlyDouble:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+// map a header type name, old or new style, to its type
+static PlyType ply_type(const char *name){
+    static const struct{ const char *name; PlyType type; } names[] = {
+        {"char", PlyChar}, {"int8", PlyChar}, {"uchar", PlyUChar}, {"uint8", PlyUChar},
+        {"short", PlyShort}, {"int16", PlyShort}, {"ushort", PlyUShort}, {"uint16", PlyUShort},
+        {"int", PlyInt}, {"int32", PlyInt}, {"uint", PlyUInt}, {"uint32", PlyUInt},
+        {"float", PlyFloat}, {"float32", PlyFloat}, {"double", PlyDouble}, {"float64", PlyDouble}
+    };
+
+    for(size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++){
+        if(strcmp(name, names[i].name) == 0){
+            return names[i].type;
+        }
+    }
+    return PlyNone;
+}
+
+// parse the next whitespace separated decimal number of an ASCII body
+static int ply_ascii(PlyReader *r, double *v){
+    while(r->p < r->end && (*r->p == ' ' || *r->p == '\t' || *r->p == '\n' || *r->p == '\r')){
+        r->p++;
+    }
+    return parse_number(&r->p, r->end, v);
+}
+
+// read the next value of the given type, converting it to double
+static int ply_value(PlyReader *r, PlyType type, double *v){
+    if(r->format == PlyAscii){
+        return ply_ascii(r, v);
+    }
+
+    int size = ply_size(type);
+    if(r->end - r->p < size){
+        return -1;
+    }
+
+    unsigned char b[8];
+    if(r->swap){
+        for(int i = 0; i < size; i++){
+            b[i] = r->p[size - 1 - i];
+        }
+    }else{
+        memcpy(b, r->p, size);
+    }
+    r->p += size;
+
+    switch(type){
+        case PlyChar: { int8_t x; memcpy(&x, b, 1); *v = x; break; }
+        case PlyUChar: { uint8_t x; memcpy(&x, b, 1); *v = x; break; }
+        case PlyShort: { int16_t x; memcpy(&x, b, 2); *v = x; break; }
+        case PlyUShort: { uint16_t x; memcpy(&x, b, 2); *v = x; break; }
+        case PlyInt: { int32_t x; memcpy(&x, b, 4); *v = x; break; }
+        case PlyUInt: { uint32_t x; memcpy(&x, b, 4); *v = x; break; }
+        case PlyFloat: { float x; memcpy(&x, b, 4); *v = x; break; }
+        case PlyDouble: { double x; memcpy(&x, b, 8); *v = x; break; }
+        default:
+            return -1;
+    }
+    return 0;
+}
+
+// parse the header at the start of data, filling in the format and elements
+// returns a pointer to the first byte of the body, or NULL if the header is malformed
+static const char *ply_header(const char *data, size_t size, PlyFormat *format, PlyElement *element, int *nElement){
+    const char *p = data;
+    const char *end = data + size;
+    int haveFormat = 0;
+
+    *nElement = 0;
+    if(size < 4 || strncmp(p, "ply", 3) != 0 || (p[3] != '\n' && p[3] != '\r')){
+        fprintf(stderr, "Not a PLY file.\n");
+        return NULL;
+    }
+
+    while(p < end){
+        const char *eol = memchr(p, '\n', end - p);
+        if(eol == NULL){
+            break;
+        }
+
+        char line[256];
+        size_t len = eol - p;
+        if(len >= sizeof(line)){
+            len = sizeof(line) - 1;
+        }
+        memcpy(line, p, len);
+        line[len] = '\0';
+        if(len > 0 && line[len - 1] == '\r'){
+            line[len - 1] = '\0';
+        }
+        p = eol + 1;
+
+        char word[4][32];
+        int n = sscanf(line, "%31s %31s %31s %31s", word[0], word[1], word[2], word[3]);
+        if(n <= 0 || strcmp(word[0], "ply") == 0 || strcmp(word[0], "comment") == 0 || strcmp(word[0], "obj_info") == 0){
+            continue;
+        }
+        if(strcmp(word[0], "end_header") == 0){
+            if(!haveFormat){
+                fprintf(stderr, "PLY header has no format line.\n");
+                return NULL;
+            }
+            return p;
+        }
+        if(strcmp(word[0], "format") == 0 && n >= 2){
+            if(strcmp(word[1], "ascii") == 0){
+                *format = PlyAscii;
+            }else if(strcmp(word[1], "binary_little_endian") == 0){
+                *format = PlyBinaryLE;
+            }else if(strcmp(word[1], "binary_big_endian") == 0){
+                *format = PlyBinaryBE;
+            }else{
+                fprintf(stderr, "Unknown PLY format %s.\n", word[1]);
+                return NULL;
+            }
+            haveFormat = 1;
+        }else if(strcmp(word[0], "element") == 0 && n >= 3){
+            if(*nElement == PLY_MAX_ELEMENT){
+                fprintf(stderr, "Too many PLY elements.\n");
+                return NULL;
+            }
+            PlyElement *e = &element[(*nElement)++];
+            strcpy(e->name, word[1]);
+            e->count = atol(word[2]);
+            e->nProperty = 0;
+        }else if(strcmp(word[0], "property") == 0 && *nElement > 0){
+            PlyElement *e = &element[*nElement - 1];
+            if(e->nProperty == PLY_MAX_PROPERTY){
+                fprintf(stderr, "Too many PLY properties in %s.\n", e->name);
+                return NULL;
+            }
+            PlyProperty *prop = &e->property[e->nProperty++];
+            if(strcmp(word[1], "list") == 0 && n >= 4){
+                char name[32];
+                if(sscanf(line, "%*s %*s %*s %*s %31s", name) != 1){
+                    fprintf(stderr, "Malformed PLY list property.\n");
+                    return NULL;
+                }
+                prop->countType = ply_type(word[2]);
+                prop->type = ply_type(word[3]);
+                strcpy(prop->name, name);
+                if(prop->countType == PlyNone){
+                    fprintf(stderr, "Unknown PLY type %s.\n", word[2]);
+                    return NULL;
+                }
+            }else if(n >= 3){
+                prop->countType = PlyNone;
+                prop->type = ply_type(word[1]);
+                strcpy(prop->name, word[2]);
+            }else{
+                fprintf(stderr, "Malformed PLY property.\n");
+                return NULL;
+            }
+            if(prop->type == PlyNone){
+                fprintf(stderr, "Unknown PLY type in property %s.\n", prop->name);
+                return NULL;
+            }
+        }
+    }
+
+    fprintf(stderr, "PLY header has no end_header line.\n");
+    return NULL;
+}
+
+// which vertex attribute each property feeds
+enum{ PlySkip = -1, PlyX, PlyY, PlyZ, PlyNX, PlyNY, PlyNZ, PlyRed, PlyGreen, PlyBlue };
+
+// return the vertex attribute slot for a property name
+static int ply_slot(const char *name){
+    static const char *names[] = {"x", "y", "z", "nx", "ny", "nz", "red", "green", "blue"};
+
+    for(int i = 0; i < 9; i++){
+        if(strcmp(name, names[i]) == 0){
+            return i;
+        }
+    }
+    if(strcmp(name, "diffuse_red") == 0){
+        return PlyRed;
+    }
+    if(strcmp(name, "diffuse_green") == 0){
+        return PlyGreen;
+    }
+    if(strcmp(name, "diffuse_blue") == 0){
+        return PlyBlue;
+    }
+    return PlySkip;
+}
+
+// skip one value, or one whole list, of a property we do not use
+static int ply_skipProperty(PlyReader *r, PlyProperty *prop){
+    double v;
+    long count = 1;
+
+    if(prop->countType != PlyNone){
+        if(ply_value(r, prop->countType, &v) != 0){
+            return -1;
+        }
+        count = (long)v;
+    }
+    if(r->format != PlyAscii){
+        long bytes = count * ply_size(prop->type);
+        if(count < 0 || r->end - r->p < bytes){
+            return -1;
+        }
+        r->p += bytes;
+        return 0;
+    }
+    for(long j = 0; j < count; j++){
+        if(ply_value(r, prop->type, &v) != 0){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// skip one instance of an element we do not use
+static int ply_skip(PlyReader *r, PlyElement *e){
+    for(int i = 0; i < e->nProperty; i++){
+        if(ply_skipProperty(r, &e->property[i]) != 0){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// read the vertex element into the mesh arrays
+static int ply_vertices(PlyReader *r, PlyElement *e, Mesh *mesh){
+    int slot[PLY_MAX_PROPERTY];
+    double scale[PLY_MAX_PROPERTY];
+
+    for(int i = 0; i < e->nProperty; i++){
+        slot[i] = e->property[i].countType == PlyNone ? ply_slot(e->property[i].name) : PlySkip;
+        // integer colors are 0 to 255
+        scale[i] = slot[i] >= PlyRed && e->property[i].type != PlyFloat && e->property[i].type != PlyDouble ? 1.0 / 255.0 : 1.0;
+    }
+
+    for(long n = 0; n < e->count; n++){
+        double attr[9] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 1.0, 1.0, 1.0};
+        for(int i = 0; i < e->nProperty; i++){
+            PlyProperty *prop = &e->property[i];
+            if(prop->countType != PlyNone){
+                if(ply_skipProperty(r, prop) != 0){
+                    return -1;
+                }
+                continue;
+            }
+            double v;
+            if(ply_value(r, prop->type, &v) != 0){
+                return -1;
+            }
+            if(slot[i] != PlySkip){
+                attr[slot[i]] = v * scale[i];
+            }
+        }
+        point_set3D(&mesh->vertex[n], attr[PlyX], attr[PlyY], attr[PlyZ]);
+        if(mesh->normal != NULL){
+            vector_set(&mesh->normal[n], attr[PlyNX], attr[PlyNY], attr[PlyNZ]);
+        }
+        if(mesh->color != NULL){
+            color_set(&mesh->color[n], attr[PlyRed], attr[PlyGreen], attr[PlyBlue]);
+        }
+    }
+    return 0;
+}
+
+// read the face element, fan triangulating polygons into the mesh index buffer
+static int ply_faces(PlyReader *r, PlyElement *e, Mesh *mesh, int *capacity){
+    for(long n = 0; n < e->count; n++){
+        for(int i = 0; i < e->nProperty; i++){
+            PlyProperty *prop = &e->property[i];
+            int isIndex = prop->countType != PlyNone &&
+                (strcmp(prop->name, "vertex_indices") == 0 || strcmp(prop->name, "vertex_index") == 0);
+            if(!isIndex){
+                if(ply_skipProperty(r, prop) != 0){
+                    return -1;
+                }
+                continue;
+            }
+
+            double v;
+            if(ply_value(r, prop->countType, &v) != 0){
+                return -1;
+            }
+            int count = (int)v;
+            int first = 0, prev = 0;
+            for(int j = 0; j < count; j++){
+                if(ply_value(r, prop->type, &v) != 0){
+                    return -1;
+                }
+                int index = (int)v;
+                if(index < 0 || index >= mesh->nVertex){
+                    fprintf(stderr, "PLY face %ld uses vertex %d of %d.\n", n, index, mesh->nVertex);
+                    return -1;
+                }
+                if(j == 0){
+                    first = index;
+                }else if(j >= 2){
+                    if(mesh->nTriangle == *capacity){
+                        int *grown = (int*)realloc(mesh->index, 2 * 3 * (size_t)*capacity * sizeof(int));
+                        if(grown == NULL){
+                            fprintf(stderr, "Failed to allocate memory for PLY faces.\n");
+                            return -1;
+                        }
+                        mesh->index = grown;
+                        *capacity *= 2;
+                    }
+                    int *tri = &mesh->index[3 * mesh->nTriangle++];
+                    tri[0] = first;
+                    tri[1] = prev;
+                    tri[2] = index;
+                }
+                prev = index;
+            }
+        }
+    }
+    return 0;
+}
+
+// read a PLY file, ASCII or binary in either byte order, into a newly allocated mesh
+// the file is memory mapped and parsed in place; the mesh gets one vertex array, optional
+// normal and color arrays if the file has nx/ny/nz or red/green/blue, and one index buffer,
+// with polygons fan triangulated into it
+// returns NULL if the file cannot be read or is malformed
+Mesh *ply_read(char *filename){
+    if(filename == NULL){
+        fprintf(stderr, "Invalid filename.\n");
+        return NULL;
+    }
+
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0){
+        fprintf(stderr, "Unable to open %s.\n", filename);
+        return NULL;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0){
+        fprintf(stderr, "Unable to read %s.\n", filename);
+        close(fd);
+        return NULL;
+    }
+    size_t size = st.st_size;
+    const char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED){
+        fprintf(stderr, "Unable to map %s.\n", filename);
+        return NULL;
+    }
+    madvise((void*)data, size, MADV_SEQUENTIAL);
+
+    PlyElement element[PLY_MAX_ELEMENT];
+    int nElement;
+    PlyFormat format = PlyAscii;
+    const char *body = ply_header(data, size, &format, element, &nElement);
+    Mesh *mesh = body != NULL ? mesh_create() : NULL;
+    if(mesh == NULL){
+        munmap((void*)data, size);
+        return NULL;
+    }
+
+    const uint16_t one = 1;
+    int hostLE = *(const unsigned char*)&one == 1;
+    PlyReader r = {body, data + size, format, (format == PlyBinaryLE && !hostLE) || (format == PlyBinaryBE && hostLE)};
+    int capacity = 0;
+    int status = 0;
+
+    for(int i = 0; i < nElement && status == 0; i++){
+        PlyElement *e = &element[i];
+        if(strcmp(e->name, "vertex") == 0 && mesh->vertex == NULL){
+            int hasNormal = 0, hasColor = 0;
+            for(int j = 0; j < e->nProperty; j++){
+                int s = ply_slot(e->property[j].name);
+                hasNormal |= s == PlyNX;
+                hasColor |= s == PlyRed;
+            }
+            mesh->nVertex = (int)e->count;
+            mesh->vertex = (Point*)malloc(e->count * sizeof(Point));
+            mesh->normal = hasNormal ? (Vector*)malloc(e->count * sizeof(Vector)) : NULL;
+            mesh->color = hasColor ? (Color*)malloc(e->count * sizeof(Color)) : NULL;
+            if((e->count > 0 && mesh->vertex == NULL) || (hasNormal && mesh->normal == NULL) || (hasColor && mesh->color == NULL)){
+                fprintf(stderr, "Failed to allocate memory for PLY vertices.\n");
+                status = -1;
+                break;
+            }
+            status = ply_vertices(&r, e, mesh);
+        }else if(strcmp(e->name, "face") == 0 && mesh->index == NULL){
+            // most models are all triangles, so one triangle per face is usually the final size
+            capacity = e->count > 0 ? (int)e->count : 1;
+            mesh->index = (int*)malloc(3 * (size_t)capacity * sizeof(int));
+            if(mesh->index == NULL){
+                fprintf(stderr, "Failed to allocate memory for PLY faces.\n");
+                status = -1;
+                break;
+            }
+            status = ply_faces(&r, e, mesh, &capacity);
+        }else{
+            for(long n = 0; n < e->count && status == 0; n++){
+                status = ply_skip(&r, e);
+            }
+        }
+        if(status != 0){
+            fprintf(stderr, "Malformed PLY %s data in %s.\n", e->name, filename);
+        }
+    }
+
+    munmap((void*)data, size);
+    if(status != 0){
+        mesh_free(mesh);
+        return NULL;
+    }
+    return mesh;
+}
+
+// read a PLY file and add it to the tail of the module as a mesh element
+// the module takes the loaded arrays as they are, without the copy module_mesh would make
+// returns 0 on success, -1 if the file could not be loaded
+int module_ply(Module *md, char *filename){
+    if(md == NULL){
+        fprintf(stderr, "Invalid module.\n");
+        return -1;
+    }
+
+    Mesh *mesh = ply_read(filename);
+    if(mesh == NULL){
+        return -1;
+    }
+
+    Element *e = element_create();
+    if(e == NULL){
+        mesh_free(mesh);
+        return -1;
+    }
+    e->type = ObjMesh;
+    e->obj = mesh;
+    module_insert(md, e);
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <math.h>
+#include <float.h>
 #include "vector.h"
 #include "polygon.h"
 #include "line.h"
@@ -19,6 +20,7 @@ Polygon *polygon_create(){
     p -> color = NULL;
     p -> normal = NULL;
     p -> zBuffer = 1;
+    p -> texture = NULL;
 
     return p;
 }
@@ -63,10 +65,22 @@ Polygon *polygon_createp(int numV, Point *vlist){
     p -> nVertex = numV;
     p -> normal = NULL;
     p -> zBuffer = 1;
+    p -> texture = NULL;
 
     return p;
 }
 
+// give back the texture coordinates and the references to their maps
+static void polygon_clearTextures(Polygon *p){
+    if(p->texture != NULL){
+        for(int i = 0; i < p->nVertex; i++){
+            texture_release(p->texture[i].map);
+        }
+        free(p->texture);
+        p->texture = NULL;
+    }
+}
+
 // free the internal data for a polygon and the polygon pointer
 void polygon_free(Polygon *p){
     if(p == NULL){
@@ -83,6 +97,7 @@ void polygon_free(Polygon *p){
     if(p->normal != NULL){
         free(p->normal);
     }
+    polygon_clearTextures(p);
     
     free(p);
 }
@@ -101,6 +116,7 @@ void polygon_init(Polygon *p){
     p -> color = NULL;
     p -> normal = NULL;
     p -> zBuffer = 1;
+    p -> texture = NULL;
 }
 
 // initialize the vertex array to the points in vlist
@@ -146,6 +162,7 @@ void polygon_clear(Polygon *p){
         free(p->normal);
         p->normal = NULL;
     }
+    polygon_clearTextures(p);
 
     p->nVertex = 0;
 }
@@ -205,6 +222,28 @@ void polygon_setNormals(Polygon *p, int numV, Vector *nlist){
     }
 }
 
+// initializes the texture array to the maps and texture coordinates in tlist, taking a reference to each map
+// a polygon is drawn textured if it has texture coordinates and either its own map or one in the draw state
+void polygon_setTextures(Polygon *p, int numV, Texture *tlist){
+    if(p == NULL || tlist == NULL){
+        fprintf(stderr, "Invalid polygon or texture list.\n");
+        return;
+    }
+
+    Texture *texture = (Texture*)malloc(numV * sizeof(Texture));
+    if(texture == NULL){
+        fprintf(stderr, "Failed to allocate memory for texture list.\n");
+        return;
+    }
+    for(int i = 0; i < numV; i++){
+        texture[i] = tlist[i];
+        texture_retain(texture[i].map);
+    }
+
+    polygon_clearTextures(p);
+    p->texture = texture;
+}
+
 // initializes the vertex list to the points in vlist, the colors to the colors in clist, the normals to the vectors in nlist
 // and the zBuffer and oneSided flags to their respectively values
 void polygon_setAll(Polygon *p, int numV, Point *vlist, Color *clist, Vector *nlist, int zBuffer, int oneSided){
@@ -270,6 +309,18 @@ void polygon_copy(Polygon *to, Polygon *from){
         }
     }
 
+    if(from -> texture != NULL){
+        to -> texture = (Texture*)malloc(from -> nVertex * sizeof(Texture));
+        if(to -> texture == NULL){
+            fprintf(stderr, "Failed to allocate memory for texture list.\n");
+            return;
+        }
+        for(int i = 0; i < from -> nVertex; i++){
+            to -> texture[i] = from -> texture[i];
+            texture_retain(to->texture[i].map);
+        }
+    }
+
     to->oneSided = from->oneSided;
     to->nVertex = from->nVertex;
     to->zBuffer = from->zBuffer;
@@ -346,6 +397,7 @@ void polygon_draw(Polygon *p, Image *src, Color c){
         Line l;
         l.a = p->vertex[i];
         l.b = p->vertex[i + 1];
+        l.zBuffer = p->zBuffer;
         line_draw(&l, src, c);
     }
 
@@ -353,18 +405,36 @@ void polygon_draw(Polygon *p, Image *src, Color c){
     Line lc;
     lc.a = p->vertex[p->nVertex - 1];
     lc.b = p->vertex[0];
+    lc.zBuffer = p->zBuffer;
     line_draw(&lc, src, c);
 }
 
+// draw the outline of the polygon anti-aliased using color c
+void polygon_drawAA(Polygon *p, Image *src, Color c){
+    if(p == NULL || src == NULL || p->nVertex < 2 || p->vertex == NULL){
+        fprintf(stderr, "Unable to draw. Invalid polygon or image.\n");
+        return;
+    }
+
+    for(int i = 0; i < p->nVertex; i++){
+        Line l;
+        l.a = p->vertex[i];
+        l.b = p->vertex[i + 1 < p->nVertex ? i + 1 : 0];
+        l.zBuffer = p->zBuffer;
+        line_drawAA(&l, src, c);
+    }
+}
+
 /*
 	Draws a filled polygon of the specified color into the image src.
  */
 void polygon_drawFill(Polygon *p, Image *src, Color c ) {
-	DrawState *ds = drawstate_create();
-    drawstate_setColor(ds, c);
-    ds->shade = ShadeConstant;
+	DrawState ds;
+    drawstate_init(&ds);
+    drawstate_setColor(&ds, c);
+    ds.shade = ShadeConstant;
 
-    polygon_drawShade(p, src, ds, NULL);
+    polygon_drawShade(p, src, &ds, NULL);
 }
 
 // Helper function to calculate the barycentric coordinates
@@ -404,10 +474,12 @@ void polygon_drawFillB(Polygon *p, Image *src, Color c){
     maxX = fmin(src->cols - 1, maxX);
     maxY = fmin(src->rows - 1, maxY);
 
-    // Iterate over the bounding box
+    // Iterate over the bounding box, filling each run of inside pixels as one span
     Point pt;
     for (int y = minY; y <= maxY; y++) {
-        for (int x = minX; x <= maxX; x++) {
+        int run = -1; // first column of the current run of inside pixels
+        int x;
+        for (x = minX; x <= maxX; x++) {
             pt.val[0] = x;
             pt.val[1] = y;
             pt.val[2] = 0;
@@ -424,24 +496,204 @@ void polygon_drawFillB(Polygon *p, Image *src, Color c){
                 }
             }
 
-            if (inside) {
-                FPixel pixel;
-                color_copy(&(pixel.c), &c);
-                image_setf(src, y, x, pixel);
+            if (inside && run < 0) {
+                run = x;
+            } else if (!inside && run >= 0) {
+                image_fillSpan(src, y, run, x - 1, c, 1.0f, 0.0f, 0);
+                run = -1;
+            }
+        }
+        if (run >= 0) {
+            image_fillSpan(src, y, run, x - 1, c, 1.0f, 0.0f, 0);
+        }
+    }
+}
+
+// a quantity that varies linearly across the screen: its value at the first vertex of a triangle and its change per pixel
+typedef struct{
+    float v, dx, dy;
+}ScreenPlane;
+
+// fit the plane through the values f0, f1, f2 at the triangle's vertices
+// e1 and e2 run from the first vertex to the other two, and det is their cross product
+static void screenPlane_set(ScreenPlane *pl, float f0, float f1, float f2, float e1x, float e1y, float e2x, float e2y, float det){
+    float d1 = f1 - f0, d2 = f2 - f0;
+    pl->v = f0;
+    pl->dx = (d1 * e2y - d2 * e1y) / det;
+    pl->dy = (d2 * e1x - d1 * e2x) / det;
+}
+
+// value of the plane at offset (x, y) from the first vertex
+static inline float screenPlane_at(ScreenPlane *pl, float x, float y){
+    return pl->v + pl->dx * x + pl->dy * y;
+}
+
+// rasterize one triangle of a polygon into a multisampled image
+// coverage and depth are found for every sample, the color only once per pixel, at the center of the pixel if
+// all its samples are covered and at the centroid of the covered ones otherwise, so it never leaves the triangle
+static void polygon_drawMultisampleTriangle(Point *v0, Point *v1, Point *v2, Color *c0, Color *c1, Color *c2, Texture *t0, Texture *t1, Texture *t2,
+                                            TextureMap *map, Image *src, DrawState *ds){
+    int n = src->samples;
+    const float *pattern = image_samplePattern(n);
+    float x0 = v0->val[0], y0 = v0->val[1];
+    float e1x = v1->val[0] - x0, e1y = v1->val[1] - y0;
+    float e2x = v2->val[0] - x0, e2y = v2->val[1] - y0;
+    float det = e1x * e2y - e1y * e2x;
+    if(det == 0.0f){
+        return;
+    }
+
+    // 1/z and everything divided by z are linear in screen space, as in the scanline fill
+    float q0 = v0->val[2] != 0.0 ? 1.0 / v0->val[2] : FLT_MAX;
+    float q1 = v1->val[2] != 0.0 ? 1.0 / v1->val[2] : FLT_MAX;
+    float q2 = v2->val[2] != 0.0 ? 1.0 / v2->val[2] : FLT_MAX;
+    ScreenPlane q, color[3], s = {0, 0, 0}, t = {0, 0, 0};
+    screenPlane_set(&q, q0, q1, q2, e1x, e1y, e2x, e2y, det);
+    if(ds->shade == ShadeGouraud){
+        for(int i = 0; i < 3; i++){
+            screenPlane_set(&color[i], c0->c[i] * q0, c1->c[i] * q1, c2->c[i] * q2, e1x, e1y, e2x, e2y, det);
+        }
+    }
+    if(map != NULL){
+        screenPlane_set(&s, t0->s * q0, t1->s * q1, t2->s * q2, e1x, e1y, e2x, e2y, det);
+        screenPlane_set(&t, t0->t * q0, t1->t * q1, t2->t * q2, e1x, e1y, e2x, e2y, det);
+    }
+
+    // the three edge functions, each positive on the inside when multiplied by the sign of det
+    float ex[3] = {v0->val[0], v1->val[0], v2->val[0]};
+    float ey[3] = {v0->val[1], v1->val[1], v2->val[1]};
+    float edx[3], edy[3];
+    float sign = det > 0 ? 1.0f : -1.0f;
+    for(int k = 0; k < 3; k++){
+        int next = k == 2 ? 0 : k + 1;
+        edx[k] = sign * (ex[next] - ex[k]);
+        edy[k] = sign * (ey[next] - ey[k]);
+    }
+
+    // pixels whose samples can reach the triangle; pixel (r, c) is centered on (c, r + 0.5), like in the scanline fill
+    float minX = fminf(ex[0], fminf(ex[1], ex[2])), maxX = fmaxf(ex[0], fmaxf(ex[1], ex[2]));
+    float minY = fminf(ey[0], fminf(ey[1], ey[2])), maxY = fmaxf(ey[0], fmaxf(ey[1], ey[2]));
+    int colStart = (int)floorf(minX - 0.5f), colEnd = (int)ceilf(maxX + 0.5f);
+    int rowStart = (int)floorf(minY - 1.0f), rowEnd = (int)ceilf(maxY);
+    colStart = colStart < 0 ? 0 : colStart;
+    rowStart = rowStart < 0 ? 0 : rowStart;
+    colEnd = colEnd >= src->cols ? src->cols - 1 : colEnd;
+    rowEnd = rowEnd >= src->rows ? src->rows - 1 : rowEnd;
+
+    for(int r = rowStart; r <= rowEnd; r++){
+        for(int c = colStart; c <= colEnd; c++){
+            float px = c, py = r + 0.5f;
+            unsigned int mask = 0;
+            float cx = 0, cy = 0;
+            for(int i = 0; i < n; i++){
+                float sx = px + pattern[2 * i], sy = py + pattern[2 * i + 1];
+                if(edx[0] * (sy - ey[0]) - edy[0] * (sx - ex[0]) >= 0 &&
+                   edx[1] * (sy - ey[1]) - edy[1] * (sx - ex[1]) >= 0 &&
+                   edx[2] * (sy - ey[2]) - edy[2] * (sx - ex[2]) >= 0){
+                    mask |= 1u << i;
+                    cx += sx;
+                    cy += sy;
+                }
+            }
+            if(mask == 0){
+                continue;
+            }
+
+            // shade once for the pixel
+            int covered = __builtin_popcount(mask);
+            if(covered < n){
+                px = cx / covered;
+                py = cy / covered;
+            }
+            float x = px - x0, y = py - y0;
+            float curZ = screenPlane_at(&q, x, y);
+            FPixel pixel;
+            switch(ds->shade){
+                case ShadeFlat:
+                    pixel.c = *c0;
+                    break;
+                case ShadeDepth:{
+                    float depthV = 1.0f - 1.0f / curZ;
+                    pixel.c.c[0] = curZ * depthV;
+                    pixel.c.c[1] = ds->color.c[1] * depthV;
+                    pixel.c.c[2] = ds->color.c[2] * depthV;
+                    break;
+                }
+                case ShadeGouraud:
+                    for(int i = 0; i < 3; i++){
+                        pixel.c.c[i] = screenPlane_at(&color[i], x, y) / curZ;
+                    }
+                    break;
+                default:
+                    pixel.c = ds->color;
+                    break;
+            }
+            if(map != NULL && ds->shade != ShadeDepth){
+                float ts = screenPlane_at(&s, x, y) / curZ, tt = screenPlane_at(&t, x, y) / curZ;
+                float lod = texture_lod(map, (s.dx - ts * q.dx) / curZ, (t.dx - tt * q.dx) / curZ,
+                                        (s.dy - ts * q.dy) / curZ, (t.dy - tt * q.dy) / curZ);
+                Color texel;
+                texture_sample(map, ts, tt, lod, &texel);
+                for(int i = 0; i < 3; i++){
+                    pixel.c.c[i] *= texel.c[i];
+                }
+            }
+            pixel.a = 1.0f;
+
+            // depth test and store each covered sample
+            FPixel *sample = &src->sample[((size_t)r * src->cols + c) * n];
+            for(int i = 0; i < n; i++){
+                if(!(mask & (1u << i))){
+                    continue;
+                }
+                if(ds->shade == ShadeConstant){
+                    pixel.z = 1.0f;
+                }else{
+                    pixel.z = screenPlane_at(&q, c + pattern[2 * i] - x0, r + 0.5f + pattern[2 * i + 1] - y0);
+                    if(pixel.z <= sample[i].z){
+                        continue;
+                    }
+                }
+                sample[i] = pixel;
             }
         }
     }
 }
 
+// fill a polygon into a multisampled image, as a fan of triangles around its first vertex
+static void polygon_drawMultisample(Polygon *p, Image *src, DrawState *ds){
+    TextureMap *map = NULL;
+    if(p->texture != NULL){
+        map = p->texture[0].map != NULL ? p->texture[0].map : ds->texture.map;
+    }
+
+    for(int k = 1; k + 1 < p->nVertex; k++){
+        Color *c0 = p->color ? &p->color[0] : &ds->color;
+        Color *c1 = p->color ? &p->color[k] : &ds->color;
+        Color *c2 = p->color ? &p->color[k + 1] : &ds->color;
+        Texture *t0 = map != NULL ? &p->texture[0] : NULL;
+        Texture *t1 = map != NULL ? &p->texture[k] : NULL;
+        Texture *t2 = map != NULL ? &p->texture[k + 1] : NULL;
+        polygon_drawMultisampleTriangle(&p->vertex[0], &p->vertex[k], &p->vertex[k + 1], c0, c1, c2, t0, t1, t2, map, src, ds);
+    }
+}
+
 // draw the filled polygon using the given DrawState
 // the shade field of the DrawState determines how the polygon should be rendered
 // The lighting parameter should be NULL unless you are doing Phong shading
 // shadeframe: draw only the outline of the polygon using the drawstate color field(call polygon_draw)
 // shaeconstant: fill the polygon with the draw state color field(call polygon_drawFill)
 // shadedepth: fill the polygon based on the depth value, which should be in the range[0, 1] as 1 is the back clip plane in the canonical view space 
+// with the depthOnlyFlag set, only the depths of the pixels are written, whatever the shade field
 void polygon_drawShade(Polygon *p, Image *src, DrawState *ds, Lighting *light){
-    if(ds->shade == ShadeFrame){
-        polygon_draw(p, src, ds->color);
+    if(ds->shade == ShadeFrame && !ds->depthOnlyFlag){
+        if(ds->lineAntialiasFlag){
+            polygon_drawAA(p, src, ds->color);
+        }else{
+            polygon_draw(p, src, ds->color);
+        }
+    }else if(src->samples > 1 && !ds->depthOnlyFlag){
+        polygon_drawMultisample(p, src, ds);
     }else {
         LinkedList *edges = NULL;
         edges = setupEdgeList( p, src, ds);
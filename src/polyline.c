@@ -163,6 +163,23 @@ void polyline_draw(Polyline *p, Image *src, Color c){
         Line l;
         l.a = p->vertex[i];
         l.b = p->vertex[i + 1];
+        l.zBuffer = p->zBuffer;
         line_draw(&l, src, c);
     }
+}
+
+// draw the polyline anti-aliased using color c and the z-buffer
+void polyline_drawAA(Polyline *p, Image *src, Color c){
+    if(p == NULL || src == NULL){
+        fprintf(stderr, "Unable to draw. Invalid polyline or image.\n");
+        return;
+    }
+
+    for(int i = 0; i < p->numVertex - 1; i++){
+        Line l;
+        l.a = p->vertex[i];
+        l.b = p->vertex[i + 1];
+        l.zBuffer = p->zBuffer;
+        line_drawAA(&l, src, c);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,238 @@
+#include <stdlib.h>
+#include <string.h>
+#include "render.h"
+#include "bezier.h"
+
+#define RENDER_SCRATCH_SIZE 4096
+
+// header placed in front of each overflow block
+typedef struct OverflowBlock{
+    struct OverflowBlock *next;
+}OverflowBlock;
+
+// allocate a render context drawing into src with the given view, draw state and lighting
+// ds and lighting are copied; either may be NULL to start from the defaults
+RenderContext *render_create(Image *src, Matrix *VTM, DrawState *ds, Lighting *lighting){
+    RenderContext *rc = (RenderContext*)malloc(sizeof(RenderContext));
+    if(rc == NULL){
+        fprintf(stderr, "Unable to allocate memory for render context.\n");
+        return NULL;
+    }
+
+    render_init(rc, src, VTM, ds, lighting);
+    return rc;
+}
+
+// initialize an existing render context
+void render_init(RenderContext *rc, Image *src, Matrix *VTM, DrawState *ds, Lighting *lighting){
+    if(rc == NULL){
+        fprintf(stderr, "Invalid render context.\n");
+        return;
+    }
+
+    rc->src = src;
+    matrix_identity(&rc->VTM);
+    if(VTM != NULL){
+        matrix_copy(&rc->VTM, VTM);
+    }
+    fmatrix_set(&rc->fVTM, &rc->VTM);
+    rc->vtmAffine = matrix_isAffine(&rc->VTM);
+    drawstate_init(&rc->ds);
+    if(ds != NULL){
+        drawstate_copy(&rc->ds, ds);
+    }
+    lighting_init(&rc->lighting);
+    if(lighting != NULL){
+        lighting_copy(&rc->lighting, lighting);
+    }
+
+    rc->scratch = NULL;
+    rc->scratchSize = 0;
+    rc->scratchUsed = 0;
+    rc->overflow = NULL;
+    rc->overflowSize = 0;
+    rc->shadows = NULL;
+    rc->patches = NULL;
+    render_clearStats(rc);
+}
+
+// free the scratch memory and the patch tessellations owned by the context
+void render_dealloc(RenderContext *rc){
+    if(rc == NULL){
+        return;
+    }
+
+    render_reset(rc);
+    free(rc->scratch);
+    rc->scratch = NULL;
+    rc->scratchSize = 0;
+    bezierCache_free(rc->patches);
+    rc->patches = NULL;
+}
+
+// free the scratch memory and the context itself
+void render_free(RenderContext *rc){
+    if(rc == NULL){
+        return;
+    }
+
+    render_dealloc(rc);
+    free(rc);
+}
+
+// set the image the context draws into
+void render_setImage(RenderContext *rc, Image *src){
+    if(rc == NULL){
+        fprintf(stderr, "Invalid render context.\n");
+        return;
+    }
+
+    rc->src = src;
+}
+
+// set the view transformation matrix
+void render_setView(RenderContext *rc, Matrix *VTM){
+    if(rc == NULL || VTM == NULL){
+        fprintf(stderr, "Invalid render context or matrix.\n");
+        return;
+    }
+
+    matrix_copy(&rc->VTM, VTM);
+    fmatrix_set(&rc->fVTM, &rc->VTM);
+    rc->vtmAffine = matrix_isAffine(&rc->VTM);
+}
+
+// set the draw state used at the root of the traversal
+void render_setDrawState(RenderContext *rc, DrawState *ds){
+    if(rc == NULL || ds == NULL){
+        fprintf(stderr, "Invalid render context or drawstate.\n");
+        return;
+    }
+
+    drawstate_copy(&rc->ds, ds);
+}
+
+// replace the context's lights with a copy of lighting
+void render_setLighting(RenderContext *rc, Lighting *lighting){
+    if(rc == NULL){
+        fprintf(stderr, "Invalid render context.\n");
+        return;
+    }
+
+    lighting_clear(&rc->lighting);
+    if(lighting != NULL){
+        lighting_copy(&rc->lighting, lighting);
+    }
+}
+
+// have every render with this context cast shadows from the direct and spot lights using the maps in shadows
+// the cache is not owned by the context; NULL turns shadows off
+void render_setShadows(RenderContext *rc, struct ShadowCache *shadows){
+    if(rc == NULL){
+        fprintf(stderr, "Invalid render context.\n");
+        return;
+    }
+
+    rc->shadows = shadows;
+}
+
+// return size bytes of scratch memory, aligned for any type
+// the memory stays valid until render_reset is called
+void *render_alloc(RenderContext *rc, size_t size){
+    if(rc == NULL){
+        fprintf(stderr, "Invalid render context.\n");
+        return NULL;
+    }
+
+    size = (size + 15) & ~(size_t)15;
+    if(rc->scratchUsed + size <= rc->scratchSize){
+        void *p = rc->scratch + rc->scratchUsed;
+        rc->scratchUsed += size;
+        return p;
+    }
+
+    // out of room: hand out a separate block and grow the arena on the next reset
+    OverflowBlock *block = (OverflowBlock*)malloc(sizeof(OverflowBlock) + 16 + size);
+    if(block == NULL){
+        fprintf(stderr, "Unable to allocate scratch memory.\n");
+        return NULL;
+    }
+    block->next = rc->overflow;
+    rc->overflow = block;
+    rc->overflowSize += size;
+
+    return (char*)block + ((sizeof(OverflowBlock) + 15) & ~(size_t)15);
+}
+
+// release all scratch memory handed out since the last reset
+// the arena grows to hold everything that was requested, so steady-state drawing does not allocate
+void render_reset(RenderContext *rc){
+    if(rc == NULL){
+        return;
+    }
+
+    if(rc->overflow != NULL){
+        OverflowBlock *block = rc->overflow;
+        while(block != NULL){
+            OverflowBlock *next = block->next;
+            free(block);
+            block = next;
+        }
+        rc->overflow = NULL;
+
+        size_t size = rc->scratchSize + rc->overflowSize;
+        if(size < RENDER_SCRATCH_SIZE){
+            size = RENDER_SCRATCH_SIZE;
+        }
+        char *scratch = (char*)malloc(size);
+        if(scratch != NULL){
+            free(rc->scratch);
+            rc->scratch = scratch;
+            rc->scratchSize = size;
+        }
+        rc->overflowSize = 0;
+    }
+
+    rc->scratchUsed = 0;
+}
+
+// zero the render statistics
+void render_clearStats(RenderContext *rc){
+    if(rc == NULL){
+        fprintf(stderr, "Invalid render context.\n");
+        return;
+    }
+
+    rc->stats.meshTriangles = 0;
+    rc->stats.vertexRefs = 0;
+    rc->stats.vertexXforms = 0;
+    rc->stats.vertexMisses = 0;
+    rc->stats.patchTessellations = 0;
+}
+
+// fraction of mesh vertex references a RENDER_VERTEX_CACHE entry FIFO post-transform cache would serve,
+// replaying the triangles in the order they were drawn; unlike vertexXforms, this depends on that order
+double render_cacheHitRate(RenderContext *rc){
+    if(rc == NULL){
+        fprintf(stderr, "Invalid render context.\n");
+        return 0.0;
+    }
+
+    if(rc->stats.vertexRefs == 0){
+        return 0.0;
+    }
+    return 1.0 - (double)rc->stats.vertexMisses / rc->stats.vertexRefs;
+}
+
+// print the render statistics to the stream fp
+void render_printStats(RenderContext *rc, FILE *fp){
+    if(rc == NULL || fp == NULL){
+        fprintf(stderr, "Invalid render context or file stream.\n");
+        return;
+    }
+
+    fprintf(fp, "mesh triangles: %ld, vertex references: %ld, vertices transformed: %ld, "
+            "%d-entry FIFO cache hit rate: %.1f%%, patches tessellated: %ld\n", rc->stats.meshTriangles,
+            rc->stats.vertexRefs, rc->stats.vertexXforms, RENDER_VERTEX_CACHE, 100.0 * render_cacheHitRate(rc),
+            rc->stats.patchTessellations);
+}
@@ -50,18 +50,63 @@ int compXIntersect( const void *a, const void *b ) {
 	return(0);
 }
 
+// coordinates are clamped to this many pixels either side of the image before going to fixed point,
+// which keeps every product in the edge walker within 64 bits
+#define SCANLINE_RANGE 8388608.0
+
+// a coordinate in 28.4 fixed point: sixteenths of a pixel
+static inline int64_t scanline_fixed(double v){
+	if (!(v > -SCANLINE_RANGE)) v = -SCANLINE_RANGE; // NaN goes to the edge too
+	if (v > SCANLINE_RANGE) v = SCANLINE_RANGE;
+	return (int64_t)llrint(v * 16.0);
+}
+
+// a / b rounded up, for b > 0
+static inline int64_t scanline_ceilDiv(int64_t a, int64_t b){
+	return a >= 0 ? (a + b - 1) / b : -((-a) / b);
+}
+
+// a / b rounded down, for b > 0
+static inline int64_t scanline_floorDiv(int64_t a, int64_t b){
+	return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// the first row whose center, at row + 0.5, is at or below the fixed-point y
+// an edge covers the rows from the one at its top end up to, not including, the one at its bottom end,
+// so a row center exactly on a shared vertex or horizontal edge belongs to the polygon below it
+static inline int scanline_firstRow(int64_t y){
+	return (int)scanline_ceilDiv(y - 8, 16);
+}
+
+// move the edge's crossing down one scanline: exact integer stepping, so tall edges do not drift
+static inline void scanline_stepEdge(Edge *edge){
+	edge->xCol += edge->xStepCol;
+	edge->xErr -= edge->xStepErr;
+	if (edge->xErr < 0) {
+		edge->xCol++;
+		edge->xErr += edge->xDen;
+	}
+	edge->xIntersect = edge->xCol - (float)edge->xErr / edge->xDen;
+}
+
 /*
 	Allocates, creates, fills out, and returns an Edge structure given
 	the inputs.
 
 	Current inputs are just the start and end location in image space.
-	Eventually, the points will be 3D and we'll add color and texture
-	coordinates.
+	The colors and, if t0 and t1 are not NULL, the texture coordinates of
+	the two ends are interpolated divided by z so they are perspective-correct.
+
+	The end points are snapped to 28.4 fixed point and the edge is walked
+	in integers: on each scanline xCol is the first column whose center,
+	at x = column, is at or right of the edge. A span covers the columns
+	from its left edge's xCol up to, not including, its right edge's, so
+	a pixel center exactly on an edge shared by two polygons is drawn by
+	exactly one of them (the top-left rule).
  */
-Edge *makeEdgeRec( Point start, Point end, Image *src, DrawState *ds, Color c0, Color c1)
+Edge *makeEdgeRec( Point start, Point end, Image *src, DrawState *ds, Color c0, Color c1, Texture *t0, Texture *t1)
 {
 	Edge *edge;
-	float dscan = end.val[1] - start.val[1];
 
 	/******
 				 Your code starts here
@@ -72,35 +117,54 @@ Edge *makeEdgeRec( Point start, Point end, Image *src, DrawState *ds, Color c0,
 	if (start.val[1] >= src->rows || end.val[1] < 0) {
 		return NULL;
 	}
+
+	int64_t X0 = scanline_fixed(start.val[0]), Y0 = scanline_fixed(start.val[1]);
+	int64_t X1 = scanline_fixed(end.val[0]), Y1 = scanline_fixed(end.val[1]);
+	int yStart = scanline_firstRow(Y0);
+	int yEnd = scanline_firstRow(Y1) - 1;
+	if (yStart < 0) yStart = 0;
+	if (yEnd >= src->rows) yEnd = src->rows - 1;
+	if (yStart > yEnd) {
+		return NULL;
+	}
+
 	// allocate an edge structure and set the x0, y0, x1, y1 values
 	edge = (Edge*)malloc(sizeof(Edge));
 	if(edge == NULL){
 		fprintf(stderr, "Failed to allocate memory for edge.\n");
 		return NULL;
 	}
-	edge -> x0 = start.val[0];
-	edge -> y0 = start.val[1];
-	edge -> x1 = end.val[0];
-	edge -> y1 = end.val[1];
-	edge -> yStart = (int)(edge -> y0 + 0.5);
-	edge -> yEnd = (int)(edge -> y1 + 0.5) - 1;
+	edge -> x0 = X0 / 16.0f;
+	edge -> y0 = Y0 / 16.0f;
+	edge -> x1 = X1 / 16.0f;
+	edge -> y1 = Y1 / 16.0f;
+	edge -> yStart = yStart;
+	edge -> yEnd = yEnd;
+
+	// the edge crosses row r's center at x = N / D with N = X0 * DY + (16r + 8 - Y0) * DX and D = 16 * DY;
+	// xCol = ceil(N / D) and xErr = xCol * D - N, and N grows by 16 * DX a row
+	int64_t DX = X1 - X0, DY = Y1 - Y0;
+	int64_t N = X0 * DY + (16 * (int64_t)yStart + 8 - Y0) * DX;
+	edge->xDen = 16 * DY;
+	edge->xCol = scanline_ceilDiv(N, edge->xDen);
+	edge->xErr = edge->xCol * edge->xDen - N;
+	edge->xStepCol = scanline_floorDiv(16 * DX, edge->xDen);
+	edge->xStepErr = 16 * DX - edge->xStepCol * edge->xDen;
+	edge->xIntersect = edge->xCol - (float)edge->xErr / edge->xDen;
 
 	// BAM put these calculations here
 	float invZ0 = (start.val[2] != 0.0) ? 1.0 / start.val[2] : FLT_MAX; //BAM might want to set it to a big number if start.val[2] is zero
 	float invZ1 = (end.val[2] != 0.0) ? 1.0 / end.val[2] : FLT_MAX;  // BAM same here
 
-	if (edge->yEnd >= src->rows) {
-    	edge->yEnd = src->rows - 1;
-	}
-	
+	float dscan = edge->y1 - edge->y0;
 	edge->dxPerScan = (edge->x1 - edge->x0) / dscan;
 	edge->dzPerScan = (invZ1 - invZ0) / dscan; 	
 	//edge->dpPerScan.val[0] = 
 	//edge->dnPerScan = 
 
 	// BAM I would suggest computing the adjustment once, because you will use it for both xIntersect and zIntersect
-	float adjust = (edge->yStart - edge->y0 + 0.5);
-	edge->xIntersect = edge->x0 + adjust * edge->dxPerScan;
+	// the attributes start at the center of the first row, which also accounts for edges clipped at the top
+	float adjust = (edge->yStart + 0.5 - edge->y0);
 	edge->zIntersect = invZ0 + adjust * edge->dzPerScan;
 
 	// color interpolation
@@ -115,28 +179,18 @@ Edge *makeEdgeRec( Point start, Point end, Image *src, DrawState *ds, Color c0,
 				edge->cIntersect.c[i] = c0.c[i] * invZ0 + adjust * edge->dcPerScan.c[i];
     		}
 	}
-    
-	if(edge->y0 < 0){
-		edge->xIntersect = edge->x0 + (-edge->y0) * edge->dxPerScan;
-		edge->zIntersect = invZ0 + (-edge->y0) * edge->dzPerScan;
-		edge->yStart = 0;
-		edge->y0 = 0.0;
-    	edge->x0 = edge->xIntersect;
-
-		if(ds->shade == ShadeGouraud){
-			for (int i = 0; i < 3; i++) {
-            	edge->cIntersect.c[i] += edge->dcPerScan.c[i] * (-edge->y0);
-        	}
-		}
-	}
-	if (edge->dxPerScan < 0.0 && edge->xIntersect < edge->x1) {
-		edge->xIntersect = edge->x1;
-		edge->zIntersect = invZ1;
-		// BAM might want to set zIntersect to edge->z1
-	} else if (edge->dxPerScan > 0.0 && edge->xIntersect > edge->x1) {
-		edge->xIntersect = edge->x1;
-		edge->zIntersect = invZ1;
-		// BAM might want to set zIntersect to edge->z1
+
+	// texture coordinates
+	edge->texture.map = NULL;
+	if(t0 != NULL && t1 != NULL){
+		edge->texture.map = t0->map;
+		edge->dsPerScan = (t1->s * invZ1 - t0->s * invZ0) / dscan;
+		edge->dtPerScan = (t1->t * invZ1 - t0->t * invZ0) / dscan;
+		edge->sIntersect = t0->s * invZ0 + adjust * edge->dsPerScan;
+		edge->tIntersect = t0->t * invZ0 + adjust * edge->dtPerScan;
+	}else{
+		edge->dsPerScan = edge->dtPerScan = 0;
+		edge->sIntersect = edge->tIntersect = 0;
 	}
 
 	return( edge );
@@ -150,23 +204,40 @@ LinkedList *setupEdgeList( Polygon *p, Image *src, DrawState *ds) {
 	LinkedList *edges = NULL;
 	Point v1, v2;
 	Color c1, c2;
+	Texture t1 = {NULL, 0.0, 0.0}, t2 = t1;
 	int i;
 
+	// the polygon is textured if it has texture coordinates and a map of its own or in the draw state
+	TextureMap *map = NULL;
+	if(p->texture != NULL){
+		map = p->texture[0].map != NULL ? p->texture[0].map : ds->texture.map;
+	}
+	Texture *tp1 = map != NULL ? &t1 : NULL;
+	Texture *tp2 = map != NULL ? &t2 : NULL;
+
 	edges = ll_new();
 
 	v1 = p->vertex[p->nVertex-1];
 	c1 = p->color ? p->color[p->nVertex-1] : ds->color;
+	if(map != NULL){
+		t1 = p->texture[p->nVertex-1];
+		t1.map = map;
+	}
 
 	for(i=0;i<p->nVertex;i++) {
 		v2 = p->vertex[i];
 		c2 = p->color ? p->color[i] : ds->color;
+		if(map != NULL){
+			t2 = p->texture[i];
+			t2.map = map;
+		}
 		// if it is not a horizontal line
-		if( (int)(v1.val[1]+0.5) != (int)(v2.val[1]+0.5) ) {
+		if( scanline_firstRow(scanline_fixed(v1.val[1])) != scanline_firstRow(scanline_fixed(v2.val[1])) ) {
 			Edge *edge;
 			if( v1.val[1] < v2.val[1] )
-				edge = makeEdgeRec( v1, v2, src, ds, c1, c2);
+				edge = makeEdgeRec( v1, v2, src, ds, c1, c2, tp1, tp2);
 			else
-				edge = makeEdgeRec( v2, v1, src, ds, c2, c1);
+				edge = makeEdgeRec( v2, v1, src, ds, c2, c1, tp2, tp1);
 
 			// insert the edge into the list of edges if it's not null
 			if( edge )
@@ -174,6 +245,7 @@ LinkedList *setupEdgeList( Polygon *p, Image *src, DrawState *ds) {
 		}
 		v1 = v2;
 		c1 = c2;
+		t1 = t2;
 	}
 
 	if( ll_empty( edges ) ) {
@@ -190,7 +262,7 @@ LinkedList *setupEdgeList( Polygon *p, Image *src, DrawState *ds) {
  */
 void fillScan( int scan, LinkedList *active, Image *src, DrawState *ds, Lighting *lights) {
 	Edge *p1, *p2;
-	Color dcPerColumn;
+	Color dcPerColumn = {{0, 0, 0}};
 	Color curColor = ds->color;
 	float curs=0, curt=0, dsPerColumn=0, dtPerColumn=0;
 	// loop over the list
@@ -215,6 +287,21 @@ void fillScan( int scan, LinkedList *active, Image *src, DrawState *ds, Lighting
 		// BAM you want to compute these here
 		float dzPerColumn = (p2->zIntersect - p1->zIntersect) / (p2->xIntersect - p1->xIntersect);
 		float curZ = p1->zIntersect;		
+
+		// texture coordinates divided by z, and 1/z itself, which the texture needs even when the
+		// shade method does not use depth; the texture's footprint also needs their change per scanline
+		TextureMap *map = ds->shade != ShadeDepth ? p1->texture.map : NULL;
+		float curq = curZ, dqPerColumn = dzPerColumn;
+		float dsPerScan = 0, dtPerScan = 0, dqPerScan = 0;
+		if(map != NULL){
+			dsPerColumn = (p2->sIntersect - p1->sIntersect) / (p2->xIntersect - p1->xIntersect);
+			dtPerColumn = (p2->tIntersect - p1->tIntersect) / (p2->xIntersect - p1->xIntersect);
+			curs = p1->sIntersect;
+			curt = p1->tIntersect;
+			dsPerScan = p1->dsPerScan - dsPerColumn * p1->dxPerScan;
+			dtPerScan = p1->dtPerScan - dtPerColumn * p1->dxPerScan;
+			dqPerScan = p1->dzPerScan - dqPerColumn * p1->dxPerScan;
+		}
 		switch(ds->shade) {
 			case ShadeConstant:
 				dzPerColumn = 0;
@@ -242,23 +329,36 @@ void fillScan( int scan, LinkedList *active, Image *src, DrawState *ds, Lighting
 				break;
 		}
 		
-		int startCol = (int)(p1->xIntersect + 0.5);
-		if (startCol < 0) {
-		  // BAM if you do this, you need to adjust curZ by adding -startCol * dzPerColumn
-		  curZ += -startCol * dzPerColumn;
-		  for (int i = 0; i < 3; i++) {
-              curColor.c[i] += -startCol * dcPerColumn.c[i];
-          }
-		  curs += -startCol*dsPerColumn;
-		  curt += -startCol*dtPerColumn;
-		  startCol = 0;
+		// the span covers the columns from the left edge's up to, not including, the right edge's
+		int startCol = p1->xCol < 0 ? 0 : (int)p1->xCol;
+		int endCol = p2->xCol > src->cols ? src->cols - 1 : (int)p2->xCol - 1;
+		if (startCol > endCol) {
+			p1 = ll_next( active );
+			continue;
 		}
-		
-		int endCol = (int)(p2->xIntersect + 0.5);
-		if (endCol >= src->cols) endCol = src->cols;  // BAM src->cols, not src->cols-1
-		
+
+		// BAM if you do this, you need to adjust curZ by adding -startCol * dzPerColumn
+		// the values above are at the edge, so move them to the center of the first pixel
+		float offset = startCol - p1->xIntersect;
+		curZ += offset * dzPerColumn;
+		for (int i = 0; i < 3; i++) {
+			curColor.c[i] += offset * dcPerColumn.c[i];
+		}
+		curs += offset * dsPerColumn;
+		curt += offset * dtPerColumn;
+		curq += offset * dqPerColumn;
+
+		// an untextured constant span needs no per-pixel work at all
+		if (ds->shade == ShadeConstant && map == NULL) {
+			image_fillSpan(src, scan, startCol, endCol, curColor, 1.0f, 0.0f, 0);
+			p1 = ll_next( active );
+			continue;
+		}
+
+		// the span is on the image now, so the pixels are read and written without bounds checks
+		FPixel *row = image_row(src, scan);
 		for (int x = startCol; x <= endCol; x++) {
-		  if (ds->shade == ShadeConstant || curZ > image_getz(src, scan, x)){ // BAM or ds->shade == ShadeConstant
+		  if (ds->shade == ShadeConstant || curZ > row[x].z){ // BAM or ds->shade == ShadeConstant
 				FPixel pixel;
 				switch(ds->shade){
 					case ShadeConstant:
@@ -277,26 +377,69 @@ void fillScan( int scan, LinkedList *active, Image *src, DrawState *ds, Lighting
 						pixel.c.c[0] = curColor.c[0] / curZ; // BAM divide by 1/z, not multiply
 						pixel.c.c[1] = curColor.c[1] / curZ;
 						pixel.c.c[2] = curColor.c[2] / curZ;
-						printf("Writing: ");
-						color_print(&pixel.c);
 						break;
 					default:
 					    break;
 				}
+				if(map != NULL){
+					// undo the division by z, then size the pixel's footprint on the texture from the
+					// derivatives of s = (s/z) / (1/z) across the column and down the scanline
+					float s = curs / curq, t = curt / curq;
+					float lod = texture_lod(map, (dsPerColumn - s * dqPerColumn) / curq, (dtPerColumn - t * dqPerColumn) / curq,
+											(dsPerScan - s * dqPerScan) / curq, (dtPerScan - t * dqPerScan) / curq);
+					Color texel;
+					texture_sample(map, s, t, lod, &texel);
+					pixel.c.c[0] *= texel.c[0];
+					pixel.c.c[1] *= texel.c[1];
+					pixel.c.c[2] *= texel.c[2];
+				}
+				pixel.a = 1.0f;
 				pixel.z = curZ;
-				image_setf(src, scan, x, pixel);
-				image_setz(src, scan, x, curZ);
+				image_put(src, scan, x, pixel);
 			}
 			curZ += dzPerColumn;
 			for (int i = 0; i < 3; i++) {
                 curColor.c[i] += dcPerColumn.c[i];
             }
+			curs += dsPerColumn;
+			curt += dtPerColumn;
+			curq += dqPerColumn;
 		}
 		// move ahead to the next pair of edges
 		p1 = ll_next( active );
 	}
 }
 
+// keep the nearer of each pixel's depth and the span's, leaving the colors alone, for depth-only passes
+static void fillScanDepth( int scan, LinkedList *active, Image *src ) {
+	Edge *p1, *p2;
+
+	p1 = ll_head( active );
+	while(p1) {
+		p2 = ll_next( active );
+		if( !p2 ) {
+			printf("bad bad bad (your edges are not coming in pairs)\n");
+			break;
+		}
+
+		// the same span fillScan covers, with 1/z moved to the center of the first pixel
+		int startCol = p1->xCol < 0 ? 0 : (int)p1->xCol;
+		int endCol = p2->xCol > src->cols ? src->cols - 1 : (int)p2->xCol - 1;
+		if( p2->xIntersect != p1->xIntersect && startCol <= endCol ) {
+			float dzPerColumn = (p2->zIntersect - p1->zIntersect) / (p2->xIntersect - p1->xIntersect);
+			float curZ = p1->zIntersect + (startCol - p1->xIntersect) * dzPerColumn;
+			FPixel *row = image_row(src, scan);
+			for (int x = startCol; x <= endCol; x++) {
+				if (curZ > row[x].z) {
+					row[x].z = curZ;
+				}
+				curZ += dzPerColumn;
+			}
+		}
+		p1 = ll_next( active );
+	}
+}
+
 /* 
 	 Process the edge list, assumes the edges list has at least one entry
 */
@@ -320,23 +463,20 @@ int processEdgeList( LinkedList *edges, Image *src, DrawState *ds, Lighting *lig
 			break;
 		}
 
-		fillScan(scan, active, src, ds, lights);
+		if( ds->depthOnlyFlag ) {
+			fillScanDepth(scan, active, src);
+		} else {
+			fillScan(scan, active, src, ds, lights);
+		}
 		for( tedge = ll_pop( active ); tedge != NULL; tedge = ll_pop( active ) ) {
 			if( tedge->yEnd > scan ) {
-				//float a = 1.0;
-
-				if( tedge->dxPerScan < 0.0 && tedge->xIntersect < tedge->x1 ) {
-					tedge->xIntersect = tedge->x1;
-				}
-				else if( tedge->dxPerScan > 0.0 && tedge->xIntersect > tedge->x1 ) {
-					tedge->xIntersect = tedge->x1;
-				}
-
-				tedge->xIntersect += tedge->dxPerScan;
+				scanline_stepEdge(tedge);
 				tedge->zIntersect += tedge->dzPerScan;
 				tedge->cIntersect.c[0] += tedge->dcPerScan.c[0];
 				tedge->cIntersect.c[1] += tedge->dcPerScan.c[1];
 				tedge->cIntersect.c[2] += tedge->dcPerScan.c[2];
+				tedge->sIntersect += tedge->dsPerScan;
+				tedge->tIntersect += tedge->dtPerScan;
 
 				ll_insert( tmplist, tedge, compXIntersect );
 			}
@@ -377,15 +517,11 @@ void processEdgeListGradient(LinkedList *edges, Image *src, Color startColor, Co
             break;
         }
 
+        // Draw scanline with gradient color, then step the edges to the next one
+        drawScanlineGradient(active, src, startColor, endColor, scan);
         for (tedge = ll_pop(active); tedge != NULL; tedge = ll_pop(active)) {
             if (tedge->yEnd > scan) {
-                tedge->xIntersect += tedge->dxPerScan;
-
-                if (tedge->dxPerScan < 0.0 && tedge->xIntersect < tedge->x1) {
-                    tedge->xIntersect = tedge->x1;
-                } else if (tedge->dxPerScan > 0.0 && tedge->xIntersect > tedge->x1) {
-                    tedge->xIntersect = tedge->x1;
-                }
+                scanline_stepEdge(tedge);
 
                 ll_insert(tmplist, tedge, compXIntersect);
             }
@@ -395,9 +531,6 @@ void processEdgeListGradient(LinkedList *edges, Image *src, Color startColor, Co
         transfer = active;
         active = tmplist;
         tmplist = transfer;
-
-        // Draw scanline with gradient color
-        drawScanlineGradient(active, src, startColor, endColor, scan);
     }
 
     ll_delete(active, NULL);
@@ -427,18 +560,22 @@ void drawScanlineGradient(LinkedList *active, Image *src, Color startColor, Colo
             break;
         }
 
-        // Calculate starting and ending x coordinates for the current scanline
-        x0 = (int)(e0->xIntersect);
-        x1 = (int)(e1->xIntersect);
+        // Calculate starting and ending x coordinates for the current scanline, leaving out
+        // the right edge's own column so neighbouring polygons do not share pixels
+        x0 = e0->xCol < 0 ? 0 : (e0->xCol > src->cols ? src->cols : (int)e0->xCol);
+        x1 = e1->xCol > src->cols ? src->cols - 1 : (e1->xCol < 0 ? -1 : (int)e1->xCol - 1);
 
         // Ensure x0 and x1 are within image boundaries
-        if (x0 < 0) x0 = 0;
-        if (x1 >= src->cols) x1 = src->cols - 1;
+        if (!image_clipSpan(src, scan, &x0, &x1)) {
+            e0 = ll_next(active);
+            continue;
+        }
 
         // Calculate the color gradient along the scanline and fill the pixels
+        FPixel *row = image_row(src, scan);
         for (int x = x0; x <= x1; x++) {
             // Calculate interpolation factor
-            t = (float)(x - x0) / (float)(x1 - x0);
+            t = x1 > x0 ? (float)(x - x0) / (float)(x1 - x0) : 0.0f;
 
             // Interpolate color between startColor and endColor
             pixelColor.c[0] = (unsigned char)lerp(startColor.c[0], endColor.c[0], t);
@@ -446,9 +583,8 @@ void drawScanlineGradient(LinkedList *active, Image *src, Color startColor, Colo
             pixelColor.c[2] = (unsigned char)lerp(startColor.c[2], endColor.c[2], t);
 
             // Set pixel color in the image
-            FPixel pixel;
-            pixel.c = pixelColor;
-            image_setf(src, scan, x, pixel);
+            FPixel pixel = {pixelColor, 1.0f, row[x].z};
+            image_put(src, scan, x, pixel);
         }
 
         // Move to the next pair of edges
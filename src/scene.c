@@ -0,0 +1,420 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "scene.h"
+
+#define SCENE_VERSION 2
+#define SCENE_ALIGN 16
+
+// the file is an image of the graph as it sits in memory, with every pointer stored as an offset
+// from the start of the file; the offsets of the pointer fields follow the image so a loader can
+// turn them back into pointers in one pass over the mapped file
+// the sizes identify the struct layout, so a file only loads in a build with the same layout
+typedef struct{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder; // SCENE_BYTE_ORDER as written by the host
+    uint16_t size[14]; // sizes of the pointer and of each serialized struct
+    uint64_t fileSize; // bytes in the file
+    uint64_t root; // offset of the root module
+    uint64_t reloc; // offset of the pointer field offsets
+    uint64_t nReloc; // number of pointer fields
+}SceneHeader;
+
+static const char scene_magic[8] = "GRSCENE";
+#define SCENE_BYTE_ORDER 0x01020304u
+
+// build-time layout of the serialized structs
+static void scene_layout(uint16_t *size){
+    size[0] = sizeof(void*);
+    size[1] = sizeof(Module);
+    size[2] = sizeof(Element);
+    size[3] = sizeof(Point);
+    size[4] = sizeof(Line);
+    size[5] = sizeof(Polyline);
+    size[6] = sizeof(Polygon);
+    size[7] = sizeof(Mesh);
+    size[8] = sizeof(Matrix);
+    size[9] = sizeof(Color);
+    size[10] = sizeof(Light);
+    size[11] = sizeof(Vector);
+    size[12] = sizeof(Instances);
+    size[13] = sizeof(BezierPatch);
+}
+
+// output buffer and bookkeeping for scene_write
+typedef struct{
+    char *data;
+    size_t size, cap;
+    uint64_t *reloc; // offsets of the pointer fields in data
+    size_t nReloc, relocCap;
+    Module **module; // hash table from modules already written to their offsets
+    uint64_t *moduleOffset;
+    size_t nModule, moduleCap;
+    int error;
+}SceneWriter;
+
+// reserve size zeroed bytes at the end of the image and return their offset
+static uint64_t scene_alloc(SceneWriter *w, size_t size){
+    size_t offset = (w->size + SCENE_ALIGN - 1) & ~(size_t)(SCENE_ALIGN - 1);
+    if(offset + size > w->cap){
+        size_t cap = w->cap > 0 ? w->cap : 4096;
+        while(cap < offset + size){
+            cap *= 2;
+        }
+        char *data = realloc(w->data, cap);
+        if(data == NULL){
+            w->error = 1;
+            return 0;
+        }
+        w->data = data;
+        w->cap = cap;
+    }
+    memset(w->data + w->size, 0, offset + size - w->size);
+    w->size = offset + size;
+    return offset;
+}
+
+// store target in the pointer field at offset at and remember the field for relocation
+static void scene_link(SceneWriter *w, uint64_t at, uint64_t target){
+    if(w->error){
+        return;
+    }
+    if(w->nReloc == w->relocCap){
+        size_t cap = w->relocCap > 0 ? 2 * w->relocCap : 1024;
+        uint64_t *reloc = realloc(w->reloc, cap * sizeof(uint64_t));
+        if(reloc == NULL){
+            w->error = 1;
+            return;
+        }
+        w->reloc = reloc;
+        w->relocCap = cap;
+    }
+    w->reloc[w->nReloc++] = at;
+    uintptr_t value = (uintptr_t)target;
+    memcpy(w->data + at, &value, sizeof(value));
+}
+
+// copy an object into the image, leaving its pointer fields to be linked, and return its offset
+static uint64_t scene_object(SceneWriter *w, const void *obj, size_t size){
+    uint64_t offset = scene_alloc(w, size);
+    if(!w->error){
+        memcpy(w->data + offset, obj, size);
+    }
+    return offset;
+}
+
+// copy an array into the image and point the field at offset at to it; NULL arrays stay NULL
+static void scene_array(SceneWriter *w, uint64_t at, const void *array, size_t size){
+    uintptr_t null = 0;
+    if(!w->error){
+        memcpy(w->data + at, &null, sizeof(null));
+    }
+    if(array == NULL || size == 0){
+        return;
+    }
+    uint64_t offset = scene_object(w, array, size);
+    scene_link(w, at, offset);
+}
+
+// hash a module pointer into the writer's table
+static size_t scene_hash(SceneWriter *w, Module *md){
+    uint64_t key = (uint64_t)(uintptr_t)md;
+    size_t h = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & (w->moduleCap - 1);
+    while(w->module[h] != NULL && w->module[h] != md){
+        h = (h + 1) & (w->moduleCap - 1);
+    }
+    return h;
+}
+
+// remember that md was written at offset, growing the table at half load
+static void scene_remember(SceneWriter *w, Module *md, uint64_t offset){
+    if(2 * (w->nModule + 1) > w->moduleCap){
+        SceneWriter grown = *w;
+        grown.moduleCap = w->moduleCap > 0 ? 2 * w->moduleCap : 64;
+        grown.module = calloc(grown.moduleCap, sizeof(Module*));
+        grown.moduleOffset = malloc(grown.moduleCap * sizeof(uint64_t));
+        if(grown.module == NULL || grown.moduleOffset == NULL){
+            free(grown.module);
+            free(grown.moduleOffset);
+            w->error = 1;
+            return;
+        }
+        for(size_t i = 0; i < w->moduleCap; i++){
+            if(w->module[i] != NULL){
+                size_t h = scene_hash(&grown, w->module[i]);
+                grown.module[h] = w->module[i];
+                grown.moduleOffset[h] = w->moduleOffset[i];
+            }
+        }
+        free(w->module);
+        free(w->moduleOffset);
+        w->module = grown.module;
+        w->moduleOffset = grown.moduleOffset;
+        w->moduleCap = grown.moduleCap;
+    }
+    size_t h = scene_hash(w, md);
+    w->module[h] = md;
+    w->moduleOffset[h] = offset;
+    w->nModule++;
+}
+
+// write the object held by an element and return its offset, or 0 for no object
+static uint64_t scene_writeObject(SceneWriter *w, Element *e);
+
+// write a module and its elements, once per module however many times it is referenced
+static uint64_t scene_writeModule(SceneWriter *w, Module *md){
+    if(w->moduleCap > 0){
+        size_t h = scene_hash(w, md);
+        if(w->module[h] == md){
+            return w->moduleOffset[h];
+        }
+    }
+
+    uint64_t offset = scene_alloc(w, sizeof(Module));
+    scene_remember(w, md, offset);
+
+    uint64_t previous = 0;
+    for(Element *e = md->head; e != NULL && !w->error; e = e->next){
+        uint64_t at = scene_alloc(w, sizeof(Element));
+        if(w->error){
+            break;
+        }
+        ((Element*)(w->data + at))->type = e->type;
+        uint64_t obj = scene_writeObject(w, e);
+        if(obj != 0){
+            scene_link(w, at + offsetof(Element, obj), obj);
+        }
+
+        if(previous == 0){
+            scene_link(w, offset + offsetof(Module, head), at);
+        }else{
+            scene_link(w, previous + offsetof(Element, next), at);
+        }
+        previous = at;
+    }
+    if(previous != 0){
+        scene_link(w, offset + offsetof(Module, tail), previous);
+    }
+    return offset;
+}
+
+static uint64_t scene_writeObject(SceneWriter *w, Element *e){
+    uint64_t offset = 0;
+    if(e->obj == NULL){
+        return 0;
+    }
+
+    switch(e->type){
+        case ObjNone:
+        case ObjIdentity:
+            break;
+        case ObjLine:
+            offset = scene_object(w, e->obj, sizeof(Line));
+            break;
+        case ObjPoint:
+            offset = scene_object(w, e->obj, sizeof(Point));
+            break;
+        case ObjMatrix:
+            offset = scene_object(w, e->obj, sizeof(Matrix));
+            break;
+        case ObjColor:
+        case ObjBodyColor:
+        case ObjSurfaceColor:
+            offset = scene_object(w, e->obj, sizeof(Color));
+            break;
+        case ObjSurfaceCoeff:
+            offset = scene_object(w, e->obj, sizeof(float));
+            break;
+        case ObjLight:
+            offset = scene_object(w, e->obj, sizeof(Light));
+            break;
+        case ObjBezierPatch:
+            offset = scene_object(w, e->obj, sizeof(BezierPatch));
+            break;
+        case ObjPolyline:{
+            Polyline *p = e->obj;
+            offset = scene_object(w, p, sizeof(Polyline));
+            scene_array(w, offset + offsetof(Polyline, vertex), p->vertex, p->numVertex * sizeof(Point));
+            break;
+        }
+        case ObjPolygon:{
+            // textures refer to images outside the graph and are not saved
+            Polygon *p = e->obj;
+            offset = scene_object(w, p, sizeof(Polygon));
+            scene_array(w, offset + offsetof(Polygon, vertex), p->vertex, p->nVertex * sizeof(Point));
+            scene_array(w, offset + offsetof(Polygon, color), p->color, p->nVertex * sizeof(Color));
+            scene_array(w, offset + offsetof(Polygon, normal), p->normal, p->nVertex * sizeof(Vector));
+            scene_array(w, offset + offsetof(Polygon, texture), NULL, 0);
+            break;
+        }
+        case ObjMesh:{
+            Mesh *m = e->obj;
+            offset = scene_object(w, m, sizeof(Mesh));
+            scene_array(w, offset + offsetof(Mesh, vertex), m->vertex, m->nVertex * sizeof(Point));
+            scene_array(w, offset + offsetof(Mesh, normal), m->normal, m->nVertex * sizeof(Vector));
+            scene_array(w, offset + offsetof(Mesh, color), m->color, m->nVertex * sizeof(Color));
+            scene_array(w, offset + offsetof(Mesh, index), m->index, 3 * (size_t)m->nTriangle * sizeof(int));
+            break;
+        }
+        case ObjModule:
+            offset = scene_writeModule(w, e->obj);
+            break;
+        case ObjInstances:{
+            Instances *in = e->obj;
+            offset = scene_object(w, in, sizeof(Instances));
+            scene_array(w, offset + offsetof(Instances, transform), in->transform, in->nInstance * sizeof(Matrix));
+            scene_array(w, offset + offsetof(Instances, color), in->color, in->nInstance * sizeof(Color));
+            uint64_t sub = scene_writeModule(w, in->module);
+            scene_link(w, offset + offsetof(Instances, module), sub);
+            break;
+        }
+    }
+    return offset;
+}
+
+// write the module graph rooted at md to a scene file
+// submodules referenced from several places, including instanced ones, are stored once and stay shared when read back
+// returns 0 on success, -1 on failure
+int scene_write(Module *md, char *filename){
+    if(md == NULL || filename == NULL){
+        fprintf(stderr, "Invalid module or filename.\n");
+        return -1;
+    }
+
+    SceneWriter w;
+    memset(&w, 0, sizeof(w));
+    uint64_t header = scene_alloc(&w, sizeof(SceneHeader));
+    uint64_t root = scene_writeModule(&w, md);
+    uint64_t reloc = scene_alloc(&w, w.nReloc * sizeof(uint64_t));
+    if(!w.error){
+        memcpy(w.data + reloc, w.reloc, w.nReloc * sizeof(uint64_t));
+
+        SceneHeader *h = (SceneHeader*)(w.data + header);
+        memcpy(h->magic, scene_magic, sizeof(h->magic));
+        h->version = SCENE_VERSION;
+        h->byteOrder = SCENE_BYTE_ORDER;
+        scene_layout(h->size);
+        h->fileSize = w.size;
+        h->root = root;
+        h->reloc = reloc;
+        h->nReloc = w.nReloc;
+    }
+
+    int status = 0;
+    if(w.error){
+        fprintf(stderr, "Unable to allocate memory for scene.\n");
+        status = -1;
+    }else{
+        FILE *fp = fopen(filename, "wb");
+        if(fp == NULL){
+            fprintf(stderr, "Unable to open %s.\n", filename);
+            status = -1;
+        }else{
+            if(fwrite(w.data, 1, w.size, fp) != w.size){
+                fprintf(stderr, "Unable to write %s.\n", filename);
+                status = -1;
+            }
+            if(fclose(fp) != 0){
+                status = -1;
+            }
+        }
+    }
+
+    free(w.data);
+    free(w.reloc);
+    free(w.module);
+    free(w.moduleOffset);
+    return status;
+}
+
+// map a scene file and turn its stored offsets back into pointers
+// returns NULL if the file cannot be read or was written by a build with a different layout
+Scene *scene_read(char *filename){
+    if(filename == NULL){
+        fprintf(stderr, "Invalid filename.\n");
+        return NULL;
+    }
+
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0){
+        fprintf(stderr, "Unable to open %s.\n", filename);
+        return NULL;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SceneHeader)){
+        fprintf(stderr, "Unable to read %s.\n", filename);
+        close(fd);
+        return NULL;
+    }
+    size_t size = st.st_size;
+    // private and writable: the relocation pass writes its pointers into copy-on-write pages
+    char *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED){
+        fprintf(stderr, "Unable to map %s.\n", filename);
+        return NULL;
+    }
+
+    SceneHeader *h = (SceneHeader*)data;
+    uint16_t layout[14];
+    scene_layout(layout);
+    if(memcmp(h->magic, scene_magic, sizeof(h->magic)) != 0 || h->version != SCENE_VERSION ||
+       h->byteOrder != SCENE_BYTE_ORDER || memcmp(h->size, layout, sizeof(layout)) != 0){
+        fprintf(stderr, "%s is not a scene file for this build.\n", filename);
+        munmap(data, size);
+        return NULL;
+    }
+    if(h->fileSize != size || h->root < sizeof(SceneHeader) || h->root > size - sizeof(Module) ||
+       h->reloc > size || h->nReloc > (size - h->reloc) / sizeof(uint64_t) || h->reloc % sizeof(uint64_t) != 0){
+        fprintf(stderr, "Corrupt scene file %s.\n", filename);
+        munmap(data, size);
+        return NULL;
+    }
+
+    // offsets are checked so a damaged file cannot send a write outside the mapping
+    const uint64_t *reloc = (const uint64_t*)(data + h->reloc);
+    uint64_t nReloc = h->nReloc;
+    for(uint64_t i = 0; i < nReloc; i++){
+        uint64_t at = reloc[i];
+        uintptr_t value;
+        if(at % sizeof(uintptr_t) != 0 || at > h->reloc - sizeof(uintptr_t)){
+            fprintf(stderr, "Corrupt scene file %s.\n", filename);
+            munmap(data, size);
+            return NULL;
+        }
+        memcpy(&value, data + at, sizeof(value));
+        if(value >= size){
+            fprintf(stderr, "Corrupt scene file %s.\n", filename);
+            munmap(data, size);
+            return NULL;
+        }
+        value += (uintptr_t)data;
+        memcpy(data + at, &value, sizeof(value));
+    }
+
+    Scene *s = (Scene*)malloc(sizeof(Scene));
+    if(s == NULL){
+        fprintf(stderr, "Unable to allocate memory for scene.\n");
+        munmap(data, size);
+        return NULL;
+    }
+    s->root = (Module*)(data + h->root);
+    s->data = data;
+    s->size = size;
+    return s;
+}
+
+// release a scene and everything in it
+void scene_free(Scene *s){
+    if(s == NULL){
+        return;
+    }
+
+    munmap(s->data, s->size);
+    free(s);
+}
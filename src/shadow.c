@@ -0,0 +1,450 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "shadow.h"
+#include "view3d.h"
+
+#define SHADOW_BIAS 0.002
+
+// box around everything the scene draws, in world coordinates
+typedef struct{
+    double min[3], max[3];
+    int empty;
+}ShadowBounds;
+
+// state shared by the workers of one shadow_update call
+typedef struct{
+    Module *scene;
+    Matrix *GTM;
+    ShadowMap **map; // maps to render
+    int nMap;
+    int next; // next map to hand out
+    pthread_mutex_t lock;
+}ShadowJob;
+
+// allocate a cache of size x size maps rendered with nThreads workers
+ShadowCache *shadow_create(int size, int nThreads){
+    if(size <= 0){
+        fprintf(stderr, "Invalid shadow map size.\n");
+        return NULL;
+    }
+
+    ShadowCache *sc = (ShadowCache*)malloc(sizeof(ShadowCache));
+    if(sc == NULL){
+        fprintf(stderr, "Unable to allocate memory for shadow cache.\n");
+        return NULL;
+    }
+    sc->size = size;
+    sc->bias = SHADOW_BIAS;
+    sc->nThreads = nThreads;
+    sc->nMap = 0;
+    sc->scene = NULL;
+    matrix_identity(&sc->GTM);
+    sc->dirty = 1;
+    return sc;
+}
+
+// free one map and its depth image
+static void shadowMap_free(ShadowMap *map){
+    if(map == NULL){
+        return;
+    }
+    image_free(map->depth);
+    free(map);
+}
+
+// free the cache and all of its maps
+void shadow_free(ShadowCache *sc){
+    if(sc == NULL){
+        return;
+    }
+
+    for(int i = 0; i < sc->nMap; i++){
+        shadowMap_free(sc->map[i]);
+    }
+    free(sc);
+}
+
+// set the depth bias of every map; larger values remove self-shadowing acne but detach shadows from their casters
+void shadow_setBias(ShadowCache *sc, float bias){
+    if(sc == NULL){
+        fprintf(stderr, "Invalid shadow cache.\n");
+        return;
+    }
+
+    sc->bias = bias;
+    for(int i = 0; i < sc->nMap; i++){
+        sc->map[i]->bias = bias;
+    }
+}
+
+// tell the cache the geometry of the scene changed, so every map is redrawn on the next update
+// changes to the lights, the scene module or the GTM passed to shadow_update are noticed without it
+void shadow_invalidate(ShadowCache *sc){
+    if(sc == NULL){
+        fprintf(stderr, "Invalid shadow cache.\n");
+        return;
+    }
+
+    sc->dirty = 1;
+}
+
+// grow the bounds by n points transformed by TM
+static void shadow_boundPoints(ShadowBounds *bounds, Matrix *TM, Point *vertex, int n){
+    for(int i = 0; i < n; i++){
+        Point q;
+        matrix_xformPoint(TM, &vertex[i], &q);
+        if(q.val[3] != 0.0 && q.val[3] != 1.0){
+            q.val[0] /= q.val[3];
+            q.val[1] /= q.val[3];
+            q.val[2] /= q.val[3];
+        }
+        for(int k = 0; k < 3; k++){
+            if(bounds->empty || q.val[k] < bounds->min[k]){
+                bounds->min[k] = q.val[k];
+            }
+            if(bounds->empty || q.val[k] > bounds->max[k]){
+                bounds->max[k] = q.val[k];
+            }
+        }
+        bounds->empty = 0;
+    }
+}
+
+// grow the bounds by everything a module draws, following the transforms the way module_render does
+static void shadow_boundModule(ShadowBounds *bounds, Module *md, Matrix *GTM){
+    Matrix LTM, TM;
+    matrix_identity(&LTM);
+
+    for(Element *e = md->head; e != NULL; e = e->next){
+        switch(e->type){
+            case ObjPoint:
+                matrix_multiply(GTM, &LTM, &TM);
+                shadow_boundPoints(bounds, &TM, e->obj, 1);
+                break;
+            case ObjLine:{
+                Line *line = e->obj;
+                matrix_multiply(GTM, &LTM, &TM);
+                shadow_boundPoints(bounds, &TM, &line->a, 1);
+                shadow_boundPoints(bounds, &TM, &line->b, 1);
+                break;
+            }
+            case ObjPolyline:{
+                Polyline *polyline = e->obj;
+                matrix_multiply(GTM, &LTM, &TM);
+                shadow_boundPoints(bounds, &TM, polyline->vertex, polyline->numVertex);
+                break;
+            }
+            case ObjPolygon:{
+                Polygon *polygon = e->obj;
+                matrix_multiply(GTM, &LTM, &TM);
+                shadow_boundPoints(bounds, &TM, polygon->vertex, polygon->nVertex);
+                break;
+            }
+            case ObjMesh:{
+                Mesh *mesh = e->obj;
+                matrix_multiply(GTM, &LTM, &TM);
+                shadow_boundPoints(bounds, &TM, mesh->vertex, mesh->nVertex);
+                break;
+            }
+            case ObjBezierPatch:
+                // the surface lies within the convex hull of its control points
+                matrix_multiply(GTM, &LTM, &TM);
+                shadow_boundPoints(bounds, &TM, ((BezierPatch*)e->obj)->surface.p, 16);
+                break;
+            case ObjMatrix:
+                if(matrix_is_zero(e->obj) == 0){
+                    matrix_multiply(e->obj, &LTM, &LTM);
+                }
+                break;
+            case ObjIdentity:
+                matrix_identity(&LTM);
+                break;
+            case ObjModule:
+                matrix_multiply(GTM, &LTM, &TM);
+                shadow_boundModule(bounds, e->obj, &TM);
+                break;
+            case ObjInstances:{
+                Instances *in = e->obj;
+                for(int i = 0; i < in->nInstance; i++){
+                    matrix_multiply(&in->transform[i], &LTM, &TM);
+                    matrix_multiply(GTM, &TM, &TM);
+                    shadow_boundModule(bounds, in->module, &TM);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+// place the map's view so that the light looks at the whole sphere around center with the given radius
+// a direct light has no position, so it looks from far outside the sphere, where its rays are nearly parallel
+static void shadowMap_setView(ShadowMap *map, int size, Point *center, double radius){
+    View3D view;
+    Light *light = &map->light;
+
+    if(light->type == LightDirect){
+        // the direction of a direct light points from the surface toward the light
+        vector_copy(&view.vpn, &light->direction);
+        vector_normalize(&view.vpn);
+        vector_scale(&view.vpn, -1);
+        point_set3D(&view.vrp, center->val[0] - radius * view.vpn.val[0], center->val[1] - radius * view.vpn.val[1],
+                    center->val[2] - radius * view.vpn.val[2]);
+        view.d = 10 * radius;
+        view.du = 2 * radius;
+        view.b = 2 * radius;
+    }else{
+        // a spot light looks along its direction from its position, as wide as its cone
+        vector_copy(&view.vpn, &light->direction);
+        vector_normalize(&view.vpn);
+        double angle = light->cutoff < 1.4 ? light->cutoff : 1.4;
+        double distance = sqrt((center->val[0] - light->position.val[0]) * (center->val[0] - light->position.val[0]) +
+                               (center->val[1] - light->position.val[1]) * (center->val[1] - light->position.val[1]) +
+                               (center->val[2] - light->position.val[2]) * (center->val[2] - light->position.val[2]));
+        view.d = 0.01 * radius;
+        point_set3D(&view.vrp, light->position.val[0] + view.d * view.vpn.val[0], light->position.val[1] + view.d * view.vpn.val[1],
+                    light->position.val[2] + view.d * view.vpn.val[2]);
+        view.du = 2 * view.d * tan(angle);
+        view.b = distance + radius - view.d;
+        if(view.b <= view.d){
+            view.b = 2 * view.d;
+        }
+    }
+
+    if(fabs(view.vpn.val[1]) < 0.9){
+        vector_set(&view.vup, 0, 1, 0);
+    }else{
+        vector_set(&view.vup, 1, 0, 0);
+    }
+    view.dv = view.du;
+    view.f = 0;
+    view.screenx = size;
+    view.screeny = size;
+    matrix_setView3D(&map->view, &view);
+}
+
+// render maps until none are left
+static void *shadow_worker(void *arg){
+    ShadowJob *job = arg;
+    DrawState ds;
+    drawstate_init(&ds);
+    ds.depthOnlyFlag = 1;
+
+    while(1){
+        pthread_mutex_lock(&job->lock);
+        int i = job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if(i >= job->nMap){
+            break;
+        }
+
+        ShadowMap *map = job->map[i];
+        RenderContext rc;
+        image_reset(map->depth);
+        render_init(&rc, map->depth, &map->view, &ds, NULL);
+        module_render(job->scene, job->GTM, &rc);
+        render_dealloc(&rc);
+        map->valid = 1;
+    }
+
+    return NULL;
+}
+
+// render the maps in parallel, one map at a time per worker
+static void shadow_render(ShadowCache *sc, ShadowMap **map, int nMap, Module *scene, Matrix *GTM){
+    int nThreads = sc->nThreads;
+    if(nThreads <= 0){
+        nThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if(nThreads <= 0){
+            nThreads = 1;
+        }
+    }
+    if(nThreads > nMap){
+        nThreads = nMap;
+    }
+
+    ShadowJob job;
+    job.scene = scene;
+    job.GTM = GTM;
+    job.map = map;
+    job.nMap = nMap;
+    job.next = 0;
+    pthread_mutex_init(&job.lock, NULL);
+
+    pthread_t threads[64];
+    int started = 0;
+    for(int i = 1; i < nThreads; i++){
+        if(pthread_create(&threads[started], NULL, shadow_worker, &job) == 0){
+            started++;
+        }
+    }
+    // the calling thread works too
+    shadow_worker(&job);
+    for(int i = 0; i < started; i++){
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&job.lock);
+}
+
+// find a map in use for a light equal to light
+static ShadowMap *shadow_find(ShadowCache *sc, Light *light, int used){
+    for(int i = 0; i < sc->nMap; i++){
+        if(sc->map[i]->used == used && light_equal(&sc->map[i]->light, light)){
+            return sc->map[i];
+        }
+    }
+    return NULL;
+}
+
+// bring the maps up to date for the direct and spot lights of lighting, which must be in world coordinates,
+// and point each such light of lighting at its map
+// maps whose light and scene are unchanged are reused; the others are rendered, in parallel, from scene and GTM
+// returns the number of maps rendered, or -1 on error
+int shadow_update(ShadowCache *sc, Module *scene, Matrix *GTM, Lighting *lighting){
+    if(sc == NULL || scene == NULL || GTM == NULL || lighting == NULL){
+        fprintf(stderr, "Invalid shadow cache, module, matrix or lighting.\n");
+        return -1;
+    }
+
+    if(scene != sc->scene || memcmp(GTM->m, sc->GTM.m, sizeof(GTM->m)) != 0){
+        sc->dirty = 1;
+    }
+    for(int i = 0; i < sc->nMap; i++){
+        sc->map[i]->used = 0;
+        if(sc->dirty){
+            sc->map[i]->valid = 0;
+        }
+    }
+
+    // first keep the maps of lights that did not change, then hand the rest of the maps to new lights
+    ShadowMap *assigned[64];
+    for(int i = 0; i < lighting->nLights; i++){
+        Light *light = &lighting->light[i];
+        assigned[i] = NULL;
+        if(light->type != LightDirect && light->type != LightSpot){
+            continue;
+        }
+        assigned[i] = shadow_find(sc, light, 1);
+        if(assigned[i] == NULL){
+            assigned[i] = shadow_find(sc, light, 0);
+        }
+        if(assigned[i] != NULL){
+            assigned[i]->used = 1;
+        }
+    }
+    for(int i = 0; i < lighting->nLights; i++){
+        Light *light = &lighting->light[i];
+        if(assigned[i] != NULL || (light->type != LightDirect && light->type != LightSpot)){
+            continue;
+        }
+        ShadowMap *map = shadow_find(sc, light, 1);
+        for(int j = 0; map == NULL && j < sc->nMap; j++){
+            if(!sc->map[j]->used){
+                map = sc->map[j];
+            }
+        }
+        if(map == NULL){
+            map = (ShadowMap*)malloc(sizeof(ShadowMap));
+            if(map == NULL){
+                fprintf(stderr, "Unable to allocate memory for shadow map.\n");
+                continue;
+            }
+            map->depth = NULL;
+            map->used = 0;
+            sc->map[sc->nMap++] = map;
+        }
+        if(map->depth == NULL || map->depth->rows != sc->size || map->depth->cols != sc->size){
+            image_free(map->depth);
+            map->depth = image_create(sc->size, sc->size);
+        }
+        if(!map->used){
+            light_copy(&map->light, light);
+            map->bias = sc->bias;
+            map->valid = 0;
+            map->used = 1;
+        }
+        assigned[i] = map;
+    }
+
+    // drop the maps of lights that are gone
+    int n = 0;
+    for(int i = 0; i < sc->nMap; i++){
+        if(sc->map[i]->used){
+            sc->map[n++] = sc->map[i];
+        }else{
+            shadowMap_free(sc->map[i]);
+        }
+    }
+    sc->nMap = n;
+
+    ShadowMap *render[64];
+    int nRender = 0;
+    for(int i = 0; i < sc->nMap; i++){
+        if(!sc->map[i]->valid && sc->map[i]->depth != NULL){
+            render[nRender++] = sc->map[i];
+        }
+    }
+    if(nRender > 0){
+        ShadowBounds bounds;
+        bounds.empty = 1;
+        shadow_boundModule(&bounds, scene, GTM);
+        Point center;
+        double radius = 1.0;
+        point_set3D(&center, 0, 0, 0);
+        if(!bounds.empty){
+            point_set3D(&center, (bounds.min[0] + bounds.max[0]) / 2, (bounds.min[1] + bounds.max[1]) / 2,
+                        (bounds.min[2] + bounds.max[2]) / 2);
+            radius = 0.5 * sqrt((bounds.max[0] - bounds.min[0]) * (bounds.max[0] - bounds.min[0]) +
+                                (bounds.max[1] - bounds.min[1]) * (bounds.max[1] - bounds.min[1]) +
+                                (bounds.max[2] - bounds.min[2]) * (bounds.max[2] - bounds.min[2]));
+            if(radius <= 0){
+                radius = 1.0;
+            }
+        }
+        for(int i = 0; i < nRender; i++){
+            shadowMap_setView(render[i], sc->size, &center, radius);
+        }
+        shadow_render(sc, render, nRender, scene, GTM);
+    }
+
+    sc->scene = scene;
+    matrix_copy(&sc->GTM, GTM);
+    sc->dirty = 0;
+
+    for(int i = 0; i < lighting->nLights; i++){
+        lighting->shadow[i] = assigned[i] != NULL && assigned[i]->valid ? assigned[i] : NULL;
+    }
+    lighting->compiled.valid = 0;
+
+    return nRender;
+}
+
+// fraction of the 3x3 map pixels around world point p that see p from the light (percentage-closer filtering)
+// points outside the map or behind the light are lit
+float shadow_sample(ShadowMap *map, Point *p){
+    Point q;
+    matrix_xformPoint(&map->view, p, &q);
+    if(q.val[3] <= 0 || q.val[2] <= 0){
+        return 1.0;
+    }
+
+    float invZ = 1.0 / q.val[2];
+    float limit = 1.0 - map->bias;
+    // the fill stores the depth at the center of pixel (r, c) in row r, column c
+    int row = (int)floor(q.val[1] / q.val[3]);
+    int col = (int)floor(q.val[0] / q.val[3]);
+    int lit = 0;
+    for(int r = row - 1; r <= row + 1; r++){
+        for(int c = col - 1; c <= col + 1; c++){
+            if(r < 0 || r >= map->depth->rows || c < 0 || c >= map->depth->cols || invZ >= map->depth->data[r][c].z * limit){
+                lit++;
+            }
+        }
+    }
+    return lit / 9.0f;
+}
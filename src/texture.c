@@ -0,0 +1,245 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "texture.h"
+
+// maps read from files, so that every polygon using a file shares one copy
+static TextureMap *texture_cache = NULL;
+static pthread_mutex_t texture_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// address of texel (r, c) of a level
+static inline Color *texture_texel(TextureMap *map, int level, int r, int c){
+    int tile = (r / TEXTURE_TILE) * map->tileCols[level] + c / TEXTURE_TILE;
+    return &map->texel[level][(tile * TEXTURE_TILE + r % TEXTURE_TILE) * TEXTURE_TILE + c % TEXTURE_TILE];
+}
+
+// build a texture map, with its mip chain, from a copy of the colors of src
+// the map starts with one reference, owned by the caller
+TextureMap *texture_create(Image *src){
+    if(src == NULL || src->data == NULL || src->rows <= 0 || src->cols <= 0){
+        fprintf(stderr, "Invalid image for texture.\n");
+        return NULL;
+    }
+
+    TextureMap *map = (TextureMap*)malloc(sizeof(TextureMap));
+    if(map == NULL){
+        fprintf(stderr, "Unable to allocate memory for texture.\n");
+        return NULL;
+    }
+
+    // size the levels, halving down to a single texel
+    size_t offset[TEXTURE_LEVELS];
+    size_t total = 0;
+    int rows = src->rows, cols = src->cols;
+    map->nLevel = 0;
+    while(map->nLevel < TEXTURE_LEVELS){
+        int level = map->nLevel++;
+        map->rows[level] = rows;
+        map->cols[level] = cols;
+        map->tileCols[level] = (cols + TEXTURE_TILE - 1) / TEXTURE_TILE;
+        offset[level] = total;
+        total += (size_t)((rows + TEXTURE_TILE - 1) / TEXTURE_TILE) * map->tileCols[level] * TEXTURE_TILE * TEXTURE_TILE;
+        if(rows == 1 && cols == 1){
+            break;
+        }
+        rows = rows > 1 ? rows / 2 : 1;
+        cols = cols > 1 ? cols / 2 : 1;
+    }
+
+    Color *texel = (Color*)malloc(total * sizeof(Color));
+    if(texel == NULL){
+        fprintf(stderr, "Unable to allocate memory for texture.\n");
+        free(map);
+        return NULL;
+    }
+    for(int level = 0; level < map->nLevel; level++){
+        map->texel[level] = texel + offset[level];
+    }
+
+    for(int r = 0; r < src->rows; r++){
+        for(int c = 0; c < src->cols; c++){
+            *texture_texel(map, 0, r, c) = src->data[r][c].c;
+        }
+    }
+
+    // each texel of a level is the average of the 2x2 texels it covers in the level above
+    for(int level = 1; level < map->nLevel; level++){
+        int upRows = map->rows[level - 1], upCols = map->cols[level - 1];
+        for(int r = 0; r < map->rows[level]; r++){
+            int r0 = 2 * r, r1 = 2 * r + 1 < upRows ? 2 * r + 1 : upRows - 1;
+            for(int c = 0; c < map->cols[level]; c++){
+                int c0 = 2 * c, c1 = 2 * c + 1 < upCols ? 2 * c + 1 : upCols - 1;
+                Color *a = texture_texel(map, level - 1, r0, c0);
+                Color *b = texture_texel(map, level - 1, r0, c1);
+                Color *d = texture_texel(map, level - 1, r1, c0);
+                Color *e = texture_texel(map, level - 1, r1, c1);
+                Color *t = texture_texel(map, level, r, c);
+                for(int i = 0; i < 3; i++){
+                    t->c[i] = 0.25 * (a->c[i] + b->c[i] + d->c[i] + e->c[i]);
+                }
+            }
+        }
+    }
+
+    map->refs = 1;
+    map->name = NULL;
+    map->next = NULL;
+    return map;
+}
+
+// return the texture map for a PPM file, reading it only if no one holds it yet
+// the caller owns one reference to the map and gives it back with texture_release
+TextureMap *texture_read(char *filename){
+    if(filename == NULL){
+        fprintf(stderr, "Invalid texture file name.\n");
+        return NULL;
+    }
+
+    pthread_mutex_lock(&texture_lock);
+    for(TextureMap *map = texture_cache; map != NULL; map = map->next){
+        if(strcmp(map->name, filename) == 0){
+            map->refs++;
+            pthread_mutex_unlock(&texture_lock);
+            return map;
+        }
+    }
+    pthread_mutex_unlock(&texture_lock);
+
+    Image *src = image_read(filename);
+    if(src == NULL){
+        return NULL;
+    }
+    TextureMap *map = texture_create(src);
+    image_free(src);
+    if(map == NULL){
+        return NULL;
+    }
+    map->name = strdup(filename);
+    if(map->name == NULL){
+        fprintf(stderr, "Unable to allocate memory for texture name.\n");
+        return map;
+    }
+
+    // another thread may have read the same file in the meantime
+    pthread_mutex_lock(&texture_lock);
+    for(TextureMap *other = texture_cache; other != NULL; other = other->next){
+        if(strcmp(other->name, filename) == 0){
+            other->refs++;
+            pthread_mutex_unlock(&texture_lock);
+            free(map->name);
+            map->name = NULL;
+            texture_release(map);
+            return other;
+        }
+    }
+    map->next = texture_cache;
+    texture_cache = map;
+    pthread_mutex_unlock(&texture_lock);
+    return map;
+}
+
+// add a reference to the map
+void texture_retain(TextureMap *map){
+    if(map == NULL){
+        return;
+    }
+
+    pthread_mutex_lock(&texture_lock);
+    map->refs++;
+    pthread_mutex_unlock(&texture_lock);
+}
+
+// drop a reference to the map, freeing it, and taking it out of the cache, when it was the last one
+void texture_release(TextureMap *map){
+    if(map == NULL){
+        return;
+    }
+
+    pthread_mutex_lock(&texture_lock);
+    int refs = --map->refs;
+    if(refs == 0 && map->name != NULL){
+        for(TextureMap **link = &texture_cache; *link != NULL; link = &(*link)->next){
+            if(*link == map){
+                *link = map->next;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&texture_lock);
+
+    if(refs == 0){
+        free(map->texel[0]);
+        free(map->name);
+        free(map);
+    }
+}
+
+// wrap a texel index into [0, n)
+static inline int texture_wrap(int i, int n){
+    i %= n;
+    return i < 0 ? i + n : i;
+}
+
+// bilinear sample of one level at texture coordinates already wrapped into [0, 1)
+static void texture_bilinear(TextureMap *map, int level, float s, float t, Color *c){
+    int rows = map->rows[level], cols = map->cols[level];
+    float x = s * cols - 0.5f, y = t * rows - 0.5f;
+    int x0 = (int)floorf(x), y0 = (int)floorf(y);
+    float fx = x - x0, fy = y - y0;
+    int c0 = texture_wrap(x0, cols), c1 = texture_wrap(x0 + 1, cols);
+    int r0 = texture_wrap(y0, rows), r1 = texture_wrap(y0 + 1, rows);
+
+    Color *a = texture_texel(map, level, r0, c0);
+    Color *b = texture_texel(map, level, r0, c1);
+    Color *d = texture_texel(map, level, r1, c0);
+    Color *e = texture_texel(map, level, r1, c1);
+    for(int i = 0; i < 3; i++){
+        float top = a->c[i] + fx * (b->c[i] - a->c[i]);
+        float bottom = d->c[i] + fx * (e->c[i] - d->c[i]);
+        c->c[i] = top + fy * (bottom - top);
+    }
+}
+
+// the color of the texture at (s, t), filtered for a pixel footprint of the given level of detail
+// lod is the base 2 log of the footprint in texels; at or below 0 the full-size level is sampled bilinearly,
+// above it the two nearest levels are sampled and blended (trilinear filtering)
+void texture_sample(TextureMap *map, float s, float t, float lod, Color *c){
+    if(map == NULL || c == NULL){
+        fprintf(stderr, "Invalid texture or color.\n");
+        return;
+    }
+
+    s -= floorf(s);
+    t -= floorf(t);
+    if(!(lod > 0)){
+        texture_bilinear(map, 0, s, t, c);
+        return;
+    }
+    if(lod >= map->nLevel - 1){
+        texture_bilinear(map, map->nLevel - 1, s, t, c);
+        return;
+    }
+
+    int level = (int)lod;
+    float f = lod - level;
+    Color fine, coarse;
+    texture_bilinear(map, level, s, t, &fine);
+    texture_bilinear(map, level + 1, s, t, &coarse);
+    for(int i = 0; i < 3; i++){
+        c->c[i] = fine.c[i] + f * (coarse.c[i] - fine.c[i]);
+    }
+}
+
+// level of detail for a pixel whose texture coordinates change by (dsdx, dtdx) to the next column
+// and (dsdy, dtdy) to the next row: the base 2 log of the longer side of its footprint in full-size texels
+float texture_lod(TextureMap *map, float dsdx, float dtdx, float dsdy, float dtdy){
+    float w = map->cols[0], h = map->rows[0];
+    float x = dsdx * dsdx * w * w + dtdx * dtdx * h * h;
+    float y = dsdy * dsdy * w * w + dtdy * dtdy * h * h;
+    float rho = x > y ? x : y;
+    if(rho <= 0){
+        return 0.0;
+    }
+    return 0.5f * log2f(rho);
+}
@@ -0,0 +1,654 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "parse.h"
+#include "wavefront.h"
+
+// files smaller than this are parsed on the calling thread
+#define WAVEFRONT_CHUNK_MIN (1 << 20)
+#define WAVEFRONT_NAME 64
+// marks a face corner without a normal index
+#define WAVEFRONT_NONE INT32_MIN
+
+// a material from an mtllib file
+typedef struct{
+    char name[WAVEFRONT_NAME];
+    Color kd; // diffuse color, used as the body color
+    Color ks; // specular color, used as the surface color
+    float ns; // specular exponent, used as the surface coefficient
+    int hasKd, hasKs, hasNs;
+}WavefrontMaterial;
+
+// the part of the file one thread parses, and what it found there
+typedef struct{
+    const char *start, *end;
+    Point *vertex;
+    int nVertex, vertexCap;
+    Vector *normal;
+    int nNormal, normalCap;
+    int *corner; // per triangle: vertex and normal index of each corner, 0 based
+    unsigned char *relative; // per triangle: bit k set if corner[k] counts back from this chunk
+    int *material; // per triangle: slot in mtlName, or -1 for the material the previous chunk ended with
+    int nTriangle, triangleCap;
+    char (*mtlName)[WAVEFRONT_NAME]; // usemtl names in the order they appear
+    int nMtl, mtlCap;
+    char mtllib[256]; // first mtllib line in the chunk
+    int error;
+}WavefrontChunk;
+
+// parse a signed integer at *pp; returns -1 if there is none
+static int wavefront_int(const char **pp, const char *end, long *v){
+    const char *p = *pp;
+    int neg = 0;
+    long x = 0;
+
+    if(p < end && (*p == '-' || *p == '+')){
+        neg = *p == '-';
+        p++;
+    }
+    if(p == end || *p < '0' || *p > '9'){
+        return -1;
+    }
+    while(p < end && *p >= '0' && *p <= '9'){
+        if(x < INT32_MAX){
+            x = x * 10 + (*p - '0');
+        }
+        p++;
+    }
+    *v = neg ? -x : x;
+    *pp = p;
+    return 0;
+}
+
+// copy the rest of the line, trimmed, into name
+static void wavefront_name(const char *p, const char *end, char *name, size_t size){
+    while(p < end && (*p == ' ' || *p == '\t')){
+        p++;
+    }
+    size_t len = 0;
+    while(p + len < end && p[len] != '\r' && p[len] != '\n'){
+        len++;
+    }
+    while(len > 0 && (p[len - 1] == ' ' || p[len - 1] == '\t')){
+        len--;
+    }
+    if(len >= size){
+        len = size - 1;
+    }
+    memcpy(name, p, len);
+    name[len] = '\0';
+}
+
+// make room for one more entry in a chunk array, doubling it when full
+static int wavefront_grow(void **array, int count, int *cap, size_t size){
+    if(count < *cap){
+        return 0;
+    }
+    int newCap = *cap > 0 ? 2 * *cap : 1024;
+    void *grown = realloc(*array, (size_t)newCap * size);
+    if(grown == NULL){
+        return -1;
+    }
+    *array = grown;
+    *cap = newCap;
+    return 0;
+}
+
+// record a face corner index: positive indices count from the start of the file,
+// negative ones count back from the current position within this chunk
+static void wavefront_corner(long index, int count, int *out, unsigned char *relative, int bit){
+    if(index > 0){
+        *out = (int)(index - 1);
+    }else{
+        *out = count + (int)index;
+        *relative |= 1 << bit;
+    }
+}
+
+// add one fan triangle to the chunk
+static int wavefront_triangle(WavefrontChunk *c, int *v, int *n, unsigned char *rel, int *k, int material){
+    if(wavefront_grow((void**)&c->corner, c->nTriangle, &c->triangleCap, 6 * sizeof(int)) != 0){
+        return -1;
+    }
+    int cap = c->triangleCap;
+    void *grown = realloc(c->relative, cap);
+    if(grown == NULL){
+        return -1;
+    }
+    c->relative = grown;
+    grown = realloc(c->material, cap * sizeof(int));
+    if(grown == NULL){
+        return -1;
+    }
+    c->material = grown;
+
+    int *corner = &c->corner[6 * c->nTriangle];
+    unsigned char bits = 0;
+    for(int i = 0; i < 3; i++){
+        corner[2 * i] = v[k[i]];
+        corner[2 * i + 1] = n[k[i]];
+        bits |= ((rel[k[i]] & 1) << (2 * i)) | (((rel[k[i]] >> 1) & 1) << (2 * i + 1));
+    }
+    c->relative[c->nTriangle] = bits;
+    c->material[c->nTriangle] = material;
+    c->nTriangle++;
+    return 0;
+}
+
+// parse the lines of one chunk
+static void *wavefront_parse(void *arg){
+    WavefrontChunk *c = arg;
+    const char *p = c->start;
+    const char *end = c->end;
+    int material = -1;
+
+    while(p < end && !c->error){
+        const char *eol = memchr(p, '\n', end - p);
+        if(eol == NULL){
+            eol = end;
+        }
+        while(p < eol && (*p == ' ' || *p == '\t')){
+            p++;
+        }
+
+        if(eol - p > 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')){
+            double x[3] = {0.0, 0.0, 0.0};
+            const char *q = p + 2;
+            for(int i = 0; i < 3; i++){
+                if(parse_number(&q, eol, &x[i]) != 0){
+                    c->error = 1;
+                }
+            }
+            if(wavefront_grow((void**)&c->vertex, c->nVertex, &c->vertexCap, sizeof(Point)) != 0){
+                c->error = 1;
+                break;
+            }
+            point_set3D(&c->vertex[c->nVertex++], x[0], x[1], x[2]);
+        }else if(eol - p > 3 && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t')){
+            double x[3] = {0.0, 0.0, 0.0};
+            const char *q = p + 3;
+            for(int i = 0; i < 3; i++){
+                if(parse_number(&q, eol, &x[i]) != 0){
+                    c->error = 1;
+                }
+            }
+            if(wavefront_grow((void**)&c->normal, c->nNormal, &c->normalCap, sizeof(Vector)) != 0){
+                c->error = 1;
+                break;
+            }
+            vector_set(&c->normal[c->nNormal++], x[0], x[1], x[2]);
+        }else if(eol - p > 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')){
+            // corners are v, v/vt, v//vn or v/vt/vn; the polygon is fanned from its first corner
+            const char *q = p + 2;
+            int v[3], n[3];
+            unsigned char rel[3];
+            int count = 0;
+            while(1){
+                while(q < eol && (*q == ' ' || *q == '\t' || *q == '\r')){
+                    q++;
+                }
+                if(q >= eol){
+                    break;
+                }
+                long index;
+                int slot = count < 3 ? count : 2;
+                rel[slot] = 0;
+                if(wavefront_int(&q, eol, &index) != 0 || index == 0){
+                    c->error = 1;
+                    break;
+                }
+                wavefront_corner(index, c->nVertex, &v[slot], &rel[slot], 0);
+                n[slot] = WAVEFRONT_NONE;
+                if(q < eol && *q == '/'){
+                    q++;
+                    long skip;
+                    wavefront_int(&q, eol, &skip);
+                    if(q < eol && *q == '/'){
+                        q++;
+                        if(wavefront_int(&q, eol, &index) != 0 || index == 0){
+                            c->error = 1;
+                            break;
+                        }
+                        wavefront_corner(index, c->nNormal, &n[slot], &rel[slot], 1);
+                    }
+                }
+                if(count >= 2){
+                    int k[3] = {0, 1, 2};
+                    if(wavefront_triangle(c, v, n, rel, k, material) != 0){
+                        c->error = 1;
+                        break;
+                    }
+                    // the last corner becomes the second corner of the next fan triangle
+                    v[1] = v[2];
+                    n[1] = n[2];
+                    rel[1] = rel[2];
+                }
+                count++;
+            }
+        }else if(eol - p > 7 && strncmp(p, "usemtl", 6) == 0 && (p[6] == ' ' || p[6] == '\t')){
+            char name[WAVEFRONT_NAME];
+            wavefront_name(p + 7, eol, name, sizeof(name));
+            material = -1;
+            for(int i = 0; i < c->nMtl; i++){
+                if(strcmp(c->mtlName[i], name) == 0){
+                    material = i;
+                }
+            }
+            if(material < 0){
+                if(wavefront_grow((void**)&c->mtlName, c->nMtl, &c->mtlCap, WAVEFRONT_NAME) != 0){
+                    c->error = 1;
+                    break;
+                }
+                strcpy(c->mtlName[c->nMtl], name);
+                material = c->nMtl++;
+            }
+        }else if(eol - p > 7 && strncmp(p, "mtllib", 6) == 0 && (p[6] == ' ' || p[6] == '\t') && c->mtllib[0] == '\0'){
+            wavefront_name(p + 7, eol, c->mtllib, sizeof(c->mtllib));
+        }
+
+        p = eol + 1;
+    }
+    return NULL;
+}
+
+// read the materials of an mtllib file; returns the number read, 0 if the file is missing
+static int wavefront_mtllib(char *filename, WavefrontMaterial **material){
+    FILE *fp = fopen(filename, "r");
+    if(fp == NULL){
+        fprintf(stderr, "Unable to open material library %s.\n", filename);
+        return 0;
+    }
+
+    char line[512];
+    int n = 0, cap = 0;
+    WavefrontMaterial *m = NULL;
+    while(fgets(line, sizeof(line), fp) != NULL){
+        const char *p = line;
+        const char *end = line + strlen(line);
+        while(p < end && (*p == ' ' || *p == '\t')){
+            p++;
+        }
+        if(strncmp(p, "newmtl", 6) == 0){
+            if(wavefront_grow((void**)&m, n, &cap, sizeof(WavefrontMaterial)) != 0){
+                break;
+            }
+            memset(&m[n], 0, sizeof(WavefrontMaterial));
+            wavefront_name(p + 6, end, m[n].name, sizeof(m[n].name));
+            n++;
+        }else if(n > 0 && (strncmp(p, "Kd", 2) == 0 || strncmp(p, "Ks", 2) == 0)){
+            double x[3] = {0.0, 0.0, 0.0};
+            const char *q = p + 2;
+            for(int i = 0; i < 3; i++){
+                parse_number(&q, end, &x[i]);
+            }
+            if(p[1] == 'd'){
+                color_set(&m[n - 1].kd, x[0], x[1], x[2]);
+                m[n - 1].hasKd = 1;
+            }else{
+                color_set(&m[n - 1].ks, x[0], x[1], x[2]);
+                m[n - 1].hasKs = 1;
+            }
+        }else if(n > 0 && strncmp(p, "Ns", 2) == 0){
+            double x;
+            const char *q = p + 2;
+            if(parse_number(&q, end, &x) == 0){
+                m[n - 1].ns = x;
+                m[n - 1].hasNs = 1;
+            }
+        }
+    }
+
+    fclose(fp);
+    *material = m;
+    return n;
+}
+
+// add a mesh to the tail of the module without copying it
+static void wavefront_insert(Module *md, Mesh *mesh){
+    Element *e = element_create();
+    if(e == NULL){
+        mesh_free(mesh);
+        return;
+    }
+    e->type = ObjMesh;
+    e->obj = mesh;
+    module_insert(md, e);
+}
+
+// build a mesh from the triangles in group, giving each distinct vertex/normal pair its own
+// mesh vertex so only the vertices the group uses are kept
+// the groups do not share the file's arrays: a mesh owns and frees its arrays, and module_drawMesh
+// transforms every vertex of a mesh, so a group pointing at all of them would transform the whole file
+static Mesh *wavefront_mesh(Point *vertex, Vector *normal, int *corner, int *group, int nGroup){
+    Mesh *mesh = mesh_create();
+    if(mesh == NULL){
+        return NULL;
+    }
+
+    // open addressing table from (vertex, normal) pairs to mesh vertices
+    int tableSize = 1;
+    while(tableSize < 6 * nGroup + 16){
+        tableSize <<= 1;
+    }
+    int64_t *key = (int64_t*)malloc(tableSize * sizeof(int64_t));
+    int *value = (int*)malloc(tableSize * sizeof(int));
+    int hasNormal = normal != NULL;
+    mesh->vertex = (Point*)malloc(3 * (size_t)nGroup * sizeof(Point));
+    mesh->normal = hasNormal ? (Vector*)malloc(3 * (size_t)nGroup * sizeof(Vector)) : NULL;
+    mesh->index = (int*)malloc(3 * (size_t)nGroup * sizeof(int));
+    if(key == NULL || value == NULL || (nGroup > 0 && (mesh->vertex == NULL || mesh->index == NULL)) ||
+       (hasNormal && nGroup > 0 && mesh->normal == NULL)){
+        fprintf(stderr, "Failed to allocate memory for OBJ mesh.\n");
+        free(key);
+        free(value);
+        mesh_free(mesh);
+        return NULL;
+    }
+    for(int i = 0; i < tableSize; i++){
+        key[i] = -1;
+    }
+
+    for(int t = 0; t < nGroup; t++){
+        int *c = &corner[6 * group[t]];
+        for(int k = 0; k < 3; k++){
+            int v = c[2 * k];
+            int n = hasNormal ? c[2 * k + 1] : -1;
+            int64_t pair = ((int64_t)v << 32) | (uint32_t)(n + 1);
+            uint32_t h = (uint32_t)((pair * 0x9E3779B97F4A7C15ull) >> 32) & (tableSize - 1);
+            while(key[h] != -1 && key[h] != pair){
+                h = (h + 1) & (tableSize - 1);
+            }
+            if(key[h] == -1){
+                key[h] = pair;
+                value[h] = mesh->nVertex;
+                mesh->vertex[mesh->nVertex] = vertex[v];
+                if(hasNormal){
+                    if(n >= 0){
+                        mesh->normal[mesh->nVertex] = normal[n];
+                    }else{
+                        vector_set(&mesh->normal[mesh->nVertex], 0.0, 0.0, 0.0);
+                    }
+                }
+                mesh->nVertex++;
+            }
+            mesh->index[3 * t + k] = value[h];
+        }
+    }
+    mesh->nTriangle = nGroup;
+
+    free(key);
+    free(value);
+    return mesh;
+}
+
+// read a Wavefront OBJ file and add its geometry to the tail of the module
+// the file is memory mapped and split at line boundaries into chunks parsed by nThreads threads
+// (0 or less for one per processor); v, vn and f lines are used, with polygons fan triangulated
+// and negative indices counted back from the line they appear on
+// faces are grouped by usemtl material into one mesh each, in order of first use, and a material
+// found in the mtllib file is applied first with module_bodyColor, module_surfaceColor and
+// module_surfaceCoeff from its Kd, Ks and Ns; after the first material that sets any of them,
+// what a material does not give is set to the draw state default
+// returns 0 on success, -1 if the file could not be read or is malformed
+int module_wavefront(Module *md, char *filename, int nThreads){
+    if(md == NULL || filename == NULL){
+        fprintf(stderr, "Invalid module or filename.\n");
+        return -1;
+    }
+
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0){
+        fprintf(stderr, "Unable to open %s.\n", filename);
+        return -1;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0){
+        fprintf(stderr, "Unable to read %s.\n", filename);
+        close(fd);
+        return -1;
+    }
+    size_t size = st.st_size;
+    const char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED){
+        fprintf(stderr, "Unable to map %s.\n", filename);
+        return -1;
+    }
+
+    if(nThreads <= 0){
+        nThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if(nThreads <= 0){
+            nThreads = 1;
+        }
+    }
+    if((size_t)nThreads > size / WAVEFRONT_CHUNK_MIN + 1){
+        nThreads = (int)(size / WAVEFRONT_CHUNK_MIN + 1);
+    }
+
+    // split at line boundaries
+    WavefrontChunk *chunk = (WavefrontChunk*)calloc(nThreads, sizeof(WavefrontChunk));
+    pthread_t *threads = (pthread_t*)malloc(nThreads * sizeof(pthread_t));
+    if(chunk == NULL || threads == NULL){
+        fprintf(stderr, "Unable to allocate memory for OBJ parsing.\n");
+        free(chunk);
+        free(threads);
+        munmap((void*)data, size);
+        return -1;
+    }
+    const char *p = data;
+    for(int i = 0; i < nThreads; i++){
+        const char *end = i == nThreads - 1 ? data + size : data + size / nThreads * (i + 1);
+        if(end < p){
+            end = p;
+        }
+        const char *eol = end < data + size ? memchr(end, '\n', data + size - end) : NULL;
+        chunk[i].start = p;
+        chunk[i].end = i == nThreads - 1 || eol == NULL ? data + size : eol + 1;
+        p = chunk[i].end;
+    }
+
+    // chunk 0 is parsed on the calling thread, and any chunk whose thread fails to start after it
+    unsigned char *started = (unsigned char*)calloc(nThreads, 1);
+    for(int i = 1; i < nThreads && started != NULL; i++){
+        started[i] = pthread_create(&threads[i], NULL, wavefront_parse, &chunk[i]) == 0;
+    }
+    wavefront_parse(&chunk[0]);
+    for(int i = 1; i < nThreads; i++){
+        if(started != NULL && started[i]){
+            pthread_join(threads[i], NULL);
+        }else{
+            wavefront_parse(&chunk[i]);
+        }
+    }
+    free(started);
+    free(threads);
+    munmap((void*)data, size);
+
+    // merge the chunks into shared arrays with global indices
+    int status = 0;
+    int nVertex = 0, nNormal = 0, nTriangle = 0;
+    for(int i = 0; i < nThreads; i++){
+        if(chunk[i].error){
+            fprintf(stderr, "Malformed OBJ data in %s.\n", filename);
+            status = -1;
+        }
+        nVertex += chunk[i].nVertex;
+        nNormal += chunk[i].nNormal;
+        nTriangle += chunk[i].nTriangle;
+    }
+
+    Point *vertex = (Point*)malloc((nVertex > 0 ? nVertex : 1) * sizeof(Point));
+    Vector *normal = nNormal > 0 ? (Vector*)malloc(nNormal * sizeof(Vector)) : NULL;
+    int *corner = (int*)malloc((nTriangle > 0 ? 6 * (size_t)nTriangle : 1) * sizeof(int));
+    int *material = (int*)malloc((nTriangle > 0 ? nTriangle : 1) * sizeof(int));
+    char (*name)[WAVEFRONT_NAME] = NULL;
+    int nName = 0, nameCap = 0;
+    if(vertex == NULL || (nNormal > 0 && normal == NULL) || corner == NULL || material == NULL){
+        fprintf(stderr, "Unable to allocate memory for OBJ data.\n");
+        status = -1;
+    }
+
+    int vertexBase = 0, normalBase = 0, triangleBase = 0, current = -1;
+    for(int i = 0; i < nThreads && status == 0; i++){
+        WavefrontChunk *c = &chunk[i];
+        memcpy(&vertex[vertexBase], c->vertex, c->nVertex * sizeof(Point));
+        if(c->nNormal > 0){
+            memcpy(&normal[normalBase], c->normal, c->nNormal * sizeof(Vector));
+        }
+
+        // chunk material slots to global material numbers
+        int *slot = (int*)malloc((c->nMtl > 0 ? c->nMtl : 1) * sizeof(int));
+        if(slot == NULL){
+            status = -1;
+            break;
+        }
+        for(int m = 0; m < c->nMtl; m++){
+            slot[m] = -1;
+            for(int j = 0; j < nName; j++){
+                if(strcmp(name[j], c->mtlName[m]) == 0){
+                    slot[m] = j;
+                }
+            }
+            if(slot[m] < 0){
+                if(wavefront_grow((void**)&name, nName, &nameCap, WAVEFRONT_NAME) != 0){
+                    status = -1;
+                    break;
+                }
+                strcpy(name[nName], c->mtlName[m]);
+                slot[m] = nName++;
+            }
+        }
+
+        for(int t = 0; t < c->nTriangle && status == 0; t++){
+            int *in = &c->corner[6 * t];
+            int *out = &corner[6 * (triangleBase + t)];
+            for(int k = 0; k < 6; k++){
+                int base = k % 2 == 0 ? vertexBase : normalBase;
+                int count = k % 2 == 0 ? nVertex : nNormal;
+                if(k % 2 == 1 && in[k] == WAVEFRONT_NONE){
+                    out[k] = -1;
+                    continue;
+                }
+                out[k] = (c->relative[t] >> k) & 1 ? base + in[k] : in[k];
+                if(out[k] < 0 || out[k] >= count){
+                    fprintf(stderr, "OBJ face uses %s %d of %d.\n", k % 2 == 0 ? "vertex" : "normal", out[k] + 1, count);
+                    status = -1;
+                    break;
+                }
+            }
+            if(c->material[t] >= 0){
+                current = slot[c->material[t]];
+            }
+            material[triangleBase + t] = current;
+        }
+        free(slot);
+
+        vertexBase += c->nVertex;
+        normalBase += c->nNormal;
+        triangleBase += c->nTriangle;
+    }
+
+    for(int i = 0; i < nThreads; i++){
+        free(chunk[i].vertex);
+        free(chunk[i].normal);
+        free(chunk[i].corner);
+        free(chunk[i].relative);
+        free(chunk[i].material);
+        free(chunk[i].mtlName);
+    }
+
+    // materials from the first mtllib, looked up next to the OBJ file
+    WavefrontMaterial *library = NULL;
+    int nLibrary = 0;
+    for(int i = 0; i < nThreads && status == 0; i++){
+        if(chunk[i].mtllib[0] != '\0'){
+            char path[1024];
+            const char *slash = strrchr(filename, '/');
+            int dirLen = slash != NULL ? (int)(slash - filename + 1) : 0;
+            snprintf(path, sizeof(path), "%.*s%s", dirLen, filename, chunk[i].mtllib);
+            nLibrary = wavefront_mtllib(path, &library);
+            break;
+        }
+    }
+    free(chunk);
+
+    // one mesh per material, in order of first use; faces before any usemtl come first
+    // the triangles are bucketed by material in one counting pass, keeping their file order in each bucket
+    int *group = (int*)malloc((nTriangle > 0 ? nTriangle : 1) * sizeof(int));
+    int *first = (int*)calloc(nName + 2, sizeof(int));
+    if(group == NULL || first == NULL){
+        status = -1;
+    }
+    for(int t = 0; t < nTriangle && status == 0; t++){
+        first[material[t] + 2]++;
+    }
+    for(int m = 0; m < nName + 1 && status == 0; m++){
+        first[m + 1] += first[m];
+    }
+    for(int t = 0; t < nTriangle && status == 0; t++){
+        group[first[material[t] + 1]++] = t;
+    }
+
+    // once a material has set the colors, every later one sets all of them, with the draw state
+    // defaults for a material missing from the library or lacking Kd, Ks or Ns, so none inherits another's
+    Color white, gray;
+    color_set(&white, 1.0, 1.0, 1.0);
+    color_set(&gray, 0.1, 0.1, 0.1);
+    int colored = 0;
+    for(int m = -1; m < nName && status == 0; m++){
+        int start = m < 0 ? 0 : first[m];
+        int nGroup = first[m + 1] - start;
+        if(nGroup == 0){
+            continue;
+        }
+
+        if(m >= 0){
+            WavefrontMaterial *found = NULL;
+            for(int j = 0; j < nLibrary; j++){
+                if(strcmp(library[j].name, name[m]) == 0){
+                    found = &library[j];
+                    break;
+                }
+            }
+            if(found != NULL && found->hasKd){
+                module_bodyColor(md, &found->kd);
+            }else if(colored){
+                module_bodyColor(md, &white);
+            }
+            if(found != NULL && found->hasKs){
+                module_surfaceColor(md, &found->ks);
+            }else if(colored){
+                module_surfaceColor(md, &gray);
+            }
+            if(found != NULL && found->hasNs){
+                module_surfaceCoeff(md, found->ns);
+            }else if(colored){
+                module_surfaceCoeff(md, 0.0);
+            }
+            colored = colored || (found != NULL && (found->hasKd || found->hasKs || found->hasNs));
+        }
+
+        Mesh *mesh = wavefront_mesh(vertex, normal, corner, &group[start], nGroup);
+        if(mesh == NULL){
+            status = -1;
+            break;
+        }
+        wavefront_insert(md, mesh);
+    }
+
+    free(group);
+    free(first);
+    free(library);
+    free(name);
+    free(vertex);
+    free(normal);
+    free(corner);
+    free(material);
+    return status;
+}
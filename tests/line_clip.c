@@ -0,0 +1,176 @@
+// line clipping test
+// lines with end points far off the image, up to a million pixels away, are drawn into an image whose
+// rows sit inside a guard border; a write past any edge lands in the border, and a pixel drawn away
+// from the true line means the clip moved the line
+//
+// usage: line_clip   exit status 1 if anything fails
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "line.h"
+
+#define ROWS 100
+#define COLS 100
+#define GUARD 2
+
+// an image of ROWS x COLS pixels whose rows point into a buffer GUARD pixels larger on every side
+typedef struct{
+    Image image;
+    FPixel *buffer;
+    FPixel *rows[ROWS];
+}GuardedImage;
+
+static const FPixel clear = {{{0, 0, 0}}, 0, 0};
+
+// set up the image and clear it, border included
+static void guarded_init(GuardedImage *g){
+    int width = COLS + 2 * GUARD;
+    g->buffer = malloc(sizeof(FPixel) * width * (ROWS + 2 * GUARD));
+    for(int i = 0; i < width * (ROWS + 2 * GUARD); i++){
+        g->buffer[i] = clear;
+    }
+    for(int r = 0; r < ROWS; r++){
+        g->rows[r] = &g->buffer[(r + GUARD) * width + GUARD];
+    }
+    image_init(&g->image);
+    g->image.rows = ROWS;
+    g->image.cols = COLS;
+    g->image.data = g->rows;
+}
+
+// clear the image and its border
+static void guarded_reset(GuardedImage *g){
+    for(int i = 0; i < (COLS + 2 * GUARD) * (ROWS + 2 * GUARD); i++){
+        g->buffer[i] = clear;
+    }
+}
+
+// the number of border pixels that were written
+static int guarded_overflow(GuardedImage *g){
+    int width = COLS + 2 * GUARD, n = 0;
+    for(int r = -GUARD; r < ROWS + GUARD; r++){
+        for(int c = -GUARD; c < COLS + GUARD; c++){
+            if(r >= 0 && r < ROWS && c >= 0 && c < COLS){
+                continue;
+            }
+            FPixel *px = &g->buffer[(r + GUARD) * width + c + GUARD];
+            n += px->c.c[0] != 0 || px->a != 0;
+        }
+    }
+    return n;
+}
+
+// the largest distance from the center of a drawn pixel to the line through (x0, y0) and (x1, y1), and the number drawn
+static double guarded_distance(GuardedImage *g, double x0, double y0, double x1, double y1, int *nDrawn){
+    double dx = x1 - x0, dy = y1 - y0, length = hypot(dx, dy);
+    double worst = 0;
+    *nDrawn = 0;
+    for(int r = 0; r < ROWS; r++){
+        for(int c = 0; c < COLS; c++){
+            if(g->rows[r][c].c.c[0] == 0){
+                continue;
+            }
+            double d = fabs((c + 0.5 - x0) * dy - (r + 0.5 - y0) * dx) / length;
+            worst = d > worst ? d : worst;
+            (*nDrawn)++;
+        }
+    }
+    return worst;
+}
+
+// random coordinate in [-scale, scale]
+static double line_random(double scale){
+    return scale * (2.0 * rand() / RAND_MAX - 1.0);
+}
+
+int main(void){
+    GuardedImage g;
+    Line l;
+    Color white = {{1, 1, 1}};
+    int failed = 0, nDrawn;
+
+    guarded_init(&g);
+    srand(5310);
+
+    // the full width of the top row, from a million pixels off each side
+    line_set2D(&l, -1e6, 0, 1e6, 0);
+    line_zBuffer(&l, 0);
+    line_draw(&l, &g.image, white);
+    double d = guarded_distance(&g, -1e6, 0.5, 1e6, 0.5, &nDrawn);
+    if(nDrawn != COLS || d > 0 || guarded_overflow(&g)){
+        printf("FAIL line_draw (-1e6, 0) to (1e6, 0): %d pixels drawn, %d outside the image\n", nDrawn, guarded_overflow(&g));
+        failed++;
+    }
+
+    // the same along the right column, and a diagonal through the corners
+    guarded_reset(&g);
+    line_set2D(&l, COLS - 0.5, 1e6, COLS - 0.5, -1e6);
+    line_zBuffer(&l, 0);
+    line_draw(&l, &g.image, white);
+    guarded_distance(&g, COLS - 0.5, 1e6, COLS - 0.5, -1e6, &nDrawn);
+    if(nDrawn != ROWS || guarded_overflow(&g)){
+        printf("FAIL line_draw along the right column: %d pixels drawn, %d outside the image\n", nDrawn, guarded_overflow(&g));
+        failed++;
+    }
+    guarded_reset(&g);
+    line_set2D(&l, -1e6, -1e6, 1e6, 1e6);
+    line_zBuffer(&l, 0);
+    line_drawDash(&l, &g.image, white, 5);
+    d = guarded_distance(&g, -1e6, -1e6, 1e6, 1e6, &nDrawn);
+    if(nDrawn < ROWS / 2 - 5 || d > 1.5 || guarded_overflow(&g)){
+        printf("FAIL line_drawDash along the diagonal: %d pixels drawn, %.2f off the line, %d outside the image\n",
+               nDrawn, d, guarded_overflow(&g));
+        failed++;
+    }
+
+    // an anti-aliased line crossing the image at a slight slope, thirty million pixels from each end
+    guarded_reset(&g);
+    line_set2D(&l, -3e7, 20, 3e7, 70);
+    line_zBuffer(&l, 0);
+    line_drawAA(&l, &g.image, white);
+    d = guarded_distance(&g, -3e7, 20, 3e7, 70, &nDrawn);
+    if(nDrawn < COLS || d > 1.5 || guarded_overflow(&g)){
+        printf("FAIL line_drawAA (-3e7, 20) to (3e7, 70): %d pixels drawn, %.2f off the line, %d outside the image\n",
+               nDrawn, d, guarded_overflow(&g));
+        failed++;
+    }
+
+    // random lines of every length; the ones that cross the middle of the image must show up on it
+    for(double scale = 1e2; scale <= 1e7; scale *= 10){
+        int nFailed = 0;
+        for(int i = 0; i < 2000; i++){
+            double x0 = line_random(scale), y0 = line_random(scale);
+            double x1 = line_random(scale), y1 = line_random(scale);
+            char *name[3] = {"line_draw", "line_drawDash", "line_drawAA"};
+            int mode = i % 3;
+            guarded_reset(&g);
+            line_set2D(&l, x0, y0, x1, y1);
+            line_zBuffer(&l, 0);
+            if(mode == 0){
+                line_draw(&l, &g.image, white);
+            }else if(mode == 1){
+                line_drawDash(&l, &g.image, white, 3);
+            }else{
+                line_drawAA(&l, &g.image, white);
+            }
+
+            double length = hypot(x1 - x0, y1 - y0);
+            double center = fabs((COLS / 2.0 - x0) * (y1 - y0) - (ROWS / 2.0 - y0) * (x1 - x0)) / length;
+            double along = ((COLS / 2.0 - x0) * (x1 - x0) + (ROWS / 2.0 - y0) * (y1 - y0)) / (length * length);
+            d = guarded_distance(&g, x0, y0, x1, y1, &nDrawn);
+            int crosses = center < ROWS / 4.0 && along > 0.01 && along < 0.99;
+            if(guarded_overflow(&g) || d > 1.5 || (crosses && nDrawn == 0)){
+                if(nFailed++ < 3){
+                    printf("FAIL %s (%g, %g) to (%g, %g): %d pixels drawn, %.2f off the line, %d outside the image\n",
+                           name[mode], x0, y0, x1, y1, nDrawn, d, guarded_overflow(&g));
+                }
+            }
+        }
+        failed += nFailed;
+        printf("%s random lines within %g pixels: %d failed\n", nFailed ? "FAIL" : "ok  ", scale, nFailed);
+    }
+
+    free(g.buffer);
+    printf("%d failed\n", failed);
+    return failed > 0;
+}
@@ -0,0 +1,861 @@
+// golden-image regression harness
+// every reference scene is drawn through module_draw and compared with its stored PPM in the golden directory,
+// then drawn through each alternate path (a reused render context, the single-precision vertex stage,
+// a scene file round trip and the threaded animation renderer) and compared with the module_draw image
+// a path that cannot draw something a scene needs, e.g. shadow maps, textures or a multisampled image,
+// skips that scene
+// a path that fails writes its image and a diff image, failing pixels in red, to the output directory
+//
+// usage: regress <golden dir> <output dir>   compare, exit status 1 if anything fails
+//        regress -g <golden dir>             write the module_draw images as the new golden images
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include "module.h"
+#include "render.h"
+#include "animation.h"
+#include "ply.h"
+#include "wavefront.h"
+#include "scene.h"
+#include "shadow.h"
+
+#define MAX_PARTS 16
+#define DATA_DIR "data" // the committed model files, relative to the tests directory
+
+// what a scene needs from a path beyond plain module_draw
+enum{
+    NeedContext = 1, // a render context the scene sets up, e.g. with shadow maps
+    NeedTextures = 2, // polygon textures, which scene files do not keep
+    NeedImage = 4 // a multisampled or supersampled image to draw into
+};
+
+// one reference scene: the tree and everything module_draw needs to draw it
+typedef struct{
+    char *name;
+    int rows, cols;
+    Module *module;
+    Module *parts[MAX_PARTS]; // submodules made for the tree, freed with it
+    int nParts;
+    Matrix VTM;
+    DrawState ds;
+    Lighting lighting;
+    ShadowCache *shadows; // shadow maps every render of the scene uses, or NULL
+    int samples; // samples per pixel of the images the scene is drawn into, 1 for none
+    int supersample; // factor the scene is drawn larger by, then filtered down, 1 for none
+    int needs; // Need bits
+}TestScene;
+
+// an alternate way of drawing a scene, with how close it has to come to module_draw
+typedef struct{
+    char *name;
+    Image *(*draw)(TestScene *t, char *outdir);
+    float tolerance; // largest channel error, in [0, 1], a pixel may have and still match
+    double minPsnr; // when some pixels do not match, the smallest PSNR, in dB, that still passes; 0 means none may differ
+    double minSsim; // and the smallest SSIM
+    int meets; // Need bits the path can draw scenes with; it skips the other scenes
+}TestPath;
+
+// a perspective view from the eye point toward the origin
+static void regress_view3D(Matrix *VTM, double ex, double ey, double ez, int rows, int cols){
+    View3D view;
+    point_set3D(&view.vrp, ex, ey, ez);
+    vector_set(&view.vpn, -ex, -ey, -ez);
+    vector_set(&view.vup, 0, 1, 0);
+    view.d = 2;
+    view.du = 1.6;
+    view.dv = 1.6 * rows / cols;
+    view.f = 0;
+    view.b = 20;
+    view.screenx = cols;
+    view.screeny = rows;
+    matrix_setView3D(VTM, &view);
+}
+
+// start a scene with the default draw state and no lights
+static void regress_begin(TestScene *t, char *name, int rows, int cols, ShadeMethod shade){
+    t->name = name;
+    t->rows = rows;
+    t->cols = cols;
+    t->module = module_create();
+    t->nParts = 0;
+    matrix_identity(&t->VTM);
+    drawstate_init(&t->ds);
+    t->ds.shade = shade;
+    lighting_init(&t->lighting);
+    t->shadows = NULL;
+    t->samples = 1;
+    t->supersample = 1;
+    t->needs = 0;
+}
+
+// a submodule of the scene, freed along with it by regress_end
+static Module *regress_module(TestScene *t){
+    Module *md = module_create();
+    if(t->nParts < MAX_PARTS){
+        t->parts[t->nParts++] = md;
+    }else{
+        fprintf(stderr, "Too many submodules in scene %s.\n", t->name);
+    }
+    return md;
+}
+
+// free the scene's tree and its submodules
+static void regress_end(TestScene *t){
+    shadow_free(t->shadows);
+    module_delete(t->module);
+    for(int i = 0; i < t->nParts; i++){
+        module_delete(t->parts[i]);
+    }
+}
+
+// 2D polygons, polylines, lines and points under 2D transforms, filled
+static void scene_wings2D(TestScene *t, ShadeMethod shade, char *name){
+    Color c;
+    Point p[4];
+    regress_begin(t, name, 200, 250, shade);
+    View2D view;
+    Point vrp;
+    Vector x;
+    point_set2D(&vrp, 0, 0);
+    vector_set(&x, 1, 0, 0);
+    view2D_set(&view, &vrp, 4, &x, 250, 200);
+    matrix_setView2D(&t->VTM, &view);
+
+    Module *wing = regress_module(t);
+    point_set2D(&p[0], 0, 0);
+    point_set2D(&p[1], 1, 0.1);
+    point_set2D(&p[2], 1, 0.3);
+    point_set2D(&p[3], 0, 0.4);
+    Polygon *polygon = polygon_createp(4, p);
+    color_set(&c, 0.8, 0.2, 0.2);
+    module_color(wing, &c);
+    module_polygon(wing, polygon);
+    polygon_free(polygon);
+    Polyline *polyline = polyline_createp(4, p);
+    color_set(&c, 0.2, 0.9, 0.2);
+    module_color(wing, &c);
+    module_polyline(wing, polyline);
+    polyline_free(polyline);
+    Line line;
+    line_set2D(&line, -0.5, -0.5, 0.7, 0.3);
+    line_zBuffer(&line, 0);
+    module_line(wing, &line);
+
+    for(int i = 0; i < 12; i++){
+        module_identity(t->module);
+        module_scale2D(t->module, 0.5 + 0.1 * i, 0.5 + 0.05 * i);
+        module_rotateZ(t->module, cos(i * 0.5), sin(i * 0.5));
+        module_translate2D(t->module, -1.5 + 0.25 * i, -1 + 0.15 * i);
+        module_module(t->module, wing);
+    }
+    module_identity(t->module);
+    color_set(&c, 1, 1, 1);
+    module_color(t->module, &c);
+    for(int i = 0; i < 50; i++){
+        Point q;
+        point_set2D(&q, -2 + 4.0 * ((i * 37) % 100) / 100, -1.5 + 3.0 * ((i * 61) % 100) / 100);
+        module_point(t->module, &q);
+    }
+}
+
+static void scene_wings(TestScene *t){
+    scene_wings2D(t, ShadeConstant, "wings");
+}
+
+static void scene_wingsFrame(TestScene *t){
+    scene_wings2D(t, ShadeFrame, "wingsframe");
+}
+
+// a row of cubes in perspective, in the given shading
+static void scene_cubes3D(TestScene *t, ShadeMethod shade, char *name){
+    Color c;
+    regress_begin(t, name, 150, 200, shade);
+    regress_view3D(&t->VTM, 3, 2, -4, 150, 200);
+    if(shade == ShadeFlat){
+        lighting_add(&t->lighting, LightAmbient, &(Color){{0.3, 0.3, 0.3}}, NULL, NULL, 0, 0);
+        lighting_add(&t->lighting, LightPoint, &(Color){{0.8, 0.8, 0.8}}, NULL, &(Point){{2, 4, -3, 1}}, 0, 0);
+        point_set3D(&t->ds.viewer, 3, 2, -4);
+    }
+
+    Module *cube = regress_module(t);
+    module_cube(cube, 1);
+    for(int i = 0; i < 8; i++){
+        module_identity(t->module);
+        color_set(&c, 0.2 + 0.1 * i, 0.9 - 0.1 * i, 0.5);
+        module_color(t->module, &c);
+        module_bodyColor(t->module, &c);
+        module_scale(t->module, 0.6, 0.6, 0.6);
+        module_rotateY(t->module, cos(i), sin(i));
+        module_rotateX(t->module, cos(i * 0.3), sin(i * 0.3));
+        module_translate(t->module, -1.5 + 0.45 * i, -0.5 + 0.15 * i, -1 + 0.3 * i);
+        module_module(t->module, cube);
+    }
+}
+
+static void scene_cubes(TestScene *t){
+    scene_cubes3D(t, ShadeConstant, "cubes");
+}
+
+static void scene_cubesDepth(TestScene *t){
+    scene_cubes3D(t, ShadeDepth, "cubesdepth");
+}
+
+static void scene_cubesFlat(TestScene *t){
+    scene_cubes3D(t, ShadeFlat, "cubesflat");
+}
+
+// wireframe cubes
+static void scene_wire(TestScene *t){
+    regress_begin(t, "wire", 150, 200, ShadeFrame);
+    regress_view3D(&t->VTM, 3, 2, -4, 150, 200);
+    Module *wire = regress_module(t);
+    module_cube(wire, 0);
+    module_rotateY(t->module, cos(0.4), sin(0.4));
+    module_module(t->module, wire);
+    module_translate(t->module, 1.2, 0, 0);
+    module_module(t->module, wire);
+}
+
+// a Gouraud-shaded sphere and cylinder under an ambient and a point light
+static void scene_sphere(TestScene *t){
+    Color c;
+    Light light;
+    Point position;
+    regress_begin(t, "sphere", 160, 160, ShadeGouraud);
+    regress_view3D(&t->VTM, 0, 1.5, -5, 160, 160);
+    point_set3D(&t->ds.viewer, 0, 1.5, -5);
+
+    light_init(&light);
+    color_set(&c, 0.2, 0.2, 0.2);
+    light_set(&light, LightAmbient, &c, NULL, NULL, 0, 0);
+    module_addLight(t->module, &light);
+    point_set3D(&position, 2, 3, -4);
+    color_set(&c, 0.9, 0.9, 0.8);
+    light_set(&light, LightPoint, &c, NULL, &position, 0, 0);
+    module_addLight(t->module, &light);
+    color_set(&c, 0.7, 0.3, 0.2);
+    module_bodyColor(t->module, &c);
+    color_set(&c, 0.3, 0.3, 0.3);
+    module_surfaceColor(t->module, &c);
+    module_surfaceCoeff(t->module, 20);
+
+    Module *sphere = regress_module(t);
+    module_sphere(sphere, 24, 12);
+    module_translate(t->module, -0.8, 0, 0);
+    module_module(t->module, sphere);
+    Module *cylinder = regress_module(t);
+    module_cylinder(cylinder, 16);
+    module_identity(t->module);
+    module_scale(t->module, 0.5, 1, 0.5);
+    module_translate(t->module, 1.0, -0.5, 0);
+    module_module(t->module, cylinder);
+}
+
+// a cone on a cylinder in depth shading
+static void scene_cone(TestScene *t){
+    regress_begin(t, "conedepth", 160, 160, ShadeDepth);
+    regress_view3D(&t->VTM, 0, 1.5, -5, 160, 160);
+    Module *cone = regress_module(t);
+    module_cone(cone, 20);
+    Module *cylinder = regress_module(t);
+    module_cylinder(cylinder, 16);
+    module_module(t->module, cone);
+    module_translate(t->module, 0, -1, 0);
+    module_module(t->module, cylinder);
+}
+
+// a Bezier curve and the control nets of a subdivided Bezier surface
+static void scene_bezier(TestScene *t){
+    Color c;
+    Point cp[4], sp[16];
+    regress_begin(t, "bezier", 160, 160, ShadeFrame);
+    regress_view3D(&t->VTM, 0, 2, -5, 160, 160);
+
+    BezierCurve curve;
+    bezierCurve_init(&curve);
+    point_set3D(&cp[0], -1, 0, 0);
+    point_set3D(&cp[1], -0.5, 1.5, 0);
+    point_set3D(&cp[2], 0.5, -1.5, 0.5);
+    point_set3D(&cp[3], 1, 0.5, 0);
+    bezierCurve_set(&curve, cp);
+    color_set(&c, 1, 1, 0);
+    module_color(t->module, &c);
+    module_bezierCurve(t->module, &curve, 3);
+
+    BezierSurface surface;
+    bezierSurface_init(&surface);
+    for(int i = 0; i < 4; i++){
+        for(int j = 0; j < 4; j++){
+            point_set3D(&sp[i * 4 + j], i / 3.0 - 0.5, (i == 1 || i == 2) && (j == 1 || j == 2) ? 0.6 : 0, j / 3.0 - 0.5);
+        }
+    }
+    bezierSurface_set(&surface, sp);
+    color_set(&c, 0, 1, 1);
+    module_color(t->module, &c);
+    module_bezierSurface(t->module, &surface, 2, 0);
+}
+
+// two adaptively tessellated Bezier patches in Gouraud shading, the second running the other way along their shared side
+static void scene_patches(TestScene *t){
+    Color c;
+    Point sp[16];
+    regress_begin(t, "patches", 160, 200, ShadeGouraud);
+    regress_view3D(&t->VTM, 0.4, 2, -2.6, 160, 200);
+    point_set3D(&t->ds.viewer, 0.4, 2, -2.6);
+    lighting_add(&t->lighting, LightAmbient, &(Color){{0.2, 0.2, 0.2}}, NULL, NULL, 0, 0);
+    lighting_add(&t->lighting, LightPoint, &(Color){{0.8, 0.8, 0.8}}, NULL, &(Point){{-1, 4, -3, 1}}, 0, 0);
+    color_set(&c, 0.5, 0.6, 0.8);
+    module_bodyColor(t->module, &c);
+
+    BezierSurface surface;
+    bezierSurface_init(&surface);
+    for(int i = 0; i < 4; i++){
+        for(int j = 0; j < 4; j++){
+            point_set3D(&sp[i * 4 + j], i / 2.5 - 1.2, (i == 1 || i == 2) && (j == 1 || j == 2) ? 0.8 : 0, j / 2.0 - 0.75);
+        }
+    }
+    bezierSurface_set(&surface, sp);
+    module_bezierPatch(t->module, &surface, 0.5f);
+
+    // the shared side is x = 0 in both nets, walked in opposite directions
+    for(int i = 0; i < 4; i++){
+        for(int j = 0; j < 4; j++){
+            point_set3D(&sp[i * 4 + j], 1.2 - i / 2.5, (i == 1 || i == 2) && (j == 1 || j == 2) ? -0.5 : 0, 0.75 - j / 2.0);
+        }
+    }
+    bezierSurface_set(&surface, sp);
+    module_bezierPatch(t->module, &surface, 0.5f);
+}
+
+// a solid Bezier surface evaluated on a grid, Gouraud shaded with its analytic normals
+static void scene_surface(TestScene *t){
+    Color c;
+    Point sp[16];
+    regress_begin(t, "surface", 160, 200, ShadeGouraud);
+    regress_view3D(&t->VTM, 0.8, 2.2, -2.8, 160, 200);
+    point_set3D(&t->ds.viewer, 0.8, 2.2, -2.8);
+    lighting_add(&t->lighting, LightAmbient, &(Color){{0.2, 0.2, 0.2}}, NULL, NULL, 0, 0);
+    lighting_add(&t->lighting, LightPoint, &(Color){{0.8, 0.8, 0.8}}, NULL, &(Point){{-1, 4, -3, 1}}, 0, 0);
+    color_set(&c, 0.8, 0.6, 0.4);
+    module_bodyColor(t->module, &c);
+
+    BezierSurface surface;
+    bezierSurface_init(&surface);
+    for(int i = 0; i < 4; i++){
+        for(int j = 0; j < 4; j++){
+            double y = ((i == 1 || i == 2) && (j == 1 || j == 2) ? 1.2 : 0) - (i == 0 && j == 3 ? 0.6 : 0);
+            point_set3D(&sp[i * 4 + j], i / 1.5 - 1, y, j / 1.5 - 1);
+        }
+    }
+    bezierSurface_set(&surface, sp);
+    module_bezierSurface(t->module, &surface, 3, 1);
+}
+
+// a PLY cube with corner normals, read through module_ply, shown twice in Gouraud shading
+static void scene_ply(TestScene *t){
+    Color c;
+    regress_begin(t, "ply", 150, 200, ShadeGouraud);
+    regress_view3D(&t->VTM, 2, 1.5, -4, 150, 200);
+    point_set3D(&t->ds.viewer, 2, 1.5, -4);
+    lighting_add(&t->lighting, LightAmbient, &(Color){{0.2, 0.2, 0.2}}, NULL, NULL, 0, 0);
+    lighting_add(&t->lighting, LightPoint, &(Color){{0.9, 0.9, 0.9}}, NULL, &(Point){{3, 4, -3, 1}}, 0, 0);
+
+    Module *cube = regress_module(t);
+    if(module_ply(cube, DATA_DIR "/cube.ply") != 0){
+        return;
+    }
+    color_set(&c, 0.3, 0.5, 0.8);
+    module_bodyColor(t->module, &c);
+    module_rotateY(t->module, cos(0.5), sin(0.5));
+    module_translate(t->module, -0.8, 0, 0);
+    module_module(t->module, cube);
+    color_set(&c, 0.8, 0.5, 0.3);
+    module_bodyColor(t->module, &c);
+    module_translate(t->module, 1.6, 0, 0);
+    module_module(t->module, cube);
+}
+
+// an OBJ pyramid with two materials, read through module_wavefront on two threads, in Gouraud shading
+static void scene_obj(TestScene *t){
+    regress_begin(t, "obj", 150, 200, ShadeGouraud);
+    regress_view3D(&t->VTM, 1.5, 1, -4, 150, 200);
+    point_set3D(&t->ds.viewer, 1.5, 1, -4);
+    lighting_add(&t->lighting, LightAmbient, &(Color){{0.2, 0.2, 0.2}}, NULL, NULL, 0, 0);
+    lighting_add(&t->lighting, LightPoint, &(Color){{0.9, 0.9, 0.9}}, NULL, &(Point){{-2, 4, -3, 1}}, 0, 0);
+
+    Module *pyramid = regress_module(t);
+    if(module_wavefront(pyramid, DATA_DIR "/pyramid.obj", 2) != 0){
+        return;
+    }
+    module_rotateY(t->module, cos(0.3), sin(0.3));
+    module_rotateX(t->module, cos(0.9), sin(0.9));
+    module_module(t->module, pyramid);
+}
+
+// a fleet of ships, each a body, two wings and an engine, each ship in its own color
+// drawn as instances, or as the matrix and module pairs the instances stand for
+static void scene_fleet3D(TestScene *t, int instanced, char *name){
+    Point p[4];
+    regress_begin(t, name, 150, 200, ShadeFlat);
+    regress_view3D(&t->VTM, 1, 2, -3.5, 150, 200);
+    point_set3D(&t->ds.viewer, 1, 2, -3.5);
+    lighting_add(&t->lighting, LightAmbient, &(Color){{0.3, 0.3, 0.3}}, NULL, NULL, 0, 0);
+    lighting_add(&t->lighting, LightDirect, &(Color){{0.7, 0.7, 0.7}}, &(Vector){{0.3, 1, -0.5, 0}}, NULL, 0, 0);
+
+    Module *ship = regress_module(t);
+    Module *cube = regress_module(t);
+    module_cube(cube, 1);
+    module_scale(ship, 0.2, 0.15, 0.8);
+    module_module(ship, cube);
+    module_identity(ship);
+    point_set3D(&p[0], 0.1, 0, -0.3);
+    point_set3D(&p[1], 0.6, 0.2, -0.2);
+    point_set3D(&p[2], 0.6, 0.2, 0.0);
+    point_set3D(&p[3], 0.1, 0, 0.2);
+    Polygon *wing = polygon_createp(4, p);
+    polygon_setSided(wing, 0);
+    module_polygon(ship, wing);
+    module_scale(ship, -1, 1, 1);
+    module_polygon(ship, wing);
+    polygon_free(wing);
+    Module *engine = regress_module(t);
+    module_cylinder(engine, 10);
+    module_identity(ship);
+    module_scale(ship, 0.1, 0.3, 0.1);
+    module_rotateX(ship, 0, 1);
+    module_translate(ship, 0, 0, 0.5);
+    module_module(ship, engine);
+
+    Matrix transform[12];
+    Color color[12];
+    for(int i = 0; i < 12; i++){
+        matrix_identity(&transform[i]);
+        matrix_rotateY(&transform[i], cos(0.3 * i), sin(0.3 * i));
+        matrix_translate(&transform[i], -1.5 + (i % 4), -0.5 + 0.4 * (i / 4), -0.5 + 0.8 * (i / 4));
+        color_set(&color[i], 0.4 + 0.05 * i, 0.7 - 0.04 * i, 0.3 + 0.02 * i);
+        if(!instanced){
+            module_identity(t->module);
+            module_color(t->module, &color[i]);
+            module_bodyColor(t->module, &color[i]);
+            module_insert(t->module, element_init(ObjMatrix, &transform[i]));
+            module_module(t->module, ship);
+        }
+    }
+    if(instanced){
+        module_instances(t->module, ship, 12, transform, color);
+    }
+}
+
+static void scene_fleet(TestScene *t){
+    scene_fleet3D(t, 1, "fleet");
+}
+
+static void scene_fleetPairs(TestScene *t){
+    scene_fleet3D(t, 0, "fleetpairs");
+}
+
+// a sphere and a cylinder over a floor, shadowed from a direct and a spot light through cached shadow maps
+static void scene_shadow(TestScene *t){
+    Color c;
+    regress_begin(t, "shadow", 160, 160, ShadeGouraud);
+    regress_view3D(&t->VTM, 0, 2.5, -4, 160, 160);
+    point_set3D(&t->ds.viewer, 0, 2.5, -4);
+    t->shadows = shadow_create(256, 2);
+    t->needs |= NeedContext;
+    // the default bias leaves acne on a floor this far from the direct light's map
+    shadow_setBias(t->shadows, 0.01);
+    lighting_add(&t->lighting, LightAmbient, &(Color){{0.2, 0.2, 0.2}}, NULL, NULL, 0, 0);
+    lighting_add(&t->lighting, LightDirect, &(Color){{0.5, 0.5, 0.5}}, &(Vector){{-0.4, -1, 0.3, 0}}, NULL, 0, 0);
+    lighting_add(&t->lighting, LightSpot, &(Color){{0.6, 0.6, 0.5}}, &(Vector){{-1.5, -3.5, 1, 0}},
+                 &(Point){{1.5, 3.5, -1, 1}}, 0.6, 2);
+
+    // the floor, a grid fine enough for the shadows to show in per-vertex lighting
+    enum{ N = 32 };
+    Point vertex[(N + 1) * (N + 1)];
+    Vector normal[(N + 1) * (N + 1)];
+    int index[6 * N * N];
+    for(int i = 0; i <= N; i++){
+        for(int j = 0; j <= N; j++){
+            point_set3D(&vertex[i * (N + 1) + j], -2 + 4.0 * j / N, -0.5, -2 + 4.0 * i / N);
+            vector_set(&normal[i * (N + 1) + j], 0, 1, 0);
+        }
+    }
+    for(int i = 0; i < N; i++){
+        for(int j = 0; j < N; j++){
+            int *tri = &index[6 * (i * N + j)];
+            int v = i * (N + 1) + j;
+            tri[0] = v;
+            tri[1] = v + 1;
+            tri[2] = v + N + 1;
+            tri[3] = v + 1;
+            tri[4] = v + N + 2;
+            tri[5] = v + N + 1;
+        }
+    }
+    Mesh floor;
+    mesh_init(&floor);
+    mesh_set(&floor, (N + 1) * (N + 1), vertex, 2 * N * N, index);
+    mesh_setNormals(&floor, (N + 1) * (N + 1), normal);
+    color_set(&c, 0.8, 0.8, 0.8);
+    module_bodyColor(t->module, &c);
+    module_mesh(t->module, &floor);
+    mesh_clear(&floor);
+
+    Module *sphere = regress_module(t);
+    module_sphere(sphere, 24, 12);
+    color_set(&c, 0.7, 0.3, 0.2);
+    module_bodyColor(t->module, &c);
+    module_scale(t->module, 0.5, 0.5, 0.5);
+    module_translate(t->module, -0.5, 0.2, 0);
+    module_module(t->module, sphere);
+    Module *cylinder = regress_module(t);
+    module_cylinder(cylinder, 16);
+    color_set(&c, 0.2, 0.4, 0.7);
+    module_bodyColor(t->module, &c);
+    module_identity(t->module);
+    module_scale(t->module, 0.3, 0.8, 0.3);
+    module_translate(t->module, 0.8, -0.5, 0.5);
+    module_module(t->module, cylinder);
+}
+
+// a textured square, point i of p with texture coordinates (s[i], t[i]) on map, facing -z or +y
+static void regress_texturedSquare(Module *md, Point *p, float *s, float *t, TextureMap *map, Vector *normal){
+    Polygon square;
+    Texture texture[4];
+    Vector n[4];
+    for(int i = 0; i < 4; i++){
+        texture[i].map = map;
+        texture[i].s = s[i];
+        texture[i].t = t[i];
+        n[i] = *normal;
+    }
+    polygon_init(&square);
+    polygon_set(&square, 4, p);
+    polygon_setNormals(&square, 4, n);
+    polygon_setTextures(&square, 4, texture);
+    module_polygon(md, &square);
+    polygon_clear(&square);
+}
+
+// a floor with a generated texture repeated into the distance, minified through the mip chain,
+// and a wall with a texture read from a PPM file, in Gouraud shading
+static void scene_texture(TestScene *t){
+    Point p[4];
+    Color c;
+    FPixel texel;
+    regress_begin(t, "texture", 150, 200, ShadeGouraud);
+    regress_view3D(&t->VTM, 0.5, 1, -4, 150, 200);
+    point_set3D(&t->ds.viewer, 0.5, 1, -4);
+    t->needs |= NeedTextures;
+    lighting_add(&t->lighting, LightAmbient, &(Color){{0.4, 0.4, 0.4}}, NULL, NULL, 0, 0);
+    lighting_add(&t->lighting, LightPoint, &(Color){{0.7, 0.7, 0.7}}, NULL, &(Point){{1, 3, -3, 1}}, 0, 0);
+    color_set(&c, 1, 1, 1);
+    module_bodyColor(t->module, &c);
+
+    // diagonal stripes in three colors
+    Image *stripes = image_create(32, 32);
+    for(int r = 0; r < 32; r++){
+        for(int k = 0; k < 32; k++){
+            int band = (r + k) / 4 % 3;
+            color_set(&texel.c, band == 0 ? 0.9 : 0.2, band == 1 ? 0.8 : 0.3, band == 2 ? 0.9 : 0.2);
+            texel.a = 1;
+            texel.z = 1;
+            image_setf(stripes, r, k, texel);
+        }
+    }
+    TextureMap *map = texture_create(stripes);
+    image_free(stripes);
+    point_set3D(&p[0], -3, -0.5, -2);
+    point_set3D(&p[1], 3, -0.5, -2);
+    point_set3D(&p[2], 3, -0.5, 12);
+    point_set3D(&p[3], -3, -0.5, 12);
+    regress_texturedSquare(t->module, p, (float[]){0, 6, 6, 0}, (float[]){0, 0, 14, 14}, map, &(Vector){{0, 1, 0, 0}});
+    texture_release(map);
+
+    map = texture_read(DATA_DIR "/checker.ppm");
+    point_set3D(&p[0], -0.8, -0.5, 0.5);
+    point_set3D(&p[1], 0.8, -0.5, 0.5);
+    point_set3D(&p[2], 0.8, 1.1, 0.5);
+    point_set3D(&p[3], -0.8, 1.1, 0.5);
+    regress_texturedSquare(t->module, p, (float[]){0, 2, 2, 0}, (float[]){2, 2, 0, 0}, map, &(Vector){{0, 0, -1, 0}});
+    texture_release(map);
+}
+
+// overlapping cubes anti-aliased with the given samples per pixel, or supersampled by the given factor
+static void scene_antialias(TestScene *t, int samples, int supersample, char *name){
+    Color c;
+    regress_begin(t, name, 120, 160, ShadeFlat);
+    t->samples = samples;
+    t->supersample = supersample;
+    t->needs |= NeedImage;
+    regress_view3D(&t->VTM, 2, 1.5, -3.5, 120 * supersample, 160 * supersample);
+    point_set3D(&t->ds.viewer, 2, 1.5, -3.5);
+    lighting_add(&t->lighting, LightAmbient, &(Color){{0.3, 0.3, 0.3}}, NULL, NULL, 0, 0);
+    lighting_add(&t->lighting, LightPoint, &(Color){{0.8, 0.8, 0.8}}, NULL, &(Point){{2, 4, -3, 1}}, 0, 0);
+
+    Module *cube = regress_module(t);
+    module_cube(cube, 1);
+    for(int i = 0; i < 3; i++){
+        module_identity(t->module);
+        color_set(&c, 0.3 + 0.3 * i, 0.8 - 0.25 * i, 0.4);
+        module_color(t->module, &c);
+        module_bodyColor(t->module, &c);
+        module_rotateY(t->module, cos(0.5 + i), sin(0.5 + i));
+        module_rotateX(t->module, cos(0.3 * i), sin(0.3 * i));
+        module_scale(t->module, 0.7, 0.7, 0.7);
+        module_translate(t->module, -0.5 + 0.45 * i, -0.2 + 0.2 * i, 0.3 * i);
+        module_module(t->module, cube);
+    }
+}
+
+static void scene_msaa(TestScene *t){
+    scene_antialias(t, 4, 1, "msaa");
+}
+
+static void scene_ssaa(TestScene *t){
+    scene_antialias(t, 1, 2, "ssaa");
+}
+
+// anti-aliased lines: a fan running off the image, a spiral polyline and the outlines of a solid cube
+static void scene_lineAA(TestScene *t){
+    Color c;
+    Line line;
+    Point a, b, p[40];
+    regress_begin(t, "lineaa", 150, 200, ShadeFrame);
+    regress_view3D(&t->VTM, 2, 1.5, -4, 150, 200);
+    t->ds.lineAntialiasFlag = 1;
+
+    color_set(&c, 1, 0.9, 0.3);
+    module_color(t->module, &c);
+    for(int i = 0; i < 16; i++){
+        point_set3D(&a, 0, 0, 0);
+        point_set3D(&b, 4 * cos(i * M_PI / 8), 4 * sin(i * M_PI / 8), 0.5);
+        line_set(&line, a, b);
+        module_line(t->module, &line);
+    }
+    for(int i = 0; i < 40; i++){
+        double r = 0.2 + 0.03 * i;
+        point_set3D(&p[i], r * cos(i * M_PI / 10), r * sin(i * M_PI / 10), -0.5 + 0.02 * i);
+    }
+    Polyline *spiral = polyline_createp(40, p);
+    color_set(&c, 0.3, 0.8, 1);
+    module_color(t->module, &c);
+    module_polyline(t->module, spiral);
+    polyline_free(spiral);
+
+    Module *cube = regress_module(t);
+    module_cube(cube, 1);
+    color_set(&c, 1, 0.4, 0.6);
+    module_color(t->module, &c);
+    module_rotateY(t->module, cos(0.6), sin(0.6));
+    module_translate(t->module, 0.6, -0.2, 0.4);
+    module_module(t->module, cube);
+}
+
+static void (*regress_scenes[])(TestScene *t) = {
+    scene_wings, scene_wingsFrame, scene_cubes, scene_cubesDepth, scene_cubesFlat, scene_wire,
+    scene_sphere, scene_cone, scene_bezier, scene_patches, scene_surface, scene_ply, scene_obj,
+    scene_fleet, scene_fleetPairs, scene_shadow,
+    scene_texture, scene_msaa, scene_ssaa, scene_lineAA
+};
+
+// draw md into src with the scene's view and lights and the draw state ds
+// through module_draw, or a render context of its own when the scene needs one
+static void regress_draw(TestScene *t, Module *md, DrawState *ds, Image *src){
+    if(!(t->needs & NeedContext)){
+        module_draw(md, &t->VTM, NULL, ds, &t->lighting, src);
+        return;
+    }
+    RenderContext *rc = render_create(src, &t->VTM, ds, &t->lighting);
+    if(rc == NULL){
+        return;
+    }
+    render_setShadows(rc, t->shadows);
+    module_render(md, NULL, rc);
+    render_free(rc);
+}
+
+// a new image to draw the scene into, larger by the supersampling factor and with the scene's samples per pixel
+static Image *regress_image(TestScene *t){
+    Image *src = image_create(t->rows * t->supersample, t->cols * t->supersample);
+    if(src != NULL && t->samples > 1){
+        image_setSamples(src, t->samples);
+    }
+    return src;
+}
+
+// the final rows x cols image of one made by regress_image: its samples resolved and the result filtered down
+static Image *regress_finish(TestScene *t, Image *src){
+    if(src == NULL){
+        return NULL;
+    }
+    image_resolve(src);
+    if(t->supersample > 1){
+        Image *dst = image_create(t->rows, t->cols);
+        image_downsample(src, dst, t->supersample, FilterTent);
+        image_free(src);
+        return dst;
+    }
+    return src;
+}
+
+// the reference path
+static Image *path_draw(TestScene *t, char *outdir){
+    Image *src = regress_image(t);
+    regress_draw(t, t->module, &t->ds, src);
+    return regress_finish(t, src);
+}
+
+// one render context kept for two frames, so the second frame reuses its scratch memory
+static Image *path_render(TestScene *t, char *outdir){
+    Image *src = regress_image(t);
+    RenderContext *rc = render_create(src, &t->VTM, &t->ds, &t->lighting);
+    render_setShadows(rc, t->shadows);
+    module_render(t->module, NULL, rc);
+    image_reset(src);
+    module_render(t->module, NULL, rc);
+    render_free(rc);
+    return regress_finish(t, src);
+}
+
+// vertices taken to the screen in single precision
+static Image *path_float(TestScene *t, char *outdir){
+    Image *src = regress_image(t);
+    DrawState ds = t->ds;
+    ds.floatVertexFlag = 1;
+    regress_draw(t, t->module, &ds, src);
+    return regress_finish(t, src);
+}
+
+// the tree written to a scene file and drawn from the mapped file
+static Image *path_scene(TestScene *t, char *outdir){
+    char filename[1024];
+    snprintf(filename, sizeof(filename), "%s/%s.scn", outdir, t->name);
+    if(scene_write(t->module, filename) != 0){
+        return NULL;
+    }
+    Scene *scene = scene_read(filename);
+    remove(filename);
+    if(scene == NULL){
+        return NULL;
+    }
+    Image *src = regress_image(t);
+    regress_draw(t, scene->root, &t->ds, src);
+    scene_free(scene);
+    return regress_finish(t, src);
+}
+
+// the setup of every animation frame: the scene's own view, draw state and lights
+static void regress_frame(int frame, Matrix *VTM, Matrix *GTM, DrawState *ds, Lighting *lighting, void *data){
+    TestScene *t = data;
+    matrix_copy(VTM, &t->VTM);
+    drawstate_copy(ds, &t->ds);
+    lighting_copy(lighting, &t->lighting);
+}
+
+// two identical frames rendered by two worker threads, the second one read back
+static Image *path_animation(TestScene *t, char *outdir){
+    char pattern[1024], filename[1024];
+    snprintf(pattern, sizeof(pattern), "%s/%s-frame%%d.ppm", outdir, t->name);
+    if(animation_render(t->module, t->rows, t->cols, 0, 1, regress_frame, t, pattern, 2) != 0){
+        return NULL;
+    }
+    snprintf(filename, sizeof(filename), pattern, 1);
+    Image *src = image_read(filename);
+    remove(filename);
+    snprintf(filename, sizeof(filename), pattern, 0);
+    remove(filename);
+    return src;
+}
+
+static TestPath regress_paths[] = {
+    {"render", path_render, 0.0f, 0.0, 0.0, NeedContext | NeedTextures | NeedImage},
+    {"float", path_float, 1.0f / 255, 30.0, 0.95, NeedContext | NeedTextures | NeedImage},
+    {"scene", path_scene, 0.0f, 0.0, 0.0, NeedContext | NeedImage},
+    {"animation", path_animation, 0.0f, 0.0, 0.0, NeedTextures}
+};
+
+// compare src with ref and print the result; a failure writes src and a diff image to outdir
+// returns 1 if the images match closely enough, 0 otherwise
+static int regress_check(char *scene, char *path, Image *src, Image *ref, TestPath *limits, char *outdir){
+    ImageDiff stats;
+    Image diff;
+    char filename[1024];
+
+    if(src == NULL || ref == NULL){
+        printf("FAIL %-12s %-10s no image\n", scene, path);
+        return 0;
+    }
+    if(src->rows != ref->rows || src->cols != ref->cols){
+        printf("FAIL %-12s %-10s size mismatch, %dx%d against %dx%d\n", scene, path, src->cols, src->rows, ref->cols, ref->rows);
+        return 0;
+    }
+    image_init(&diff);
+    int nDiff = image_compare(src, ref, limits->tolerance, &stats, &diff);
+    if(nDiff < 0){
+        printf("FAIL %-12s %-10s not compared\n", scene, path);
+        image_dealloc(&diff);
+        return 0;
+    }
+    int pass = nDiff == 0 || (limits->minPsnr > 0 && stats.psnr >= limits->minPsnr && stats.ssim >= limits->minSsim);
+    printf("%s %-12s %-10s differing pixels %d, max error %.3f, PSNR %.1f dB, SSIM %.4f\n", pass ? "ok  " : "FAIL",
+           scene, path, nDiff, stats.maxError, stats.psnr, stats.ssim);
+    if(!pass){
+        snprintf(filename, sizeof(filename), "%s/%s-%s.ppm", outdir, scene, path);
+        image_write(src, filename);
+        snprintf(filename, sizeof(filename), "%s/%s-%s-diff.ppm", outdir, scene, path);
+        image_write(&diff, filename);
+    }
+    image_dealloc(&diff);
+    return pass;
+}
+
+int main(int argc, char *argv[]){
+    int golden = argc == 3 && strcmp(argv[1], "-g") == 0;
+    if(argc != 3){
+        fprintf(stderr, "usage: %s <golden dir> <output dir>\n       %s -g <golden dir>\n", argv[0], argv[0]);
+        return 2;
+    }
+    char *goldenDir = golden ? argv[2] : argv[1];
+    char *outdir = argv[2];
+    mkdir(outdir, 0755);
+
+    int nScene = sizeof(regress_scenes) / sizeof(regress_scenes[0]);
+    int nPath = sizeof(regress_paths) / sizeof(regress_paths[0]);
+    int failed = 0;
+    for(int i = 0; i < nScene; i++){
+        TestScene t;
+        char filename[1024];
+        regress_scenes[i](&t);
+        snprintf(filename, sizeof(filename), "%s/%s.ppm", goldenDir, t.name);
+
+        Image *reference = path_draw(&t, outdir);
+        if(golden){
+            image_write(reference, filename);
+            printf("wrote %s\n", filename);
+        }else{
+            TestPath exact = {"draw", path_draw, 0.0f, 0.0, 0.0, NeedContext | NeedTextures | NeedImage};
+            Image *stored = image_read(filename);
+            failed += !regress_check(t.name, "draw", reference, stored, &exact, outdir);
+            image_free(stored);
+            for(int k = 0; k < nPath; k++){
+                if(t.needs & ~regress_paths[k].meets){
+                    printf("skip %-12s %s\n", t.name, regress_paths[k].name);
+                    continue;
+                }
+                Image *src = regress_paths[k].draw(&t, outdir);
+                failed += !regress_check(t.name, regress_paths[k].name, src, reference, &regress_paths[k], outdir);
+                image_free(src);
+            }
+        }
+        image_free(reference);
+        regress_end(&t);
+    }
+
+    if(!golden){
+        printf("%d failed\n", failed);
+    }
+    return failed > 0;
+}
@@ -0,0 +1,157 @@
+// vertex transform benchmark
+// times the matrix kernels against the scalar loops they replaced, in millions of vertices
+// (or multiplies) a second on one core, and checks that a vertex transformed on its own
+// and in a batch comes out bit for bit the same
+//
+// usage: xform_bench [vertices]   exit status 1 if the single and batched transforms disagree
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "matrix.h"
+
+#define REPEAT 20
+
+// the scalar point transform matrix_xformPoint used before it was vectorized
+static void bench_scalarXform(Matrix *m, Point *p, Point *q){
+    Point temp;
+    for (int i = 0; i < 4; i++) {
+        temp.val[i] = 0.0;
+        for (int j = 0; j < 4; j++) {
+            temp.val[i] += m->m[i][j] * p->val[j];
+        }
+    }
+    point_copy(q, &temp);
+}
+
+// the scalar matrix multiply matrix_multiply used before it was vectorized
+static void bench_scalarMultiply(Matrix *left, Matrix *right, Matrix *m){
+    Matrix result;
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            result.m[i][j] = 0.0;
+            for (int k = 0; k < 4; k++) {
+                result.m[i][j] += left->m[i][k] * right->m[k][j];
+            }
+        }
+    }
+    matrix_copy(m, &result);
+}
+
+// seconds on the monotonic clock
+static double bench_now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// random value in [-1, 1]
+static double bench_random(void){
+    return 2.0 * rand() / RAND_MAX - 1.0;
+}
+
+int main(int argc, char *argv[]){
+    int n = argc > 1 ? atoi(argv[1]) : 100000;
+    if(n <= 0){
+        fprintf(stderr, "usage: %s [vertices]\n", argv[0]);
+        return 2;
+    }
+
+    Point *p = malloc(n * sizeof(Point));
+    Point *q = malloc(n * sizeof(Point));
+    Point *r = malloc(n * sizeof(Point));
+    Matrix *mats = malloc(n * sizeof(Matrix));
+    if(p == NULL || q == NULL || r == NULL || mats == NULL){
+        fprintf(stderr, "Unable to allocate memory for the benchmark.\n");
+        return 2;
+    }
+
+    srand(5310);
+    Matrix m;
+    for(int i = 0; i < 4; i++){
+        for(int j = 0; j < 4; j++){
+            m.m[i][j] = bench_random();
+        }
+    }
+    for(int i = 0; i < n; i++){
+        point_set(&p[i], bench_random(), bench_random(), bench_random(), 1.0);
+        for(int j = 0; j < 16; j++){
+            mats[i].m[j / 4][j % 4] = bench_random();
+        }
+    }
+
+    // the single-point and batched kernels have to agree exactly, or a polygon and a mesh sharing a vertex could crack
+    int mismatch = 0;
+    matrix_xformPoints(&m, p, r, n);
+    for(int i = 0; i < n; i++){
+        matrix_xformPoint(&m, &p[i], &q[i]);
+        mismatch += memcmp(q[i].val, r[i].val, sizeof(q[i].val)) != 0;
+    }
+
+    double t, scalar, single, batched, scalarMul, multiply;
+    Matrix acc;
+
+    t = bench_now();
+    for(int k = 0; k < REPEAT; k++){
+        for(int i = 0; i < n; i++){
+            bench_scalarXform(&m, &p[i], &q[i]);
+        }
+    }
+    scalar = REPEAT * n / (bench_now() - t) * 1e-6;
+
+    t = bench_now();
+    for(int k = 0; k < REPEAT; k++){
+        for(int i = 0; i < n; i++){
+            matrix_xformPoint(&m, &p[i], &q[i]);
+        }
+    }
+    single = REPEAT * n / (bench_now() - t) * 1e-6;
+
+    t = bench_now();
+    for(int k = 0; k < REPEAT; k++){
+        matrix_xformPoints(&m, p, q, n);
+    }
+    batched = REPEAT * n / (bench_now() - t) * 1e-6;
+
+    matrix_identity(&acc);
+    t = bench_now();
+    for(int k = 0; k < REPEAT; k++){
+        for(int i = 0; i < n; i++){
+            bench_scalarMultiply(&mats[i], &m, &acc);
+        }
+    }
+    scalarMul = REPEAT * n / (bench_now() - t) * 1e-6;
+
+    t = bench_now();
+    for(int k = 0; k < REPEAT; k++){
+        for(int i = 0; i < n; i++){
+            matrix_multiply(&mats[i], &m, &acc);
+        }
+    }
+    multiply = REPEAT * n / (bench_now() - t) * 1e-6;
+
+#if defined(__AVX__)
+    char *kernel = "AVX";
+#elif defined(__SSE2__)
+    char *kernel = "SSE2";
+#else
+    char *kernel = "scalar";
+#endif
+    printf("%s kernels, %d vertices x %d\n", kernel, n, REPEAT);
+    printf("  scalar xformPoint   %7.1f Mvtx/s\n", scalar);
+    printf("  matrix_xformPoint   %7.1f Mvtx/s  %.2fx\n", single, single / scalar);
+    printf("  matrix_xformPoints  %7.1f Mvtx/s  %.2fx\n", batched, batched / scalar);
+    printf("  scalar multiply     %7.1f M/s\n", scalarMul);
+    printf("  matrix_multiply     %7.1f M/s  %.2fx\n", multiply, multiply / scalarMul);
+    printf("%d of %d vertices differ between matrix_xformPoint and matrix_xformPoints\n", mismatch, n);
+
+    // keep the results live
+    if(q[n / 2].val[0] + acc.m[0][0] == 12345.678){
+        printf("\n");
+    }
+    free(p);
+    free(q);
+    free(r);
+    free(mats);
+    return mismatch > 0;
+}